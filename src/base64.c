@@ -29,6 +29,7 @@ void encode_base64(
 
 
 
+#include "instrument.h"
 
 static int code2char(unsigned int c) {
 	c &= 0x3f;
@@ -38,10 +39,7 @@ static int code2char(unsigned int c) {
 		c == 62 ? '+' : '/';
 }
 
-void encode_base64(const unsigned char *src, int src_size, char *(*allocator)(int size, void *context), void *context) {
-	char *dst = allocator((src_size + 2) / 3 * 4, context);
-	if (!dst)
-		return;
+static void encode_to(char *dst, const unsigned char *src, int src_size) {
 	for (; src_size >= 3; src_size -= 3, dst += 4, src += 3) {
 		unsigned int a = src[0];
 		unsigned int b = src[1];
@@ -66,6 +64,16 @@ void encode_base64(const unsigned char *src, int src_size, char *(*allocator)(in
 	}
 }
 
+void encode_base64(const unsigned char *src, int src_size, char *(*allocator)(int size, void *context), void *context) {
+	char *dst;
+	INSTRUMENT_START(start);
+	INSTRUMENT_ALLOCATION(INSTRUMENT_ENCODE_BASE64);
+	dst = allocator((src_size + 2) / 3 * 4, context);
+	if (dst)
+		encode_to(dst, src, src_size);
+	INSTRUMENT_STOP(INSTRUMENT_ENCODE_BASE64, start, dst ? src_size : 0);
+}
+
 static int char2code(const char **s) {
 	for (;;) {
 		char c = *(*s)++;
@@ -73,10 +81,11 @@ static int char2code(const char **s) {
 			if (c >= '0') {
 				if (c <= '9')
 					return c - '0' + 52;
+				if (c == '=') return -1;
 			} else {
 				if (c == '+') return 62;
 				if (c == '/') return 63;
-				if (!c || c == '=') return -1;				
+				if (!c) return -1;
 			}
 		} else {
 			if (c < 'a') {
@@ -103,10 +112,7 @@ static int get_base64_decoded_size(const char *src) {
 	return r;
 }
 
-void decode_base64(const char *src, char *(*allocator)(int size, void *context), void *context) {
-	char *dst = allocator(get_base64_decoded_size(src), context);
-	if (!dst)
-		return;
+static void decode_to(char *dst, const char *src) {
 	for (;;) {
 		int a,b;
 		if ((a = char2code(&src)) < 0 || (b = char2code(&src)) < 0) break;
@@ -118,6 +124,18 @@ void decode_base64(const char *src, char *(*allocator)(int size, void *context),
 	}
 }
 
+void decode_base64(const char *src, char *(*allocator)(int size, void *context), void *context) {
+	int size;
+	char *dst;
+	INSTRUMENT_START(start);
+	size = get_base64_decoded_size(src);
+	INSTRUMENT_ALLOCATION(INSTRUMENT_DECODE_BASE64);
+	dst = allocator(size, context);
+	if (dst)
+		decode_to(dst, src);
+	INSTRUMENT_STOP(INSTRUMENT_DECODE_BASE64, start, dst ? size : 0);
+}
+
 #ifdef TESTS
 
 #include <string.h>
@@ -178,6 +196,10 @@ void decode_base64_tests()
 	decode_base64("YW55IGNhcm5hbCBwbGVhcw=", buffer_allocator, &r);
 	ASSERT(r.size == 16 && memcmp(r.data, "any carnal pleas", r.size) == 0);
 
+	// = ends the data
+	decode_base64("TW=Fu", buffer_allocator, &r);
+	ASSERT(r.size == 1 && memcmp(r.data, "M", r.size) == 0);
+
 	check_two_way(
 		"TWFuIGlzIGRpc3Rpbmd1aXNoZWQsIG5vdCBvbmx5IGJ5IGhpcyByZWFzb24sIGJ1dCBieSB0aGlz"
 		"IHNpbmd1bGFyIHBhc3Npb24gZnJvbSBvdGhlciBhbmltYWxzLCB3aGljaCBpcyBhIGx1c3Qgb2Yg"
@@ -0,0 +1,581 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gunit.h"
+#include "scan.hpp"
+#include "utf8.hpp"
+
+// Benchmarks of the C modules, link all *.c but test_main.c as C without TESTS.
+// Corpora are generated from fixed seeds, so runs on different machines and days compare.
+
+extern "C" {
+void decode_base64(const char* src, char* (*allocator)(int size, void* context), void* context);
+void encode_base64(const unsigned char* src, int src_size, char* (*allocator)(int size, void* context), void* context);
+double calc(const char** expression, const char** out_err_msg);
+double strtodn(const char* s, long max_len, char** end);
+const char* strstrn(const char* text, const char* substring, size_t substring_len);
+int eq_wild(const char* text, const char* wildcard);
+int eq_wild_ci(const char* text, const char* wildcard);
+int eq_wild_utf8_ci(const char* text, const char* wildcard);
+struct wild_pattern* wild_compile(const char* wildcard);
+int eq_wild_compiled(const struct wild_pattern* pattern, const char* text, size_t text_len);
+long long wild_grep(const char* data, size_t size, const char* wildcard, int thread_count,
+    void (*on_match)(void* context, size_t line_offset, size_t line_length), void* context);
+struct scanf_program* scanf_compile(char const* fmt);
+int scanf_exec(struct scanf_program const* program, char const* buf, ...);
+int snscanf(char const* buf, size_t buf_len, char const* fmt, ...);
+struct scan_columns* scan_columns(const char* data, size_t size, const char* format, int thread_count);
+void scan_columns_free(struct scan_columns* columns);
+int get_utf8(int (*get_fn)(void* context), void* get_fn_context);
+int put_utf8(int character, int (*put_fn)(int ch, void* context), void* put_fn_context);
+size_t utf8_decode_buf(const char* src, size_t len, int* dst, size_t cap);
+size_t utf8_encode_buf(const int* src, size_t n, char* dst, size_t cap);
+size_t utf8_validate(const char* src, size_t len, int allow_surrogates);
+size_t utf8_to_utf16(const char* src, size_t len, unsigned short* dst, size_t cap);
+size_t utf16_to_utf8(const unsigned short* src, size_t n, char* dst, size_t cap);
+size_t cp1252_to_utf8(const char* src, size_t len, char* dst, size_t cap);
+size_t utf8_to_cp1252(const char* src, size_t len, char* dst, size_t cap, size_t* unmapped);
+struct utf8_index* utf8_index_build(const char* text, size_t len, size_t block_size);
+void utf8_index_free(struct utf8_index* index);
+size_t utf8_index_offset(const struct utf8_index* index, const char* text, size_t n);
+size_t utf8_index_count(const struct utf8_index* index);
+size_t utf8_decode_parallel(const char* src, size_t len, int* dst, size_t cap, int thread_count);
+size_t utf8_validate_parallel(const char* src, size_t len, int allow_surrogates, int thread_count);
+}
+
+namespace {
+
+struct lcg {
+  unsigned int seed;
+  unsigned int next(unsigned int n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+  }
+};
+
+char* string_allocator(int size, void* context) {
+  std::string* s = static_cast<std::string*>(context);
+  s->resize(size);
+  return &(*s)[0];
+}
+
+const std::string& binary_corpus() {
+  static std::string r;
+  if (r.empty()) {
+    lcg rnd{1};
+    for (int i = 0; i < 48 << 10; i++)
+      r.push_back(static_cast<char>(rnd.next(256)));
+  }
+  return r;
+}
+
+// Lines of a log file: a date, a level, a number, a float and a message.
+const std::string& log_corpus() {
+  static std::string r;
+  if (r.empty()) {
+    static const char* levels[] = {"info", "warning", "error", "debug"};
+    static const char* words[] = {"connection", "timeout", "user", "request", "closed", "retry", "server", "file"};
+    lcg rnd{2};
+    char line[200];
+    for (int i = 0; i < 4000; i++) {
+      int n = std::snprintf(line, sizeof(line), "2024-%02u-%02u %s %u %u.%03u", rnd.next(12) + 1, rnd.next(28) + 1,
+          levels[rnd.next(4)], rnd.next(100000), rnd.next(1000), rnd.next(1000));
+      for (unsigned w = rnd.next(8) + 2; w; w--)
+        n += std::snprintf(line + n, sizeof(line) - n, " %s", words[rnd.next(8)]);
+      r.append(line, n).push_back('\n');
+    }
+  }
+  return r;
+}
+
+std::vector<std::string> log_lines() {
+  std::vector<std::string> r;
+  const std::string& text = log_corpus();
+  for (size_t i = 0, j; i < text.size(); i = j + 1) {
+    j = text.find('\n', i);
+    r.push_back(text.substr(i, j - i));
+  }
+  return r;
+}
+
+// Words of a script, ranges of letters and spaces, about 256Kb.
+std::string utf8_corpus(unsigned seed, int first, int count) {
+  std::string r;
+  auto out = std::back_inserter(r);
+  lcg rnd{seed};
+  while (r.size() < 256 << 10) {
+    for (unsigned n = rnd.next(8) + 1; n; n--)
+      put_utf8(first + static_cast<int>(rnd.next(count)), out);
+    r.push_back(rnd.next(10) ? ' ' : '\n');
+  }
+  return r;
+}
+
+// Mixed text: mostly ASCII with Cyrillic, CJK and emoji words.
+const std::string& mixed_corpus() {
+  static std::string r;
+  if (r.empty()) {
+    lcg rnd{3};
+    auto out = std::back_inserter(r);
+    while (r.size() < 256 << 10) {
+      static const int first[] = {'a', 'a', 'a', 0x430, 0x4e00, 0x1f600};
+      static const int count[] = {26, 26, 26, 32, 5000, 80};
+      int script = rnd.next(6);
+      for (unsigned n = rnd.next(8) + 1; n; n--)
+        put_utf8(first[script] + static_cast<int>(rnd.next(count[script])), out);
+      r.push_back(' ');
+    }
+  }
+  return r;
+}
+
+const std::string& ascii_corpus() {
+  static std::string r = utf8_corpus(4, 'a', 26);
+  return r;
+}
+
+const std::string& cyrillic_corpus() {
+  static std::string r = utf8_corpus(5, 0x430, 32);
+  return r;
+}
+
+const std::string& cjk_corpus() {
+  static std::string r = utf8_corpus(6, 0x4e00, 5000);
+  return r;
+}
+
+// French-like Windows-1252 text: ASCII letters with accented ones and typographic quotes.
+const std::string& cp1252_corpus() {
+  static std::string r;
+  if (r.empty()) {
+    static const char accents[] = "\xe9\xe8\xe0\xe7\xf4\xea\x92\x93\x94";
+    lcg rnd{7};
+    while (r.size() < 256 << 10) {
+      for (unsigned n = rnd.next(8) + 1; n; n--)
+        r.push_back(rnd.next(8) ? static_cast<char>('a' + rnd.next(26)) : accents[rnd.next(9)]);
+      r.push_back(' ');
+    }
+  }
+  return r;
+}
+
+struct string_source {
+  const char* p;
+};
+
+int get_char(void* context) {
+  string_source* s = static_cast<string_source*>(context);
+  return *s->p ? static_cast<unsigned char>(*s->p++) : -1;
+}
+
+int put_char(int c, void* context) {
+  *(*static_cast<char**>(context))++ = static_cast<char>(c);
+  return 1;
+}
+
+void count_line(void* context, size_t, size_t) {
+  ++*static_cast<long long*>(context);
+}
+
+}  // namespace
+
+BENCHMARK(Base64, Encode) {
+  const std::string& data = binary_corpus();
+  std::string out;
+  state.SetBytesPerOp(data.size());
+  for (auto _ : state) {
+    encode_base64(reinterpret_cast<const unsigned char*>(data.data()), static_cast<int>(data.size()), string_allocator, &out);
+    testing::DoNotOptimize(out);
+  }
+}
+
+BENCHMARK(Base64, Decode) {
+  const std::string& data = binary_corpus();
+  std::string encoded, out;
+  encode_base64(reinterpret_cast<const unsigned char*>(data.data()), static_cast<int>(data.size()), string_allocator, &encoded);
+  state.SetBytesPerOp(encoded.size());
+  for (auto _ : state) {
+    decode_base64(encoded.c_str(), string_allocator, &out);
+    testing::DoNotOptimize(out);
+  }
+  ASSERT_TRUE(out == data);
+}
+
+BENCHMARK(Calc, Expressions) {
+  // Random expressions of numbers, operators, powers, functions and parentheses.
+  static const char* parts[] = {"+", "-", "*", "/", "^2+", "*sin(", "+ln(", "-(", "*cos("};
+  lcg rnd{8};
+  std::vector<std::string> exprs;
+  size_t bytes = 0;
+  for (int i = 0; i < 64; i++) {
+    std::string e;
+    int open = 0;
+    for (unsigned n = rnd.next(8) + 2; n; n--) {
+      e += std::to_string(rnd.next(1000) + 1);
+      if (rnd.next(3) == 0)
+        e += "." + std::to_string(rnd.next(100));
+      if (open && rnd.next(3) == 0) {
+        e += ")";
+        open--;
+      }
+      const char* p = parts[rnd.next(9)];
+      open += std::strchr(p, '(') != nullptr;
+      e += p;
+    }
+    e += "1";
+    e.append(open, ')');
+    bytes += e.size();
+    exprs.push_back(e);
+  }
+  state.SetBytesPerOp(bytes);
+  for (auto _ : state) {
+    double sum = 0;
+    for (const std::string& e : exprs) {
+      const char* p = e.c_str();
+      const char* err;
+      sum += calc(&p, &err);
+    }
+    testing::DoNotOptimize(sum);
+  }
+}
+
+BENCHMARK(Strtod, Decimals) {
+  lcg rnd{9};
+  std::string numbers;
+  char buf[40];
+  for (int i = 0; i < 2000; i++) {
+    int n = rnd.next(4) ? std::snprintf(buf, sizeof(buf), "%u.%u ", rnd.next(100000), rnd.next(1000000))
+        : std::snprintf(buf, sizeof(buf), "%.17g ", static_cast<double>(rnd.next(1 << 30)) * 1e-9 * rnd.next(1000));
+    numbers.append(buf, n);
+  }
+  state.SetBytesPerOp(numbers.size());
+  for (auto _ : state) {
+    double sum = 0;
+    const char* end = numbers.data() + numbers.size();
+    for (const char* p = numbers.data(); p < end; p++) {
+      char* next;
+      sum += strtodn(p, static_cast<long>(end - p), &next);
+      p = next;
+    }
+    testing::DoNotOptimize(sum);
+  }
+}
+
+class EqWild : public testing::Benchmark {
+ public:
+  void SetUp() override {
+    lines = log_lines();
+    for (const std::string& l : lines)
+      bytes += l.size();
+    state.SetBytesPerOp(bytes);
+  }
+  std::vector<std::string> lines;
+  size_t bytes = 0;
+};
+
+BENCHMARK_F(EqWild, Match) {
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += eq_wild(l.c_str(), "*error*conn?ction*");
+    testing::DoNotOptimize(n);
+  }
+}
+
+BENCHMARK_F(EqWild, Compiled) {
+  struct wild_pattern* p = wild_compile("*error*conn?ction*");
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += eq_wild_compiled(p, l.data(), l.size());
+    testing::DoNotOptimize(n);
+  }
+  std::free(p);
+}
+
+BENCHMARK_F(EqWild, IgnoreCase) {
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += eq_wild_ci(l.c_str(), "*ERROR*Conn?ction*");
+    testing::DoNotOptimize(n);
+  }
+}
+
+BENCHMARK_F(EqWild, Utf8IgnoreCase) {
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += eq_wild_utf8_ci(l.c_str(), "*ERROR*Conn?ction*");
+    testing::DoNotOptimize(n);
+  }
+}
+
+BENCHMARK_F(EqWild, Strstrn) {
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += strstrn(l.c_str(), "timeout", 7) != nullptr;
+    testing::DoNotOptimize(n);
+  }
+}
+
+// The same work on 1, 2, 4 threads and one per CPU, to see how it scales.
+class WildGrep : public testing::Benchmark {
+ public:
+  void Lines(int thread_count) {
+    const std::string& text = log_corpus();
+    state.SetBytesPerOp(text.size());
+    for (auto _ : state) {
+      long long n = 0;
+      wild_grep(text.data(), text.size(), "*error*conn?ction*", thread_count, count_line, &n);
+      testing::DoNotOptimize(n);
+    }
+  }
+};
+
+BENCHMARK_F(WildGrep, Lines1Thread) { Lines(1); }
+BENCHMARK_F(WildGrep, Lines2Threads) { Lines(2); }
+BENCHMARK_F(WildGrep, Lines4Threads) { Lines(4); }
+BENCHMARK_F(WildGrep, LinesAllThreads) { Lines(0); }
+
+class Sscanf : public EqWild {};
+
+BENCHMARK_F(Sscanf, Cached) {
+  int month, day, number, frac;
+  char level[16];
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += sscanf(l.c_str(), "2024-%d-%d %15s %d.%d", &month, &day, level, &number, &frac);
+    testing::DoNotOptimize(n);
+  }
+}
+
+BENCHMARK_F(Sscanf, Compiled) {
+  int month, day, number, frac;
+  char level[16];
+  struct scanf_program* p = scanf_compile("2024-%d-%d %15s %d.%d");
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += scanf_exec(p, l.c_str(), &month, &day, level, &number, &frac);
+    testing::DoNotOptimize(n);
+  }
+  std::free(p);
+}
+
+BENCHMARK_F(Sscanf, Slices) {
+  int level_len, rest_len;
+  const char *level, *rest;
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += snscanf(l.data(), l.size(), "%*s %.*s %*d %*f %.*[^\n]", &level_len, &level, &rest_len, &rest);
+    testing::DoNotOptimize(n);
+  }
+}
+
+BENCHMARK_F(Sscanf, Template) {
+  int month, day, number, frac;
+  char level[16];
+  for (auto _ : state) {
+    int n = 0;
+    for (const std::string& l : lines)
+      n += scan<"2024-%d-%d %15s %d.%d">(l.c_str(), &month, &day, level, &number, &frac);
+    testing::DoNotOptimize(n);
+  }
+}
+
+// 1, 2, 4 threads and one per CPU. log_corpus has 4000 lines, so lines per second are 4000e9 / median ns.
+class ScanColumns : public testing::Benchmark {
+ public:
+  void Lines(int thread_count) {
+    const std::string& text = log_corpus();
+    state.SetBytesPerOp(text.size());
+    for (auto _ : state) {
+      struct scan_columns* c = scan_columns(text.data(), text.size(), "2024-%d-%d %15s %d %lf", thread_count);
+      testing::DoNotOptimize(c);
+      scan_columns_free(c);
+    }
+  }
+};
+
+BENCHMARK_F(ScanColumns, Lines1Thread) { Lines(1); }
+BENCHMARK_F(ScanColumns, Lines2Threads) { Lines(2); }
+BENCHMARK_F(ScanColumns, Lines4Threads) { Lines(4); }
+BENCHMARK_F(ScanColumns, LinesAllThreads) { Lines(0); }
+
+BENCHMARK(Utf8, GetCallback) {
+  const std::string& text = mixed_corpus();
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state) {
+    string_source s{text.c_str()};
+    int sum = 0;
+    for (int c; (c = get_utf8(get_char, &s)) > 0;)
+      sum += c;
+    testing::DoNotOptimize(sum);
+  }
+}
+
+BENCHMARK(Utf8, GetTemplate) {
+  const std::string& text = mixed_corpus();
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state) {
+    std::pair<const char*, const char*> in(text.data(), text.data() + text.size());
+    int sum = 0;
+    for (int c; (c = get_utf8(in)) > 0;)
+      sum += c;
+    testing::DoNotOptimize(sum);
+  }
+}
+
+BENCHMARK(Utf8, PutCallback) {
+  const std::string& text = mixed_corpus();
+  std::vector<int> chars(text.size());
+  chars.resize(utf8_decode_buf(text.data(), text.size(), chars.data(), chars.size()));
+  std::string out(text.size(), 0);
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state) {
+    char* d = &out[0];
+    for (int c : chars)
+      put_utf8(c, put_char, &d);
+    testing::DoNotOptimize(out);
+  }
+}
+
+BENCHMARK(Utf8, PutTemplate) {
+  const std::string& text = mixed_corpus();
+  std::vector<int> chars(text.size());
+  chars.resize(utf8_decode_buf(text.data(), text.size(), chars.data(), chars.size()));
+  std::string out(text.size(), 0);
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state) {
+    char* d = &out[0];
+    for (int c : chars)
+      put_utf8(c, d);
+    testing::DoNotOptimize(out);
+  }
+}
+
+BENCHMARK(Utf8, DecodeAscii) {
+  const std::string& text = ascii_corpus();
+  std::vector<int> chars(text.size());
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(utf8_decode_buf(text.data(), text.size(), chars.data(), chars.size()));
+}
+
+BENCHMARK(Utf8, DecodeCyrillic) {
+  const std::string& text = cyrillic_corpus();
+  std::vector<int> chars(text.size());
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(utf8_decode_buf(text.data(), text.size(), chars.data(), chars.size()));
+}
+
+BENCHMARK(Utf8, DecodeCjk) {
+  const std::string& text = cjk_corpus();
+  std::vector<int> chars(text.size());
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(utf8_decode_buf(text.data(), text.size(), chars.data(), chars.size()));
+}
+
+BENCHMARK(Utf8, Encode) {
+  const std::string& text = mixed_corpus();
+  std::vector<int> chars(text.size());
+  chars.resize(utf8_decode_buf(text.data(), text.size(), chars.data(), chars.size()));
+  std::string out(text.size(), 0);
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(utf8_encode_buf(chars.data(), chars.size(), &out[0], out.size()));
+}
+
+BENCHMARK(Utf8, Validate) {
+  const std::string& text = mixed_corpus();
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(utf8_validate(text.data(), text.size(), 0));
+}
+
+// 16Mb of the mixed text on 1, 2, 4 threads and one per CPU.
+class Utf8Parallel : public testing::Benchmark {
+ public:
+  void SetUp() override {
+    static std::string big;
+    while (big.size() < 16 << 20)
+      big += mixed_corpus();
+    text = &big;
+    state.SetBytesPerOp(big.size());
+  }
+  void Validate(int thread_count) {
+    for (auto _ : state)
+      testing::DoNotOptimize(utf8_validate_parallel(text->data(), text->size(), 0, thread_count));
+  }
+  void Decode(int thread_count) {
+    static std::vector<int> chars(text->size());
+    for (auto _ : state)
+      testing::DoNotOptimize(utf8_decode_parallel(text->data(), text->size(), chars.data(), chars.size(), thread_count));
+  }
+  const std::string* text = nullptr;
+};
+
+BENCHMARK_F(Utf8Parallel, Validate1Thread) { Validate(1); }
+BENCHMARK_F(Utf8Parallel, Validate2Threads) { Validate(2); }
+BENCHMARK_F(Utf8Parallel, Validate4Threads) { Validate(4); }
+BENCHMARK_F(Utf8Parallel, ValidateAllThreads) { Validate(0); }
+BENCHMARK_F(Utf8Parallel, Decode1Thread) { Decode(1); }
+BENCHMARK_F(Utf8Parallel, Decode2Threads) { Decode(2); }
+BENCHMARK_F(Utf8Parallel, Decode4Threads) { Decode(4); }
+BENCHMARK_F(Utf8Parallel, DecodeAllThreads) { Decode(0); }
+
+BENCHMARK(Utf8, IndexOffset) {
+  const std::string& text = mixed_corpus();
+  struct utf8_index* index = utf8_index_build(text.data(), text.size(), 0);
+  size_t count = utf8_index_count(index);
+  lcg rnd{10};
+  for (auto _ : state)
+    testing::DoNotOptimize(utf8_index_offset(index, text.data(), rnd.next(static_cast<unsigned>(count))));
+  utf8_index_free(index);
+}
+
+BENCHMARK(Utf16, FromUtf8) {
+  const std::string& text = mixed_corpus();
+  std::vector<unsigned short> out(text.size());
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(utf8_to_utf16(text.data(), text.size(), out.data(), out.size()));
+}
+
+BENCHMARK(Utf16, ToUtf8) {
+  const std::string& text = mixed_corpus();
+  std::vector<unsigned short> utf16(text.size());
+  utf16.resize(utf8_to_utf16(text.data(), text.size(), utf16.data(), utf16.size()));
+  std::string out(text.size(), 0);
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(utf16_to_utf8(utf16.data(), utf16.size(), &out[0], out.size()));
+}
+
+BENCHMARK(Latin1, FromCp1252) {
+  const std::string& text = cp1252_corpus();
+  std::string out(text.size() * 3, 0);
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(cp1252_to_utf8(text.data(), text.size(), &out[0], out.size()));
+}
+
+BENCHMARK(Latin1, ToCp1252) {
+  const std::string& text = cp1252_corpus();
+  std::string utf8(text.size() * 3, 0);
+  utf8.resize(cp1252_to_utf8(text.data(), text.size(), &utf8[0], utf8.size()));
+  std::string out(text.size(), 0);
+  size_t unmapped;
+  state.SetBytesPerOp(text.size());
+  for (auto _ : state)
+    testing::DoNotOptimize(utf8_to_cp1252(utf8.data(), utf8.size(), &out[0], out.size(), &unmapped));
+}
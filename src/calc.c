@@ -37,6 +37,13 @@ const unsigned long long PINF_HOLD = 0x7ff0000000000000ULL;
 #define NAN (*(double*)&NAN_HOLD)
 #define INF (*(double*)&PINF_HOLD)
 #endif
+#ifndef INF
+#define INF HUGE_VAL
+#endif
+
+#include "instrument.h"
+
+double strtodn(const char *s, long max_len, char **end);
 
 static double adds(const char **expression, const char **err_msg);
  
@@ -74,7 +81,7 @@ static double un(const char **p, const char **err)
     return is(p, ')') ? r : error(err, "expected ')'");
   } else {
     char *next;
-    double r = strtod(*p, &next);
+    double r = strtodn(*p, 0, &next);
     return next == *p ? error(err, "expected number") : (*p = next, r);
   }
 }
@@ -113,11 +120,14 @@ static double adds(const char **p, const char **err)
 }
 
 double calc(const char **expression, const char **err) {
+	const char *begin = *expression;
 	double r;
+	INSTRUMENT_START(start);
 	*err = "";
 	r = adds(expression, err);
 	if (**expression)
 		r = error(err, "syntax error");
+	INSTRUMENT_STOP(INSTRUMENT_CALC, start, *expression - begin);
 	return r;
 }
 
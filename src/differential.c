@@ -0,0 +1,667 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // memmem
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+//
+// Randomized differential testing of the library against the C library and reference code:
+// sscanf.c against the host vsscanf, strstrn against memmem (a naive search where there is none),
+// base64.c against a table-driven RFC 4648 codec and strtodn against the host strtod.
+// Each kind of case is generated from a seed, run through both sides and compared, including
+// the bytes around every sscanf argument. Mismatching cases are shrunk to the fewest directives
+// and input chars that still mismatch, so they can be pasted into the tests.
+// The same cases are timed on both sides, so the report shows speed gaps next to correctness gaps.
+// Only built with TESTS, where sscanf.c is test_scanf and doesn't replace the host sscanf.
+// The sscanf line leaves out the differences that are by design (see check_scanf), sscanf+ keeps them.
+// Sample (test_main --differential 100000, glibc, -O2):
+//    sscanf     100096 cases      0 mismatches  ours/reference time 1.73
+//    strstrn    100096 cases      0 mismatches  ours/reference time 2.02
+//    base64     100096 cases      0 mismatches  ours/reference time 9.06
+//    strtod     100096 cases      0 mismatches  ours/reference time 0.67
+//    sscanf+    100096 cases  41075 mismatches  ours/reference time 2.24
+//      first: sscanf("475539 ", "%4c%ho%hu%n") is 3, the C library gives 3
+//
+void differential_report(FILE *out, unsigned int seed, long rounds);
+
+#ifdef TESTS
+
+int test_vsscanf(char const *buf, char const *fmt, va_list ap);
+const char *strstrn(const char *text, const char *substring, size_t substring_len);
+void decode_base64(const char *src, char *(*allocator)(int size, void *context), void *context);
+void encode_base64(const unsigned char *src, int src_size, char *(*allocator)(int size, void *context), void *context);
+double strtodn(const char *s, long max_len, char **end);
+
+#define DIFF_MAX_ARGS 8
+#define DIFF_ARG_SIZE 64    // bytes of each argument zone, all strings have smaller widths
+#define DIFF_MAX_INPUT 256
+#define DIFF_BATCH 256      // cases timed at once
+#define DIFF_MAX_NUMBER 1024
+#define DIFF_CHECKS 4       // the ones run_all makes
+
+struct diff_stats {
+	const char *name;
+	long cases, mismatches;
+	clock_t ours, reference;
+	char first[512];        // the first mismatch, shrunk
+};
+
+static unsigned int diff_next(unsigned int *seed, unsigned int n)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 8) % n;
+}
+
+// Copies src as a C string literal body, cut to fit.
+static void diff_quote(char *dst, size_t size, const char *src, size_t len)
+{
+	for (; len && size > 5; src++, len--) {
+		unsigned char c = (unsigned char) *src;
+		int n = c == '\n' ? sprintf(dst, "\\n") : c == '\t' ? sprintf(dst, "\\t") : c == '\r' ? sprintf(dst, "\\r") :
+			c == '"' || c == '\\' ? sprintf(dst, "\\%c", c) : c < ' ' || c > '~' ? sprintf(dst, "\\x%02x", c) : sprintf(dst, "%c", c);
+		dst += n;
+		size -= n;
+	}
+	*dst = 0;
+}
+
+//
+// sscanf (check_scanf): a format is a list of directives, each with a piece of input it matches,
+// which is then damaged a bit to reach the failure paths.
+// Some differences are by design, sscanf_tests pin them:
+// - sscanf.c returns EOF when the first directive fails, the C library returns 0 unless the input ended,
+// - numbers are the longest valid prefix ("1e" is 1), the C library fails after reading the prefix of a longer number,
+// - %s and %[ match an empty string, %n skips white space,
+// - %Nc with less than N chars left fails here, and glibc stores the rest.
+// Cases with known_gaps = false leave these out: the pieces are complete and end with a space,
+// %[ and %c start with a space directive, damage only cuts the input between pieces, and EOF compares equal to 0.
+//
+struct scanf_case {
+	int count;
+	char directives[DIFF_MAX_ARGS * 2][24];
+	char pieces[DIFF_MAX_ARGS * 2][48];
+	int cut;  // the number of pieces in the input
+};
+
+static void scanf_format(const struct scanf_case *c, char *fmt)
+{
+	int i;
+	*fmt = 0;
+	for (i = 0; i < c->count; i++)
+		strcat(fmt, c->directives[i]);
+}
+
+static void scanf_input(const struct scanf_case *c, char *input)
+{
+	int i;
+	*input = 0;
+	for (i = 0; i < c->count && i < c->cut; i++)
+		strcat(input, c->pieces[i]);
+}
+
+static int scanf_assigns(const char *directive)
+{
+	if (*directive == ' ')
+		directive++;
+	return directive[0] == '%' && directive[1] != '%' && directive[1] != '*';
+}
+
+static void random_digits(unsigned int *seed, char *dst, const char *digits, int count)
+{
+	int n = (int) strlen(digits);
+	while (count--)
+		*dst++ = digits[diff_next(seed, n)];
+	*dst = 0;
+}
+
+static void generate_directive(unsigned int *seed, char *directive, char *input, int known_gaps)
+{
+	static const char *int_mods[] = { "", "hh", "h", "l", "ll" };
+	static const char int_convs[] = "diouxX";
+	// Sets and chars they have.
+	static const char *sets[][2] = { { "[a-c]", "abc" }, { "[^ ]", "abc]-x09" }, { "[]a]", "]a" }, { "[^]x]", "abc-09" },
+		{ "[0-9a-f]", "09af" }, { "[-a]", "-a" } };
+	char width[8] = "";
+	const char *star = diff_next(seed, 8) ? "" : "*";
+	// Empty matches and leading white space differ by design, and pieces end with a space, so these start with a space directive.
+	const char *space = known_gaps ? "" : " ";
+	unsigned int n = diff_next(seed, 24) + 1;
+	if (diff_next(seed, 3) == 0)
+		sprintf(width, "%u", diff_next(seed, 12) + 1);
+	switch (diff_next(seed, 9)) {
+	case 0: case 1: { // integers
+		char conv = int_convs[diff_next(seed, 6)];
+		int hex = (conv == 'x' || conv == 'X' || conv == 'i') && diff_next(seed, 3) == 0 && (known_gaps || !*width);
+		// %i reads 0 as octal and no letters without 0x.
+		const char *digits = conv == 'o' ? "01234567" : conv == 'd' || conv == 'u' ? "0123456789" :
+			conv == 'i' && !hex && !known_gaps ? "123456789" : "0123456789abcdefABCDEF";
+		if (!known_gaps && *width)
+			sprintf(width, "%u", n + 1 + diff_next(seed, 4));
+		sprintf(directive, "%%%s%s%s%c", star, width, int_mods[diff_next(seed, 5)], conv);
+		input += sprintf(input, "%s%s", diff_next(seed, 4) ? "" : diff_next(seed, 2) ? "-" : "+", hex ? "0x" : "");
+		random_digits(seed, input, digits, known_gaps ? (int) n - 1 : (int) n);
+		break;
+	}
+#ifdef CONFIG_LIBC_FLOATINGPOINT
+	case 2: { // floats
+		static const char float_convs[] = "fFeEgGaA";
+		static const char *floats[] = { "1.5", "-0.25e3", ".5", "0x1.8p1", "inf", "-INFINITY", "nan", "1e400", "1e-400", "+7",
+			"1e", "1e+", ".", "0x", "infin", "nan(" };
+		sprintf(directive, "%%%s%s%s%c", star, known_gaps ? width : "", diff_next(seed, 2) ? "l" : "", float_convs[diff_next(seed, 8)]);
+		if (diff_next(seed, 3))
+			sprintf(input, "%u.%ue%d", diff_next(seed, 100000), diff_next(seed, 1000), (int) diff_next(seed, 60) - 30);
+		else
+			strcpy(input, floats[diff_next(seed, known_gaps ? 16 : 10)]);
+		break;
+	}
+#endif
+	case 3: // strings
+		sprintf(directive, "%%%s%us", star, known_gaps ? diff_next(seed, 20) + 1 : n + diff_next(seed, 4));
+		random_digits(seed, input, "abcXYZ09-", n);
+		break;
+	case 4: // chars
+		n = diff_next(seed, 5) + 1;
+		sprintf(directive, "%s%%%s%uc", space, star, n);
+		random_digits(seed, input, known_gaps ? "ab \t\n" : "ab", known_gaps ? 5 : n);
+		break;
+	case 5: { // sets
+		int set = diff_next(seed, 6);
+		n = diff_next(seed, 10) + !known_gaps;
+		// [^]x] takes the space after the piece too.
+		sprintf(directive, "%s%%%s%u%s", space, star, known_gaps ? diff_next(seed, 20) + 1 : n, sets[set][0]);
+		random_digits(seed, input, known_gaps ? "abc]-x 09" : sets[set][1], n);
+		break;
+	}
+	case 6: // counts and percents
+		if (diff_next(seed, 2)) {
+			sprintf(directive, "%s%%n", space);
+			*input = 0;
+		} else {
+			strcpy(directive, "%%");
+			strcpy(input, "%");
+		}
+		break;
+	case 7: // white space
+		strcpy(directive, diff_next(seed, 2) ? " " : "\n");
+		random_digits(seed, input, " \t\n", diff_next(seed, 4));
+		break;
+	default: // literals
+		random_digits(seed, directive, "ab,:", 1);
+		strcpy(input, directive);
+		break;
+	}
+}
+
+// Whether the first directive from i on to fail at the end of input is not a %s or %[, which succeed there by design,
+// or a %c, which glibc fills with what is left.
+static int fails_at_end(const struct scanf_case *c, int i)
+{
+	for (; i < c->count; i++) {
+		const char *d = c->directives[i];
+		size_t n = strlen(d);
+		if (*d > ' ' || d[1])
+			return !strchr("s]nc", d[n - 1]);
+	}
+	return 1;
+}
+
+static void generate_scanf_case(unsigned int *seed, struct scanf_case *c, int known_gaps)
+{
+	int args = 0;
+	c->count = 0;
+	while (c->count < DIFF_MAX_ARGS * 2 && args < DIFF_MAX_ARGS && diff_next(seed, 6)) {
+		char *piece = c->pieces[c->count];
+		int n;
+		generate_directive(seed, c->directives[c->count], piece, known_gaps);
+		args += scanf_assigns(c->directives[c->count++]);
+		n = (int) strlen(piece);
+		if (!known_gaps || diff_next(seed, 3) == 0)
+			strcpy(piece + n, " ");
+		// A replaced or dropped char.
+		else if (n && diff_next(seed, 6) == 0) {
+			int at = diff_next(seed, n);
+			if (diff_next(seed, 2))
+				piece[at] = "0x-+. e9a"[diff_next(seed, 9)];
+			else
+				memmove(piece + at, piece + at + 1, n - at);
+		}
+	}
+	c->cut = diff_next(seed, 4) ? c->count : (int) diff_next(seed, c->count + 1);
+	if (!known_gaps && !fails_at_end(c, c->cut))
+		c->cut = c->count;
+}
+
+static int call_scanf(int (*scan)(char const *buf, char const *fmt, va_list ap), const char *input, const char *fmt, char *zones, ...)
+{
+	va_list ap;
+	int r;
+	va_start(ap, zones);
+	r = scan(input, fmt, ap);
+	va_end(ap);
+	return r;
+}
+
+static int run_scanf(int (*scan)(char const *buf, char const *fmt, va_list ap), const char *input, const char *fmt, char *zones)
+{
+	// Unused arguments are ignored, so all of them are passed.
+	memset(zones, 0xaa, DIFF_MAX_ARGS * DIFF_ARG_SIZE);
+	return call_scanf(scan, input, fmt, zones,
+		zones, zones + DIFF_ARG_SIZE, zones + DIFF_ARG_SIZE * 2, zones + DIFF_ARG_SIZE * 3,
+		zones + DIFF_ARG_SIZE * 4, zones + DIFF_ARG_SIZE * 5, zones + DIFF_ARG_SIZE * 6, zones + DIFF_ARG_SIZE * 7);
+}
+
+// 0 if both sides agree, or else a code of the results, so that shrinking keeps the kind of the mismatch.
+static int scanf_differs(const struct scanf_case *c, int known_gaps)
+{
+	char fmt[DIFF_MAX_ARGS * 2 * 24], input[DIFF_MAX_ARGS * 2 * 48];
+	char ours[DIFF_MAX_ARGS * DIFF_ARG_SIZE], reference[DIFF_MAX_ARGS * DIFF_ARG_SIZE];
+	int r1, r2;
+	scanf_format(c, fmt);
+	scanf_input(c, input);
+	r1 = run_scanf(test_vsscanf, input, fmt, ours);
+	r2 = run_scanf(vsscanf, input, fmt, reference);
+	if (!known_gaps && r1 <= 0 && r2 <= 0)
+		r1 = r2;
+	if (r1 == r2 && memcmp(ours, reference, sizeof(ours)) == 0)
+		return 0;
+	return ((r1 + 2) * 32 + r2 + 2) * 2 + (r1 == r2);
+}
+
+// Drops directives with their input, then input chars, while the case still mismatches.
+static void shrink_scanf_case(struct scanf_case *c, int known_gaps)
+{
+	int i, j, shrunk = 1, kind = scanf_differs(c, known_gaps);
+	while (shrunk) {
+		shrunk = 0;
+		for (i = 0; i < c->count; i++) {
+			struct scanf_case t = *c;
+			memmove(t.directives[i], t.directives[i + 1], sizeof(t.directives[0]) * (t.count - i - 1));
+			memmove(t.pieces[i], t.pieces[i + 1], sizeof(t.pieces[0]) * (t.count - i - 1));
+			t.count--;
+			t.cut -= i < t.cut;
+			if ((known_gaps || t.cut == t.count || fails_at_end(&t, t.cut)) && scanf_differs(&t, known_gaps) == kind) {
+				*c = t;
+				shrunk = 1;
+				i--;
+			}
+		}
+		for (i = 0; known_gaps && i < c->count; i++) {
+			for (j = 0; c->pieces[i][j]; j++) {
+				struct scanf_case t = *c;
+				memmove(t.pieces[i] + j, t.pieces[i] + j + 1, strlen(t.pieces[i] + j));
+				if (scanf_differs(&t, known_gaps) == kind) {
+					*c = t;
+					shrunk = 1;
+					j--;
+				}
+			}
+		}
+	}
+}
+
+static void check_scanf(unsigned int seed, long rounds, int known_gaps, struct diff_stats *stats)
+{
+	struct scanf_case *cases = (struct scanf_case *) malloc(sizeof(struct scanf_case) * DIFF_BATCH);
+	static char fmt[DIFF_BATCH][DIFF_MAX_ARGS * 2 * 24], input[DIFF_BATCH][DIFF_MAX_ARGS * 2 * 48];
+	char zones[DIFF_MAX_ARGS * DIFF_ARG_SIZE], quoted[2][200];
+	long done;
+	int i;
+	stats->name = known_gaps ? "sscanf+" : "sscanf";
+	for (done = 0; done < rounds; done += DIFF_BATCH) {
+		clock_t t;
+		for (i = 0; i < DIFF_BATCH; i++) {
+			generate_scanf_case(&seed, &cases[i], known_gaps);
+			scanf_format(&cases[i], fmt[i]);
+			scanf_input(&cases[i], input[i]);
+		}
+		t = clock();
+		for (i = 0; i < DIFF_BATCH; i++)
+			run_scanf(test_vsscanf, input[i], fmt[i], zones);
+		stats->ours += clock() - t;
+		t = clock();
+		for (i = 0; i < DIFF_BATCH; i++)
+			run_scanf(vsscanf, input[i], fmt[i], zones);
+		stats->reference += clock() - t;
+		for (i = 0; i < DIFF_BATCH; i++) {
+			stats->cases++;
+			if (scanf_differs(&cases[i], known_gaps) && stats->mismatches++ == 0) {
+				shrink_scanf_case(&cases[i], known_gaps);
+				scanf_format(&cases[i], fmt[i]);
+				scanf_input(&cases[i], input[i]);
+				diff_quote(quoted[0], sizeof(quoted[0]), input[i], strlen(input[i]));
+				diff_quote(quoted[1], sizeof(quoted[1]), fmt[i], strlen(fmt[i]));
+				snprintf(stats->first, sizeof(stats->first), "sscanf(\"%s\", \"%s\") is %d, the C library gives %d",
+					quoted[0], quoted[1], run_scanf(test_vsscanf, input[i], fmt[i], zones), run_scanf(vsscanf, input[i], fmt[i], zones));
+			}
+		}
+	}
+	free(cases);
+}
+
+//
+// strstrn: texts and substrings of few letters, so that partial matches are frequent.
+//
+static const char *naive_search(const char *text, const char *substring, size_t substring_len)
+{
+	size_t len = strlen(text), i;
+	for (i = 0; i + substring_len <= len; i++) {
+		if (memcmp(text + i, substring, substring_len) == 0)
+			return text + i;
+	}
+	return NULL;
+}
+
+static const char *reference_search(const char *text, const char *substring, size_t substring_len)
+{
+#ifdef __GLIBC__
+	return (const char *) memmem(text, strlen(text), substring, substring_len);
+#else
+	return naive_search(text, substring, substring_len);
+#endif
+}
+
+static void check_strstrn(unsigned int seed, long rounds, struct diff_stats *stats)
+{
+	static char texts[DIFF_BATCH][DIFF_MAX_INPUT], substrings[DIFF_BATCH][16];
+	static size_t lens[DIFF_BATCH];
+	long done;
+	int i, k;
+	stats->name = "strstrn";
+	for (done = 0; done < rounds; done += DIFF_BATCH) {
+		clock_t t;
+		for (i = 0; i < DIFF_BATCH; i++) {
+			size_t n = diff_next(&seed, DIFF_MAX_INPUT);
+			random_digits(&seed, texts[i], diff_next(&seed, 2) ? "ab" : "abcd", (int) n);
+			lens[i] = diff_next(&seed, 9);
+			if (n > lens[i] && diff_next(&seed, 2))
+				memcpy(substrings[i], texts[i] + diff_next(&seed, (unsigned int) (n - lens[i])), lens[i]);
+			else
+				random_digits(&seed, substrings[i], "abc", (int) lens[i]);
+			// Not terminated after the length.
+			substrings[i][lens[i]] = 'a';
+		}
+		for (k = 0; k < 2; k++) {
+			// Called through a volatile pointer, so memmem, which is pure, is not moved out of the loops.
+			const char *(*volatile search)(const char *, const char *, size_t) = k ? reference_search : strstrn;
+			int j;
+			t = clock();
+			for (j = 0; j < 8; j++)
+				for (i = 0; i < DIFF_BATCH; i++)
+					search(texts[i], substrings[i], lens[i]);
+			*(k ? &stats->reference : &stats->ours) += clock() - t;
+		}
+		for (i = 0; i < DIFF_BATCH; i++) {
+			stats->cases++;
+			if (strstrn(texts[i], substrings[i], lens[i]) != naive_search(texts[i], substrings[i], lens[i]) &&
+				stats->mismatches++ == 0)
+			{
+				char quoted[2][240];
+				diff_quote(quoted[0], sizeof(quoted[0]), texts[i], strlen(texts[i]));
+				diff_quote(quoted[1], sizeof(quoted[1]), substrings[i], lens[i]);
+				snprintf(stats->first, sizeof(stats->first), "strstrn(\"%s\", \"%s\", %u)", quoted[0], quoted[1], (unsigned) lens[i]);
+			}
+		}
+	}
+}
+
+//
+// base64: encoding of random bytes, and decoding of the encodings with line breaks,
+// junk chars and cut off tails, which both sides skip or stop at.
+//
+struct diff_buffer {
+	int size;
+	char data[DIFF_MAX_INPUT * 2];
+};
+
+static char *diff_allocator(int size, void *context)
+{
+	struct diff_buffer *b = (struct diff_buffer *) context;
+	b->size = size;
+	return size <= (int) sizeof(b->data) ? b->data : NULL;
+}
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int reference_encode(const unsigned char *src, int len, char *dst)
+{
+	char *d = dst;
+	int i;
+	for (i = 0; i < len; i += 3) {
+		unsigned int v = src[i] << 16 | (i + 1 < len ? src[i + 1] << 8 : 0) | (i + 2 < len ? src[i + 2] : 0);
+		*d++ = base64_alphabet[v >> 18];
+		*d++ = base64_alphabet[v >> 12 & 63];
+		*d++ = i + 1 < len ? base64_alphabet[v >> 6 & 63] : '=';
+		*d++ = i + 2 < len ? base64_alphabet[v & 63] : '=';
+	}
+	return (int) (d - dst);
+}
+
+static int reference_decode(const char *src, char *dst)
+{
+	static signed char codes[256];
+	unsigned int bits = 0;
+	int count = 0, n = 0;
+	if (!codes['B']) {
+		int i;
+		memset(codes, -1, sizeof(codes));
+		for (i = 0; i < 64; i++)
+			codes[(unsigned char) base64_alphabet[i]] = (signed char) i;
+	}
+	for (; *src && *src != '='; src++) {
+		int c = codes[(unsigned char) *src];
+		if (c < 0)
+			continue;
+		bits = bits << 6 | c;
+		if ((count += 6) >= 8)
+			dst[n++] = (char) (bits >> (count -= 8));
+	}
+	return n;
+}
+
+static void check_base64(unsigned int seed, long rounds, struct diff_stats *stats)
+{
+	static unsigned char raw[DIFF_BATCH][DIFF_MAX_INPUT / 2];
+	static char encoded[DIFF_BATCH][DIFF_MAX_INPUT * 2];
+	static int lens[DIFF_BATCH];
+	struct diff_buffer ours;
+	static char reference[DIFF_MAX_INPUT * 2];
+	long done;
+	int i, j;
+	stats->name = "base64";
+	for (done = 0; done < rounds; done += DIFF_BATCH) {
+		clock_t t;
+		for (i = 0; i < DIFF_BATCH; i++) {
+			int n;
+			lens[i] = diff_next(&seed, DIFF_MAX_INPUT / 2);
+			for (j = 0; j < lens[i]; j++)
+				raw[i][j] = (unsigned char) diff_next(&seed, 256);
+			n = reference_encode(raw[i], lens[i], encoded[i]);
+			encoded[i][n] = 0;
+		}
+		t = clock();
+		for (i = 0; i < DIFF_BATCH; i++) {
+			encode_base64(raw[i], lens[i], diff_allocator, &ours);
+			decode_base64(encoded[i], diff_allocator, &ours);
+		}
+		stats->ours += clock() - t;
+		t = clock();
+		for (i = 0; i < DIFF_BATCH; i++) {
+			reference_encode(raw[i], lens[i], reference);
+			reference_decode(encoded[i], reference);
+		}
+		stats->reference += clock() - t;
+		for (i = 0; i < DIFF_BATCH; i++) {
+			int n = (int) strlen(encoded[i]), at;
+			stats->cases++;
+			encode_base64(raw[i], lens[i], diff_allocator, &ours);
+			if (ours.size != n || memcmp(ours.data, encoded[i], n) != 0) {
+				if (stats->mismatches++ == 0)
+					snprintf(stats->first, sizeof(stats->first), "encode_base64 of %d bytes", lens[i]);
+				continue;
+			}
+			// Junk, line breaks and cuts.
+			for (j = diff_next(&seed, 4); j > 0 && n > 0 && n < (int) sizeof(encoded[i]) - 1; j--) {
+				at = diff_next(&seed, n);
+				memmove(encoded[i] + at + 1, encoded[i] + at, n - at + 1);
+				encoded[i][at] = "\n \r-_.\x80="[diff_next(&seed, 8)];
+				n++;
+			}
+			if (n > 0 && diff_next(&seed, 4) == 0)
+				encoded[i][diff_next(&seed, n)] = 0;
+			decode_base64(encoded[i], diff_allocator, &ours);
+			n = reference_decode(encoded[i], reference);
+			if ((ours.size != n || memcmp(ours.data, reference, n) != 0) && stats->mismatches++ == 0) {
+				char quoted[480];
+				diff_quote(quoted, sizeof(quoted), encoded[i], strlen(encoded[i]));
+				snprintf(stats->first, sizeof(stats->first), "decode_base64(\"%s\")", quoted);
+			}
+		}
+	}
+}
+
+//
+// strtod: short and long decimals, exponents near the +-400 clamp offset by as many zeros
+// in the digits, decimals close to halfway between doubles and hexadecimal numbers.
+//
+static void random_decimal(unsigned int *seed, char *dst, int digits)
+{
+	int dot = diff_next(seed, digits + 2), i;
+	for (i = 0; i < digits; i++) {
+		if (i == dot)
+			*dst++ = '.';
+		// Runs of 0 and 9 are close to the rounding boundaries.
+		*dst++ = diff_next(seed, 4) ? (char) ('0' + diff_next(seed, 10)) : i % 2 ? '0' : '9';
+	}
+	*dst = 0;
+}
+
+static void generate_number(unsigned int *seed, char *dst)
+{
+	int zeros = 300 + diff_next(seed, 200);
+	if (diff_next(seed, 4) == 0)
+		*dst++ = diff_next(seed, 2) ? '-' : '+';
+	switch (diff_next(seed, 6)) {
+	case 0: // short
+		random_decimal(seed, dst, diff_next(seed, 20) + 1);
+		if (diff_next(seed, 3))
+			sprintf(dst + strlen(dst), "e%d", (int) diff_next(seed, 700) - 350);
+		break;
+	case 1: // long
+		random_decimal(seed, dst, diff_next(seed, 700) + 20);
+		sprintf(dst + strlen(dst), "e%d", (int) diff_next(seed, 800) - 400);
+		break;
+	case 2: // point far left, exponent far right
+		dst += sprintf(dst, "0.");
+		memset(dst, '0', zeros);
+		random_digits(seed, dst + zeros, "0123456789", diff_next(seed, 30) + 1);
+		sprintf(dst + strlen(dst), "e%d", zeros + (int) diff_next(seed, 660) - 340);
+		break;
+	case 3: // point far right, exponent far left
+		random_digits(seed, dst, "123456789", 1);
+		random_digits(seed, dst + 1, "0123456789", diff_next(seed, 30));
+		dst += strlen(dst);
+		memset(dst, '0', zeros);
+		sprintf(dst + zeros, "e%d", (int) diff_next(seed, 660) - 340 - zeros);
+		break;
+	case 4: { // close to halfway
+		unsigned long long bits = (unsigned long long) diff_next(seed, 1 << 24) << 40 ^
+			(unsigned long long) diff_next(seed, 1 << 24) << 16 ^ diff_next(seed, 1 << 24);
+		double d;
+		bits &= ~(1ULL << 63);
+		memcpy(&d, &bits, sizeof d);
+		sprintf(dst, "%.*e", (int) diff_next(seed, 30) + 15, d);
+		break;
+	}
+	default: // hexadecimal
+		dst += sprintf(dst, diff_next(seed, 2) ? "0x" : "0X");
+		random_digits(seed, dst, "0123456789abcdefABCDEF", diff_next(seed, 20) + 1);
+		if (diff_next(seed, 2))
+			dst[diff_next(seed, (unsigned int) strlen(dst) + 1)] = '.';
+		if (diff_next(seed, 4))
+			sprintf(dst + strlen(dst), "p%d", (int) diff_next(seed, 2200) - 1100);
+		break;
+	}
+}
+
+static void check_strtod(unsigned int seed, long rounds, struct diff_stats *stats)
+{
+	static char numbers[DIFF_BATCH][DIFF_MAX_NUMBER];
+	long done;
+	int i;
+	stats->name = "strtod";
+	for (done = 0; done < rounds; done += DIFF_BATCH) {
+		clock_t t;
+		char *end;
+		for (i = 0; i < DIFF_BATCH; i++)
+			generate_number(&seed, numbers[i]);
+		t = clock();
+		for (i = 0; i < DIFF_BATCH; i++)
+			strtodn(numbers[i], 0, &end);
+		stats->ours += clock() - t;
+		t = clock();
+		for (i = 0; i < DIFF_BATCH; i++)
+			strtod(numbers[i], &end);
+		stats->reference += clock() - t;
+		for (i = 0; i < DIFF_BATCH; i++) {
+			char *expected_end;
+			double r = strtodn(numbers[i], 0, &end), expected = strtod(numbers[i], &expected_end);
+			stats->cases++;
+			if ((end != expected_end || (memcmp(&r, &expected, sizeof r) != 0 && (r == r || expected == expected))) &&
+				stats->mismatches++ == 0)
+			{
+				char quoted[400];
+				diff_quote(quoted, sizeof(quoted), numbers[i], strlen(numbers[i]));
+				snprintf(stats->first, sizeof(stats->first), "strtodn(\"%s\") is %.17g, the C library gives %.17g",
+					quoted, r, expected);
+			}
+		}
+	}
+}
+
+// The checks that are expected to agree, sscanf without the known gaps.
+static void run_all(unsigned int seed, long rounds, struct diff_stats *stats)
+{
+	memset(stats, 0, sizeof(struct diff_stats) * DIFF_CHECKS);
+	check_scanf(seed, rounds, 0, &stats[0]);
+	check_strstrn(seed, rounds, &stats[1]);
+	check_base64(seed, rounds, &stats[2]);
+	check_strtod(seed, rounds, &stats[3]);
+}
+
+void differential_report(FILE *out, unsigned int seed, long rounds)
+{
+	struct diff_stats stats[DIFF_CHECKS + 1];
+	int i;
+	run_all(seed, rounds, stats);
+	memset(&stats[DIFF_CHECKS], 0, sizeof(stats[DIFF_CHECKS]));
+	check_scanf(seed, rounds, 1, &stats[DIFF_CHECKS]);
+	for (i = 0; i <= DIFF_CHECKS; i++) {
+		fprintf(out, "%-8s %8ld cases %6ld mismatches  ours/reference time %.2f\n", stats[i].name, stats[i].cases, stats[i].mismatches,
+			stats[i].reference ? (double) stats[i].ours / stats[i].reference : 0.0);
+		if (stats[i].mismatches)
+			fprintf(out, "  first: %s\n", stats[i].first);
+	}
+}
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+void differential_tests()
+{
+	struct diff_stats stats[DIFF_CHECKS];
+	int i;
+	run_all(1, 10000, stats);
+	for (i = 0; i < DIFF_CHECKS; i++) {
+		if (stats[i].mismatches)
+			printf("%s\n", stats[i].first);
+		ASSERT(stats[i].mismatches == 0);
+	}
+}
+
+#endif //TESTS
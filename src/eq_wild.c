@@ -1,4 +1,7 @@
 #include <string.h>
+#include <stdlib.h>
+
+#include "instrument.h"
 
 #ifndef __cplusplus
 
@@ -25,15 +28,214 @@ const char *strstrn(const char *text, const char *substring, size_t substring_le
 	}
 }
 
+static bool match_wild(const char *text, const char *wildcard) {
+	const char *asterisk_pos = strchr(wildcard, '*');
+	if (!asterisk_pos)
+		return strcmp(text, wildcard) == 0;
+	if (strncmp(text, wildcard, asterisk_pos - wildcard))
+		return false;
+	text += asterisk_pos - wildcard;
+	wildcard = asterisk_pos + 1;
+	for (;;) {
+		if (*wildcard == 0)
+			return true;
+		asterisk_pos = strchr(wildcard, '*');
+		if (!asterisk_pos) {
+			const char *text_tail = text + strlen(text) - strlen(wildcard);
+			return text_tail >= text && strcmp(wildcard, text_tail) == 0;
+		} else {
+			const char *fragment_pos = strstrn(text, wildcard, asterisk_pos - wildcard);
+			if (!fragment_pos)
+				return false;
+			text = fragment_pos + (asterisk_pos - wildcard);
+			wildcard = asterisk_pos + 1;
+		}
+	}
+}
+
 //
 // Matches a text against a wildcard having '*'.
 // See eq_wild_tests for usage samples.
 //
 bool eq_wild(const char *text, const char *wildcard) {
+	bool r;
+	INSTRUMENT_START(start);
+	r = match_wild(text, wildcard);
+	INSTRUMENT_STOP(INSTRUMENT_EQ_WILD, start, strlen(text));
+	return r;
+}
+
+//
+// Searches for a substring in a text of the given length.
+// Acts as strstrn, but the text is not zero-terminated either.
+//
+static const char *memstrn(const char *text, size_t text_len, const char *substring, size_t substring_len) {
+	const char *end = text + text_len;
+	if (!substring_len)
+		return text;
+	while ((size_t)(end - text) >= substring_len) {
+		const char *r = (const char *) memchr(text, *substring, end - text - substring_len + 1);
+		if (!r)
+			return NULL;
+		if (memcmp(r, substring, substring_len) == 0)
+			return r;
+		text = r + 1;
+	}
+	return NULL;
+}
+
+//
+// A wildcard split at '*' into fragments once, to be matched against many texts.
+// Fragments point inside the wildcard string, so it must outlive the compiled pattern.
+//
+struct wild_fragment {
+	const char *s;
+	size_t len;
+};
+
+struct wild_pattern {
+	int fragment_count;  // number of '*' + 1
+	struct wild_fragment fragments[1];
+};
+
+//
+// Compiles the wildcard for eq_wild_compiled.
+// Returns NULL if out of memory. Release the result with free().
+//
+struct wild_pattern *wild_compile(const char *wildcard) {
+	int count = 1;
+	const char *p;
+	struct wild_pattern *r;
+	for (p = wildcard; (p = strchr(p, '*')) != NULL; p++)
+		count++;
+	INSTRUMENT_ALLOCATION(INSTRUMENT_EQ_WILD);
+	r = (struct wild_pattern *) malloc(sizeof(struct wild_pattern) + sizeof(struct wild_fragment) * (count - 1));
+	if (!r)
+		return NULL;
+	r->fragment_count = count;
+	for (count = 0;; count++) {
+		const char *asterisk_pos = strchr(wildcard, '*');
+		r->fragments[count].s = wildcard;
+		if (!asterisk_pos) {
+			r->fragments[count].len = strlen(wildcard);
+			return r;
+		}
+		r->fragments[count].len = asterisk_pos - wildcard;
+		wildcard = asterisk_pos + 1;
+	}
+}
+
+//
+// Matches a text of the given length (not necessarily zero-terminated) against a compiled wildcard.
+// Gives the same results as eq_wild, but doesn't rescan the wildcard on each call.
+//
+bool eq_wild_compiled(const struct wild_pattern *pattern, const char *text, size_t text_len) {
+	const struct wild_fragment *f = pattern->fragments;
+	const struct wild_fragment *last = f + pattern->fragment_count - 1;
+	const char *end = text + text_len;
+	if (f == last)
+		return text_len == f->len && memcmp(text, f->s, text_len) == 0;
+	if (text_len < f->len || memcmp(text, f->s, f->len) != 0)
+		return false;
+	text += f->len;
+	for (f++; f != last; f++) {
+		const char *fragment_pos = memstrn(text, end - text, f->s, f->len);
+		if (!fragment_pos)
+			return false;
+		text = fragment_pos + f->len;
+	}
+	return (size_t)(end - text) >= last->len && memcmp(end - last->len, last->s, last->len) == 0;
+}
+
+// Aligned block reads may touch bytes past the terminating zero (never past a page),
+// which AddressSanitizer reports, so sanitized builds use the scalar code.
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(__SANITIZE_ADDRESS__)
+#include <emmintrin.h>
+#define EQ_WILD_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+static int lowest_bit(unsigned int mask) { unsigned long r; _BitScanForward(&r, mask); return (int) r; }
+#else
+#define lowest_bit(mask) __builtin_ctz(mask)
+#endif
+#endif
+
+static int fold_ascii(int c) {
+	return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+//
+// Acts as strncmp(a, b, n) == 0, but ignores ASCII letter case.
+//
+static bool eq_n_ci(const char *a, const char *b, size_t n) {
+	for (; n; n--, a++, b++) {
+		if (fold_ascii((unsigned char) *a) != fold_ascii((unsigned char) *b))
+			return false;
+		if (!*a)
+			return true;
+	}
+	return true;
+}
+
+//
+// Acts as strchr(text, c), but ignores ASCII letter case. The c must be already folded and nonzero.
+//
+static const char *strchr_ci(const char *text, int c) {
+#ifdef EQ_WILD_SSE2
+	const __m128i needle = _mm_set1_epi8((char) c);
+	const __m128i before_a = _mm_set1_epi8('A' - 1);
+	const __m128i after_z = _mm_set1_epi8('Z' + 1);
+	const __m128i case_bit = _mm_set1_epi8('a' - 'A');
+	const __m128i *block = (const __m128i *) ((size_t) text & ~(size_t) 15);
+	unsigned int skip_mask = ~0u << ((size_t) text & 15);
+	for (;; block++, skip_mask = ~0u) {
+		__m128i v = _mm_load_si128(block);
+		__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, before_a), _mm_cmplt_epi8(v, after_z));
+		__m128i folded = _mm_or_si128(v, _mm_and_si128(upper, case_bit));
+		unsigned int found = _mm_movemask_epi8(_mm_cmpeq_epi8(folded, needle)) & skip_mask;
+		unsigned int zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) & skip_mask;
+		if (found | zero) {
+			int i = lowest_bit(found | zero);
+			return found & (1u << i) ? (const char *) block + i : NULL;
+		}
+	}
+#else
+	for (;; text++) {
+		if (fold_ascii((unsigned char) *text) == c)
+			return text;
+		if (!*text)
+			return NULL;
+	}
+#endif
+}
+
+//
+// Acts as strstrn, but ignores ASCII letter case.
+//
+static const char *strstrn_ci(const char *text, const char *substring, size_t substring_len) {
+	int first;
+	if (!substring_len)
+		return text;
+	first = fold_ascii((unsigned char) *substring);
+	for (;;) {
+		const char *r = strchr_ci(text, first);
+		if (!r)
+			return NULL;
+		if (eq_n_ci(r + 1, substring + 1, substring_len - 1))
+			return r;
+		text = r + 1;
+	}
+}
+
+//
+// Matches a text against a wildcard having '*' ignoring the case of ASCII letters.
+// Other bytes are compared as is. Neither text nor wildcard is copied.
+//
+bool eq_wild_ci(const char *text, const char *wildcard) {
 	const char *asterisk_pos = strchr(wildcard, '*');
 	if (!asterisk_pos)
-		return strcmp(text, wildcard) == 0;
-	if (strncmp(text, wildcard, asterisk_pos - wildcard))
+		return eq_n_ci(text, wildcard, (size_t) -1);
+	if (!eq_n_ci(text, wildcard, asterisk_pos - wildcard))
 		return false;
 	text += asterisk_pos - wildcard;
 	wildcard = asterisk_pos + 1;
@@ -43,9 +245,9 @@ bool eq_wild(const char *text, const char *wildcard) {
 		asterisk_pos = strchr(wildcard, '*');
 		if (!asterisk_pos) {
 			const char *text_tail = text + strlen(text) - strlen(wildcard);
-			return text_tail >= text && strcmp(wildcard, text_tail) == 0;
+			return text_tail >= text && eq_n_ci(wildcard, text_tail, (size_t) -1);
 		} else {
-			const char *fragment_pos = strstrn(text, wildcard, asterisk_pos - wildcard);
+			const char *fragment_pos = strstrn_ci(text, wildcard, asterisk_pos - wildcard);
 			if (!fragment_pos)
 				return false;
 			text = fragment_pos + (asterisk_pos - wildcard);
@@ -54,6 +256,164 @@ bool eq_wild(const char *text, const char *wildcard) {
 	}
 }
 
+int get_utf8(int (*get_fn)(void *context), void *get_fn_context);
+
+//
+// Unicode simple case folding (C+S mappings of CaseFolding.txt, Unicode 14.0).
+// Each range maps first, first+stride, ... last to code + delta.
+//
+static const struct case_fold_range {
+	int first, last, delta, stride;
+} case_folds[] = {
+	{0x0041, 0x005A, 32, 1}, {0x00B5, 0x00B5, 775, 1}, {0x00C0, 0x00D6, 32, 1},
+	{0x00D8, 0x00DE, 32, 1}, {0x0100, 0x012E, 1, 2}, {0x0132, 0x0136, 1, 2}, {0x0139, 0x0147, 1, 2},
+	{0x014A, 0x0176, 1, 2}, {0x0178, 0x0178, -121, 1}, {0x0179, 0x017D, 1, 2},
+	{0x017F, 0x017F, -268, 1}, {0x0181, 0x0181, 210, 1}, {0x0182, 0x0184, 1, 2},
+	{0x0186, 0x0186, 206, 1}, {0x0187, 0x0187, 1, 1}, {0x0189, 0x018A, 205, 1},
+	{0x018B, 0x018B, 1, 1}, {0x018E, 0x018E, 79, 1}, {0x018F, 0x018F, 202, 1},
+	{0x0190, 0x0190, 203, 1}, {0x0191, 0x0191, 1, 1}, {0x0193, 0x0193, 205, 1},
+	{0x0194, 0x0194, 207, 1}, {0x0196, 0x0196, 211, 1}, {0x0197, 0x0197, 209, 1},
+	{0x0198, 0x0198, 1, 1}, {0x019C, 0x019C, 211, 1}, {0x019D, 0x019D, 213, 1},
+	{0x019F, 0x019F, 214, 1}, {0x01A0, 0x01A4, 1, 2}, {0x01A6, 0x01A6, 218, 1},
+	{0x01A7, 0x01A7, 1, 1}, {0x01A9, 0x01A9, 218, 1}, {0x01AC, 0x01AC, 1, 1},
+	{0x01AE, 0x01AE, 218, 1}, {0x01AF, 0x01AF, 1, 1}, {0x01B1, 0x01B2, 217, 1},
+	{0x01B3, 0x01B5, 1, 2}, {0x01B7, 0x01B7, 219, 1}, {0x01B8, 0x01B8, 1, 1}, {0x01BC, 0x01BC, 1, 1},
+	{0x01C4, 0x01C4, 2, 1}, {0x01C5, 0x01C5, 1, 1}, {0x01C7, 0x01C7, 2, 1}, {0x01C8, 0x01C8, 1, 1},
+	{0x01CA, 0x01CA, 2, 1}, {0x01CB, 0x01DB, 1, 2}, {0x01DE, 0x01EE, 1, 2}, {0x01F1, 0x01F1, 2, 1},
+	{0x01F2, 0x01F4, 1, 2}, {0x01F6, 0x01F6, -97, 1}, {0x01F7, 0x01F7, -56, 1},
+	{0x01F8, 0x021E, 1, 2}, {0x0220, 0x0220, -130, 1}, {0x0222, 0x0232, 1, 2},
+	{0x023A, 0x023A, 10795, 1}, {0x023B, 0x023B, 1, 1}, {0x023D, 0x023D, -163, 1},
+	{0x023E, 0x023E, 10792, 1}, {0x0241, 0x0241, 1, 1}, {0x0243, 0x0243, -195, 1},
+	{0x0244, 0x0244, 69, 1}, {0x0245, 0x0245, 71, 1}, {0x0246, 0x024E, 1, 2},
+	{0x0345, 0x0345, 116, 1}, {0x0370, 0x0372, 1, 2}, {0x0376, 0x0376, 1, 1},
+	{0x037F, 0x037F, 116, 1}, {0x0386, 0x0386, 38, 1}, {0x0388, 0x038A, 37, 1},
+	{0x038C, 0x038C, 64, 1}, {0x038E, 0x038F, 63, 1}, {0x0391, 0x03A1, 32, 1},
+	{0x03A3, 0x03AB, 32, 1}, {0x03C2, 0x03C2, 1, 1}, {0x03CF, 0x03CF, 8, 1}, {0x03D0, 0x03D0, -30, 1},
+	{0x03D1, 0x03D1, -25, 1}, {0x03D5, 0x03D5, -15, 1}, {0x03D6, 0x03D6, -22, 1},
+	{0x03D8, 0x03EE, 1, 2}, {0x03F0, 0x03F0, -54, 1}, {0x03F1, 0x03F1, -48, 1},
+	{0x03F4, 0x03F4, -60, 1}, {0x03F5, 0x03F5, -64, 1}, {0x03F7, 0x03F7, 1, 1},
+	{0x03F9, 0x03F9, -7, 1}, {0x03FA, 0x03FA, 1, 1}, {0x03FD, 0x03FF, -130, 1},
+	{0x0400, 0x040F, 80, 1}, {0x0410, 0x042F, 32, 1}, {0x0460, 0x0480, 1, 2}, {0x048A, 0x04BE, 1, 2},
+	{0x04C0, 0x04C0, 15, 1}, {0x04C1, 0x04CD, 1, 2}, {0x04D0, 0x052E, 1, 2}, {0x0531, 0x0556, 48, 1},
+	{0x10A0, 0x10C5, 7264, 1}, {0x10C7, 0x10C7, 7264, 1}, {0x10CD, 0x10CD, 7264, 1},
+	{0x13F8, 0x13FD, -8, 1}, {0x1C80, 0x1C80, -6222, 1}, {0x1C81, 0x1C81, -6221, 1},
+	{0x1C82, 0x1C82, -6212, 1}, {0x1C83, 0x1C84, -6210, 1}, {0x1C85, 0x1C85, -6211, 1},
+	{0x1C86, 0x1C86, -6204, 1}, {0x1C87, 0x1C87, -6180, 1}, {0x1C88, 0x1C88, 35267, 1},
+	{0x1C90, 0x1CBA, -3008, 1}, {0x1CBD, 0x1CBF, -3008, 1}, {0x1E00, 0x1E94, 1, 2},
+	{0x1E9B, 0x1E9B, -58, 1}, {0x1E9E, 0x1E9E, -7615, 1}, {0x1EA0, 0x1EFE, 1, 2},
+	{0x1F08, 0x1F0F, -8, 1}, {0x1F18, 0x1F1D, -8, 1}, {0x1F28, 0x1F2F, -8, 1},
+	{0x1F38, 0x1F3F, -8, 1}, {0x1F48, 0x1F4D, -8, 1}, {0x1F59, 0x1F5F, -8, 2},
+	{0x1F68, 0x1F6F, -8, 1}, {0x1F88, 0x1F8F, -8, 1}, {0x1F98, 0x1F9F, -8, 1},
+	{0x1FA8, 0x1FAF, -8, 1}, {0x1FB8, 0x1FB9, -8, 1}, {0x1FBA, 0x1FBB, -74, 1},
+	{0x1FBC, 0x1FBC, -9, 1}, {0x1FBE, 0x1FBE, -7173, 1}, {0x1FC8, 0x1FCB, -86, 1},
+	{0x1FCC, 0x1FCC, -9, 1}, {0x1FD8, 0x1FD9, -8, 1}, {0x1FDA, 0x1FDB, -100, 1},
+	{0x1FE8, 0x1FE9, -8, 1}, {0x1FEA, 0x1FEB, -112, 1}, {0x1FEC, 0x1FEC, -7, 1},
+	{0x1FF8, 0x1FF9, -128, 1}, {0x1FFA, 0x1FFB, -126, 1}, {0x1FFC, 0x1FFC, -9, 1},
+	{0x2126, 0x2126, -7517, 1}, {0x212A, 0x212A, -8383, 1}, {0x212B, 0x212B, -8262, 1},
+	{0x2132, 0x2132, 28, 1}, {0x2160, 0x216F, 16, 1}, {0x2183, 0x2183, 1, 1}, {0x24B6, 0x24CF, 26, 1},
+	{0x2C00, 0x2C2F, 48, 1}, {0x2C60, 0x2C60, 1, 1}, {0x2C62, 0x2C62, -10743, 1},
+	{0x2C63, 0x2C63, -3814, 1}, {0x2C64, 0x2C64, -10727, 1}, {0x2C67, 0x2C6B, 1, 2},
+	{0x2C6D, 0x2C6D, -10780, 1}, {0x2C6E, 0x2C6E, -10749, 1}, {0x2C6F, 0x2C6F, -10783, 1},
+	{0x2C70, 0x2C70, -10782, 1}, {0x2C72, 0x2C72, 1, 1}, {0x2C75, 0x2C75, 1, 1},
+	{0x2C7E, 0x2C7F, -10815, 1}, {0x2C80, 0x2CE2, 1, 2}, {0x2CEB, 0x2CED, 1, 2},
+	{0x2CF2, 0x2CF2, 1, 1}, {0xA640, 0xA66C, 1, 2}, {0xA680, 0xA69A, 1, 2}, {0xA722, 0xA72E, 1, 2},
+	{0xA732, 0xA76E, 1, 2}, {0xA779, 0xA77B, 1, 2}, {0xA77D, 0xA77D, -35332, 1},
+	{0xA77E, 0xA786, 1, 2}, {0xA78B, 0xA78B, 1, 1}, {0xA78D, 0xA78D, -42280, 1},
+	{0xA790, 0xA792, 1, 2}, {0xA796, 0xA7A8, 1, 2}, {0xA7AA, 0xA7AA, -42308, 1},
+	{0xA7AB, 0xA7AB, -42319, 1}, {0xA7AC, 0xA7AC, -42315, 1}, {0xA7AD, 0xA7AD, -42305, 1},
+	{0xA7AE, 0xA7AE, -42308, 1}, {0xA7B0, 0xA7B0, -42258, 1}, {0xA7B1, 0xA7B1, -42282, 1},
+	{0xA7B2, 0xA7B2, -42261, 1}, {0xA7B3, 0xA7B3, 928, 1}, {0xA7B4, 0xA7C2, 1, 2},
+	{0xA7C4, 0xA7C4, -48, 1}, {0xA7C5, 0xA7C5, -42307, 1}, {0xA7C6, 0xA7C6, -35384, 1},
+	{0xA7C7, 0xA7C9, 1, 2}, {0xA7D0, 0xA7D0, 1, 1}, {0xA7D6, 0xA7D8, 1, 2}, {0xA7F5, 0xA7F5, 1, 1},
+	{0xAB70, 0xABBF, -38864, 1}, {0xFF21, 0xFF3A, 32, 1}, {0x10400, 0x10427, 40, 1},
+	{0x104B0, 0x104D3, 40, 1}, {0x10570, 0x1057A, 39, 1}, {0x1057C, 0x1058A, 39, 1},
+	{0x1058C, 0x10592, 39, 1}, {0x10594, 0x10595, 39, 1}, {0x10C80, 0x10CB2, 64, 1},
+	{0x118A0, 0x118BF, 32, 1}, {0x16E40, 0x16E5F, 32, 1}, {0x1E900, 0x1E921, 34, 1},
+};
+
+static int fold_case(int c) {
+	int lo = 0, hi = sizeof(case_folds) / sizeof(*case_folds);
+	if (c < 'A')
+		return c;
+	if (c < 0x80)
+		return fold_ascii(c);
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (c > case_folds[mid].last)
+			lo = mid + 1;
+		else if (c < case_folds[mid].first)
+			hi = mid;
+		else
+			return (c - case_folds[mid].first) % case_folds[mid].stride ? c : c + case_folds[mid].delta;
+	}
+	return c;
+}
+
+static int get_byte(void *context) {
+	const unsigned char **p = (const unsigned char **) context;
+	int c = **p;
+	if (c)
+		++*p;
+	return c;
+}
+
+static int get_folded(const char **p) {
+	return fold_case(get_utf8(get_byte, (void *) p));
+}
+
+//
+// Matches the fragment (ending at '*' or zero) at the text start.
+// On success moves the text past the matched part.
+//
+static bool match_fragment_utf8(const char **text, const char *fragment) {
+	const char *t = *text;
+	for (;;) {
+		int f = get_folded(&fragment);
+		if (f == '*' || f == 0) {
+			*text = t;
+			return true;
+		}
+		if (get_folded(&t) != f)
+			return false;
+	}
+}
+
+//
+// Matches a UTF-8 text against a UTF-8 wildcard having '*' using Unicode simple case folding.
+// Both strings are decoded as get_utf8 does (skipping ill-formed sequences, joining surrogate pairs)
+// and compared by folded code points. Neither is copied.
+//
+bool eq_wild_utf8_ci(const char *text, const char *wildcard) {
+	const char *asterisk_pos = strchr(wildcard, '*');
+	if (!asterisk_pos)
+		return match_fragment_utf8(&text, wildcard) && get_folded(&text) == 0;
+	if (!match_fragment_utf8(&text, wildcard))
+		return false;
+	wildcard = asterisk_pos + 1;
+	for (;;) {
+		if (*wildcard == 0)
+			return true;
+		asterisk_pos = strchr(wildcard, '*');
+		if (!asterisk_pos) {
+			// Find the tail having as many code points as the last fragment.
+			const char *lead = text;
+			const char *p = wildcard;
+			while (get_folded(&p)) {
+				if (!get_folded(&lead))
+					return false;
+			}
+			while (get_folded(&lead))
+				get_folded(&text);
+			return match_fragment_utf8(&text, wildcard) && get_folded(&text) == 0;
+		}
+		while (!match_fragment_utf8(&text, wildcard)) {
+			if (!get_folded(&text))
+				return false;
+		}
+		wildcard = asterisk_pos + 1;
+	}
+}
+
 #ifdef TESTS
 
 #include <stdio.h>
@@ -92,6 +452,58 @@ void eq_wild_tests() {
 
 	ASSERT(eq_wild("just another test", "just*another*test"));
 	ASSERT(!eq_wild("just some other test", "just*another*test"));
+
+	{
+		static const char *wildcards[] = {
+			"asd", "asdf", "a*", "ad*", "*f", "*easdf", "*adf", "a*f", "an*f", "a*xf",
+			"*s*", "*a*", "*f*", "*x*", "a*s*f", "a*d*f", "as*s*f", "a*d*df", "*", "**", "", "sd*df" };
+		static const char *texts[] = { "asdf", "", "a", "sdf", "asdfasdf" };
+		int i, j;
+		for (i = 0; i < sizeof(wildcards) / sizeof(*wildcards); i++) {
+			struct wild_pattern *p = wild_compile(wildcards[i]);
+			for (j = 0; j < sizeof(texts) / sizeof(*texts); j++)
+				ASSERT(eq_wild_compiled(p, texts[j], strlen(texts[j])) == eq_wild(texts[j], wildcards[i]));
+			free(p);
+		}
+	}
+	ASSERT(eq_wild_ci("AsDf", "a*S*f"));
+	ASSERT(eq_wild_ci("asdf", "ASDF"));
+	ASSERT(!eq_wild_ci("asdf", "ASD"));
+	ASSERT(!eq_wild_ci("as", "*ASD"));
+	ASSERT(eq_wild_ci("mail@Example.COM", "*@example.com"));
+	ASSERT(eq_wild_ci("Host-42.Example.org", "host-*.EXAMPLE.*"));
+	ASSERT(!eq_wild_ci("Host-42.Exomple.org", "host-*.EXAMPLE.*"));
+	ASSERT(eq_wild_ci("[a]", "*[A]*"));
+	ASSERT(!eq_wild_ci("{a}", "*[A]*"));
+	ASSERT(eq_wild_ci("\xc3\x89t\xc3\xa9", "*T*"));
+	ASSERT(!eq_wild_ci("\xc3\x89t\xc3\xa9", "\xc3\xa9*"));
+	ASSERT(eq_wild_ci("just another long test with mixed CASE crossing 16-byte blocks", "JUST*ANOTHER*case*BLOCKS"));
+
+	ASSERT(eq_wild_utf8_ci("asdf", "A*S*F"));
+	ASSERT(eq_wild_utf8_ci("\xc3\x89t\xc3\xa9", "\xc3\xa9T\xc3\x89"));  // Été = éTÉ
+	ASSERT(eq_wild_utf8_ci("\xd0\x9c\xd0\xbe\xd1\x81\xd0\xba\xd0\xb2\xd0\xb0", "\xd0\xbc*\xd0\x92\xd0\x90"));  // Москва = м*ВА
+	ASSERT(eq_wild_utf8_ci("\xe2\x84\xaa", "k"));  // Kelvin sign
+	ASSERT(eq_wild_utf8_ci("x\xe2\x84\xaa", "*K"));
+	ASSERT(eq_wild_utf8_ci("\xcf\x82", "\xce\xa3"));  // final sigma = capital sigma
+	ASSERT(!eq_wild_utf8_ci("\xc3\x9f", "ss"));  // no full folding
+	ASSERT(!eq_wild_utf8_ci("ab", "*abc"));
+	ASSERT(eq_wild_utf8_ci("a\xed\xa0\x80\xed\xb0\x80", "A\xf0\x90\x80\x80"));  // surrogate pair
+	ASSERT(eq_wild_utf8_ci("a\x80" "b", "AB"));  // ill-formed skipped
+	ASSERT(eq_wild_utf8_ci("\xf0\x90\x90\x80*", "*\xf0\x90\x90\xa8*"));  // Deseret
+	{
+		static const char *wildcards[] = { "A*", "*F", "a*S*f", "*X*", "AS*S*F", "*", "" };
+		static const char *texts[] = { "asdf", "ASDF", "" };
+		int i, j;
+		for (i = 0; i < sizeof(wildcards) / sizeof(*wildcards); i++)
+			for (j = 0; j < sizeof(texts) / sizeof(*texts); j++)
+				ASSERT(eq_wild_utf8_ci(texts[j], wildcards[i]) == eq_wild_ci(texts[j], wildcards[i]));
+	}
+	{
+		struct wild_pattern *p = wild_compile("a*d");
+		ASSERT(eq_wild_compiled(p, "asdf", 3));
+		ASSERT(!eq_wild_compiled(p, "asdf", 2));
+		free(p);
+	}
 }
 
 #endif
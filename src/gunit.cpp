@@ -1,35 +1,563 @@
 #include "gunit.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
 namespace testing {
 TestRegRecord* tests = nullptr;
+TestRegRecord* benchmarks = nullptr;
 int failed;
+thread_local std::ostringstream* test_out = nullptr;
 
-TestRegRecord::TestRegRecord(const char* name, Test* (*fn)())
-    : name(name), fn(fn), next(tests) {
-  tests = this;
+std::ostream& out() {
+  return test_out ? *test_out : std::cout;
 }
 
-}  // namespace testing
+TestRegRecord::TestRegRecord(const char* name, Test* (*fn)(), TestRegRecord** list)
+    : name(name), next(*list), fn(fn) {
+  *list = this;
+}
+
+//
+// Hardware counters of the benchmark thread and the threads it starts, from Linux perf_event_open.
+// Each one is opened on its own, so the ones a CPU or VM lacks are skipped and the rest still count,
+// and values are scaled up when the kernel multiplexes them. None open where perf is not permitted
+// (perf_event_paranoid > 2, containers filtering the syscall) or off Linux.
+//
+class PerfCounters {
+ public:
+  enum { kInstructions, kCycles, kBranchMisses, kL1dMisses, kLlcMisses, kCount };
+  static const char* name(int i) {
+    static const char* names[kCount] = {"instructions", "cycles", "branch_misses", "l1d_misses", "llc_misses"};
+    return names[i];
+  }
+
+  PerfCounters() {
+    for (int i = 0; i < kCount; i++)
+      fds_[i] = -1;
+#ifdef __linux__
+    static const unsigned long long cache_read_miss =
+        PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    static const struct {
+      unsigned type;
+      unsigned long long config;
+    } events[kCount] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cache_read_miss},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cache_read_miss},
+    };
+    for (int i = 0; i < kCount; i++) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = events[i].type;
+      attr.config = events[i].config;
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fds_[i] < 0 && error_.empty())
+        error_ = std::strerror(errno);
+    }
+#else
+    error_ = "not Linux";
+#endif
+    Reset();
+  }
+  ~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds_) {
+      if (fd >= 0)
+        close(fd);
+    }
+#endif
+  }
+  bool available() const {
+    for (int fd : fds_) {
+      if (fd >= 0)
+        return true;
+    }
+    return false;
+  }
+  bool has(int i) const { return fds_[i] >= 0; }
+  // Why the first counter failed to open.
+  const std::string& error() const { return error_; }
+  void Reset() {
+    for (double& t : totals_)
+      t = 0;
+  }
+  void Start() {
+#ifdef __linux__
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+  void Stop() {
+#ifdef __linux__
+    for (int fd : fds_) {
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < kCount; i++) {
+      unsigned long long v[3];  // value, time enabled, time running
+      if (fds_[i] >= 0 && read(fds_[i], v, sizeof(v)) == static_cast<ssize_t>(sizeof(v)) && v[2])
+        totals_[i] += static_cast<double>(v[0]) * v[1] / v[2];
+    }
+#endif
+  }
+  double total(int i) const { return totals_[i]; }
+
+ private:
+  int fds_[kCount];
+  double totals_[kCount];
+  std::string error_;
+};
+
+void BenchmarkState::StartCounters() { counters_->Start(); }
+void BenchmarkState::StopCounters() { counters_->Stop(); }
+
+namespace {
+
+const double kBatchNs = 1e6;         // a timed batch lasts at least this long
+const double kBudgetNs = 2e9;        // stop repeating a slow benchmark after this time
+const int kMinRepetitions = 5;
+const double kSignificance = 0.01;   // p-value below which a slowdown is not noise
 
-int RUN_ALL_TESTS() {
-  ::testing::failed = 0;
+struct BenchmarkResult {
+  const char* name;
+  size_t iterations;  // per batch
+  size_t bytes_per_op;
+  std::vector<double> samples;  // ns per iteration of each batch, sorted
+  double counters[PerfCounters::kCount];  // per iteration over the timed batches, < 0 if not counted
+};
+
+double run_batch(const char* name, Benchmark* b, size_t iterations) {
+  b->state.iterations_ = iterations;
+  b->state.start_ = b->state.stop_ = std::chrono::steady_clock::time_point();
+  b->Run();
+  if (b->state.stop_ == std::chrono::steady_clock::time_point()) {
+    std::cout << "[E]no timed loop `for (auto _ : state)` in " << name << std::endl;
+    throw 1;
+  }
+  return std::chrono::duration<double, std::nano>(b->state.stop_ - b->state.start_).count();
+}
+
+BenchmarkResult run_benchmark(TestRegRecord* rec, int repetitions, PerfCounters& counters) {
+  BenchmarkResult r{rec->name, 1, 0, {}, {}};
+  Benchmark* b = static_cast<Benchmark*>(rec->fn());
+  for (double& c : r.counters)
+    c = -1;
   try {
-    for (testing::TestRegRecord* trr = testing::tests; trr; trr = trr->next) {
-      std::cout << "Test:" << trr->name << std::endl;
-      ::testing::Test* t = trr->fn();
-      t->SetUp();
-      t->Run();
-      t->TearDown();
-      delete t;
+    b->SetUp();
+    // Grow the batch to kBatchNs, these runs also warm up caches and branch predictors.
+    for (;;) {
+      double ns = run_batch(r.name, b, r.iterations);
+      if (ns >= kBatchNs)
+        break;
+      size_t next = ns <= 0 ? r.iterations * 10 : static_cast<size_t>(r.iterations * kBatchNs * 1.2 / ns);
+      r.iterations = std::min(std::max(next, r.iterations + 1), r.iterations * 10);
+    }
+    double spent = 0;
+    counters.Reset();
+    b->state.counters_ = counters.available() ? &counters : nullptr;
+    for (int i = 0; i < repetitions && (i < kMinRepetitions || spent < kBudgetNs); i++) {
+      double ns = run_batch(r.name, b, r.iterations);
+      spent += ns;
+      r.samples.push_back(ns / r.iterations);
+    }
+    b->state.counters_ = nullptr;
+    for (int i = 0; i < PerfCounters::kCount; i++) {
+      if (counters.has(i))
+        r.counters[i] = counters.total(i) / (static_cast<double>(r.iterations) * r.samples.size());
     }
+    r.bytes_per_op = b->state.bytes_per_op_;
+    b->TearDown();
   } catch (int) {
     ::testing::failed++;
+    r.samples.clear();
   }
-  std::cout << (::testing::failed ? "failed" : "passed") << std::endl;
-  return ::testing::failed;
+  delete b;
+  std::sort(r.samples.begin(), r.samples.end());
+  return r;
 }
 
-int main() {
-  return RUN_ALL_TESTS();
+struct TestResult {
+  TestRegRecord* record;
+  bool passed;
+  double ms;
+  std::string output;  // what the test printed through out()
+};
+
+void run_test(TestResult& r) {
+  auto start = std::chrono::steady_clock::now();
+  std::ostringstream output;
+  test_out = &output;
+  Test* t = r.record->fn();
+  r.passed = true;
+  try {
+    t->SetUp();
+    t->Run();
+  } catch (int) {
+    r.passed = false;
+  } catch (const std::exception& e) {
+    output << "[E]exception " << e.what() << " in " << r.record->name << std::endl;
+    r.passed = false;
+  } catch (...) {
+    output << "[E]unknown exception in " << r.record->name << std::endl;
+    r.passed = false;
+  }
+  try {
+    t->TearDown();
+  } catch (...) {
+    r.passed = false;
+  }
+  delete t;
+  test_out = nullptr;
+  r.output = output.str();
+  r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  size_t rank = static_cast<size_t>(p * sorted.size() + 0.999999);
+  return sorted[rank ? rank - 1 : 0];
+}
+
+void write_json(FILE* f, const std::vector<BenchmarkResult>& results) {
+  std::fprintf(f, "{\n  \"benchmarks\": [");
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchmarkResult& r = results[i];
+    double median = percentile(r.samples, 0.5);
+    std::fprintf(f, "%s\n    {\"name\": \"%s\", \"iterations\": %zu, \"min_ns\": %.3f, \"median_ns\": %.3f, \"p99_ns\": %.3f",
+        i ? "," : "", r.name, r.iterations, r.samples.front(), median, percentile(r.samples, 0.99));
+    if (r.bytes_per_op)
+      std::fprintf(f, ", \"bytes_per_second\": %.0f", r.bytes_per_op * 1e9 / median);
+    for (int j = 0; j < PerfCounters::kCount; j++) {
+      if (r.counters[j] >= 0)
+        std::fprintf(f, ", \"%s_per_op\": %.3f", PerfCounters::name(j), r.counters[j]);
+    }
+    std::fprintf(f, ", \"samples_ns\": [");
+    for (size_t j = 0; j < r.samples.size(); j++)
+      std::fprintf(f, "%s%.3f", j ? ", " : "", r.samples[j]);
+    std::fprintf(f, "]}");
+  }
+  std::fprintf(f, "\n  ]\n}\n");
+}
+
+struct Baseline {
+  std::string name;
+  std::vector<double> samples;
+};
+
+std::string read_all(FILE* f) {
+  std::string text;
+  char buf[4096];
+  for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;)
+    text.append(buf, n);
+  return text;
+}
+
+// Parses names and samples of benchmarks from the text write_json wrote.
+bool parse_baseline(const std::string& text, std::vector<Baseline>& out) {
+  static const char name_key[] = "\"name\": \"", samples_key[] = "\"samples_ns\": [";
+  for (size_t at = 0; (at = text.find(name_key, at)) != std::string::npos;) {
+    at += sizeof(name_key) - 1;
+    size_t name_end = text.find('"', at);
+    size_t samples = text.find(samples_key, at);
+    if (name_end == std::string::npos || samples == std::string::npos)
+      return false;
+    Baseline b{text.substr(at, name_end - at), {}};
+    const char* p = text.c_str() + samples + sizeof(samples_key) - 1;
+    for (char* end; *p != ']'; p = end + (*end == ',')) {
+      b.samples.push_back(std::strtod(p, &end));
+      if (end == p)
+        return false;
+    }
+    out.push_back(b);
+    at = p - text.c_str();
+  }
+  return true;
+}
+
+bool read_baseline(const char* file_name, std::vector<Baseline>& out) {
+  FILE* f = std::fopen(file_name, "rb");
+  if (!f)
+    return false;
+  std::string text = read_all(f);
+  std::fclose(f);
+  return parse_baseline(text, out);
+}
+
+//
+// One-sided Mann-Whitney U test: the probability to see `current` ranked this high over `base`
+// if both came from one distribution. Normal approximation with tie and continuity corrections,
+// which is accurate for the dozens of batches the runner takes.
+//
+double slower_p_value(const std::vector<double>& base, const std::vector<double>& current) {
+  std::vector<std::pair<double, bool>> all;  // value, is current
+  for (double v : base)
+    all.push_back({v, false});
+  for (double v : current)
+    all.push_back({v, true});
+  std::sort(all.begin(), all.end());
+  double n1 = static_cast<double>(base.size()), n2 = static_cast<double>(current.size()), n = n1 + n2;
+  double rank_sum = 0, ties = 0;
+  for (size_t i = 0, j; i < all.size(); i = j) {
+    for (j = i; j < all.size() && all[j].first == all[i].first; j++) {}
+    double t = static_cast<double>(j - i), rank = (i + 1 + j) / 2.0;
+    ties += t * t * t - t;
+    for (size_t k = i; k < j; k++)
+      rank_sum += all[k].second ? rank : 0;
+  }
+  double u = rank_sum - n2 * (n2 + 1) / 2;
+  double sigma = std::sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))));
+  if (sigma == 0)
+    return 1;
+  double z = (u - n1 * n2 / 2 - 0.5) / sigma;
+  return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+// Prints the change of each benchmark against the baseline, returns the number of regressions.
+int compare_baseline(const std::vector<BenchmarkResult>& results, const std::vector<Baseline>& baseline, double threshold) {
+  int regressions = 0;
+  std::printf("\n%-32s %12s %12s %9s %9s\n", "benchmark", "base ns", "now ns", "delta", "p");
+  for (const BenchmarkResult& r : results) {
+    const Baseline* b = nullptr;
+    for (const Baseline& i : baseline) {
+      if (i.name == r.name && !i.samples.empty())
+        b = &i;
+    }
+    if (!b) {
+      std::printf("%-32s %12s\n", r.name, "new");
+      continue;
+    }
+    std::vector<double> base = b->samples;
+    std::sort(base.begin(), base.end());
+    double was = percentile(base, 0.5), now = percentile(r.samples, 0.5);
+    double delta = (now / was - 1) * 100;
+    double p = slower_p_value(base, r.samples);
+    bool regressed = delta > threshold && p < kSignificance;
+    regressions += regressed;
+    std::printf("%-32s %12.2f %12.2f %+8.1f%% %9.4f%s\n", r.name, was, now, delta, p, regressed ? " REGRESSED" : "");
+  }
+  std::printf("%d regressed by more than %.1f%%\n", regressions, threshold);
+  return regressions;
+}
+
+}  // namespace
+}  // namespace testing
+
+// The regression gate of the runner itself.
+TEST(Gunit, SlowerPValue) {
+  std::vector<double> base, shifted, same(20, 5.0);
+  for (int i = 0; i < 20; i++) {
+    base.push_back(100 + i);
+    shifted.push_back(200 + i);
+  }
+  ASSERT_LE(0.5, testing::slower_p_value(base, base));
+  ASSERT_LT(testing::slower_p_value(base, shifted), 0.01);
+  ASSERT_LE(0.99, testing::slower_p_value(shifted, base));
+  // All ties, sigma is 0.
+  ASSERT_EQ(testing::slower_p_value(same, same), 1.0);
+}
+
+TEST(Gunit, BaselineRoundTrip) {
+  testing::BenchmarkResult results[2] = {{"Case.First", 10, 64, {1.5, 2.25, 3}, {}}, {"Case.Second", 1, 0, {7}, {}}};
+  for (int i = 0; i < testing::PerfCounters::kCount; i++) {
+    results[0].counters[i] = 100.0 + i;
+    results[1].counters[i] = -1;
+  }
+  FILE* f = std::tmpfile();
+  ASSERT_TRUE(f != nullptr);
+  testing::write_json(f, std::vector<testing::BenchmarkResult>(results, results + 2));
+  std::rewind(f);
+  std::string text = testing::read_all(f);
+  std::fclose(f);
+  ASSERT_TRUE(text.find("\"instructions_per_op\": 100.000") != std::string::npos);
+  ASSERT_TRUE(text.find("\"llc_misses_per_op\": 104.000") != std::string::npos);
+  std::vector<testing::Baseline> baseline;
+  ASSERT_TRUE(testing::parse_baseline(text, baseline));
+  ASSERT_EQ(baseline.size(), 2u);
+  ASSERT_EQ(baseline[0].name, "Case.First");
+  ASSERT_TRUE(baseline[0].samples == results[0].samples);
+  ASSERT_EQ(baseline[1].name, "Case.Second");
+  ASSERT_TRUE(baseline[1].samples == results[1].samples);
+  ASSERT_FALSE(testing::parse_baseline("{\"name\": \"Cut\", \"samples_ns\": [1, x", baseline));
+  ASSERT_FALSE(testing::read_baseline("/nonexistent/baseline.json", baseline));
+}
+
+int RUN_ALL_TESTS(const char* filter, int shard, int shard_count, int jobs) {
+  using namespace ::testing;
+  // Registered last first, numbered in the source order for stable shards.
+  std::vector<TestRegRecord*> selected;
+  for (TestRegRecord* trr = tests; trr; trr = trr->next) {
+    if (!filter || std::strstr(trr->name, filter))
+      selected.insert(selected.begin(), trr);
+  }
+  std::vector<TestResult> results;
+  for (size_t i = 0; i < selected.size(); i++) {
+    if (shard_count <= 1 || static_cast<int>(i % shard_count) == shard)
+      results.push_back(TestResult{selected[i], false, 0, {}});
+  }
+  if (jobs <= 0)
+    jobs = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  jobs = std::min(jobs, std::max(static_cast<int>(results.size()), 1));
+  std::atomic<size_t> next(0);
+  std::mutex out_lock;
+  auto worker = [&]() {
+    for (size_t i; (i = next++) < results.size();) {
+      run_test(results[i]);
+      std::lock_guard<std::mutex> lock(out_lock);
+      std::cout << results[i].output << (results[i].passed ? "[ok] " : "[failed] ") << results[i].record->name << std::endl;
+    }
+  };
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 1; i < jobs; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (std::thread& t : threads)
+    t.join();
+  double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  failed = 0;
+  std::printf("\n%-48s %10s\n", "test", "ms");
+  for (const TestResult& r : results) {
+    std::printf("%-48s %10.1f%s\n", r.record->name, r.ms, r.passed ? "" : " failed");
+    failed += !r.passed;
+  }
+  std::printf("%zu tests, %d failed, %.1f ms with %d jobs\n", results.size(), failed, total_ms, jobs);
+  std::cout << (failed ? "failed" : "passed") << std::endl;
+  return failed;
+}
+
+int RUN_ALL_BENCHMARKS(const char* filter, int repetitions, const char* json_file,
+    const char* baseline_file, double threshold) {
+  using namespace ::testing;
+  std::vector<BenchmarkResult> results;
+  std::vector<Baseline> baseline;
+  failed = 0;
+  // Read it first, it may be the json_file to be overwritten.
+  if (baseline_file && !read_baseline(baseline_file, baseline)) {
+    std::printf("can't read baseline %s\n", baseline_file);
+    return 1;
+  }
+  PerfCounters counters;
+  if (!counters.available())
+    std::printf("hardware counters unavailable (%s), timing only\n", counters.error().c_str());
+  std::printf("%-32s %12s %12s %12s %12s %10s", "benchmark", "iterations", "min ns", "median ns", "p99 ns", "MB/s");
+  if (counters.available())
+    std::printf(" %6s %11s %11s %11s %11s", "IPC", "instr/op", "br-miss/op", "L1d-miss/op", "LLC-miss/op");
+  std::printf("\n");
+  // Registered last first, run in the source order.
+  std::vector<TestRegRecord*> selected;
+  for (TestRegRecord* trr = benchmarks; trr; trr = trr->next) {
+    if (!filter || std::strstr(trr->name, filter))
+      selected.insert(selected.begin(), trr);
+  }
+  for (TestRegRecord* trr : selected) {
+    BenchmarkResult r = run_benchmark(trr, repetitions, counters);
+    if (r.samples.empty()) {
+      std::printf("%-32s failed\n", r.name);
+      continue;
+    }
+    double median = percentile(r.samples, 0.5);
+    std::printf("%-32s %12zu %12.2f %12.2f %12.2f", r.name, r.iterations, r.samples.front(), median,
+        percentile(r.samples, 0.99));
+    if (r.bytes_per_op)
+      std::printf(" %10.1f", r.bytes_per_op * 1e3 / median);
+    else if (counters.available())
+      std::printf(" %10s", "");
+    if (counters.available()) {
+      const double* c = r.counters;
+      if (c[PerfCounters::kInstructions] >= 0 && c[PerfCounters::kCycles] > 0)
+        std::printf(" %6.2f", c[PerfCounters::kInstructions] / c[PerfCounters::kCycles]);
+      else
+        std::printf(" %6s", "-");
+      for (int i : {PerfCounters::kInstructions, PerfCounters::kBranchMisses, PerfCounters::kL1dMisses, PerfCounters::kLlcMisses}) {
+        if (c[i] >= 0)
+          std::printf(" %11.2f", c[i]);
+        else
+          std::printf(" %11s", "-");
+      }
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+    results.push_back(r);
+  }
+  if (json_file) {
+    FILE* f = std::fopen(json_file, "w");
+    if (!f) {
+      std::printf("can't write %s\n", json_file);
+      return failed + 1;
+    }
+    write_json(f, results);
+    std::fclose(f);
+  }
+  if (baseline_file)
+    failed += compare_baseline(results, baseline, threshold);
+  return failed;
+}
+
+//
+// Runs the tests, or with --bench the benchmarks.
+//
+int main(int argc, char** argv) {
+  bool bench = false;
+  const char* filter = nullptr;
+  const char* json_file = nullptr;
+  const char* baseline_file = nullptr;
+  double threshold = 5;
+  int repetitions = 100;
+  int shard = 0, shard_count = 1, jobs = 0;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--bench") == 0)
+      bench = true;
+    else if (std::strncmp(argv[i], "--bench=", 8) == 0)
+      bench = true, filter = argv[i] + 8;
+    else if (std::strncmp(argv[i], "--filter=", 9) == 0)
+      filter = argv[i] + 9;
+    else if (std::strncmp(argv[i], "--repetitions=", 14) == 0)
+      repetitions = std::max(std::atoi(argv[i] + 14), 1);
+    else if (std::strncmp(argv[i], "--json=", 7) == 0)
+      json_file = argv[i] + 7;
+    else if (std::strncmp(argv[i], "--baseline=", 11) == 0)
+      baseline_file = argv[i] + 11;
+    else if (std::strncmp(argv[i], "--threshold=", 12) == 0)
+      threshold = std::atof(argv[i] + 12);
+    else if (std::strncmp(argv[i], "--jobs=", 7) == 0)
+      jobs = std::atoi(argv[i] + 7);
+    else if (std::sscanf(argv[i], "--shard=%d/%d", &shard, &shard_count) == 2 && shard >= 0 && shard < shard_count)
+      continue;
+    else {
+      std::printf("usage: %s [--filter=substring] [--jobs=N] [--shard=i/n]\n"
+          "       %s --bench[=filter] [--repetitions=N] [--json=file] [--baseline=file] [--threshold=percent]\n", argv[0], argv[0]);
+      return 1;
+    }
+  }
+  return bench ? RUN_ALL_BENCHMARKS(filter, repetitions, json_file, baseline_file, threshold) : RUN_ALL_TESTS(filter, shard, shard_count, jobs);
 }
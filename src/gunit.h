@@ -1,28 +1,129 @@
 #ifndef GTEST_H
 #define GTEST_H
 
+#include <chrono>
+#include <cstddef>
 #include <iostream>
 
 namespace testing
 {
 class Test;
+class PerfCounters;
+struct TestRegRecord;
+extern TestRegRecord* tests;
+extern TestRegRecord* benchmarks;
+
 struct TestRegRecord {
   const char* name;
   TestRegRecord* next;
   Test* (*fn)();
-  TestRegRecord(const char* name, Test* (*fn)());
+  TestRegRecord(const char* name, Test* (*fn)(), TestRegRecord** list = &tests);
 };
 
+//
+// Where assertions print: the buffer of the test running on this thread, which the runner prints
+// with the test result, so parallel tests don't interleave, or std::cout outside tests.
+//
+std::ostream& out();
+
 class Test {
 public:
+  virtual ~Test() {}
   virtual void SetUp() {}
   virtual void Run() {}
   virtual void TearDown() {}
 };
 
+//
+// The timed loop of a benchmark: `for (auto _ : state) {...}` runs its body
+// as many times as the runner asked, the code before and after the loop is not timed.
+//
+class BenchmarkState {
+ public:
+  // The loop variable, its destructor tells compilers it is used.
+  struct value {
+    ~value() {}
+  };
+  struct iterator {
+    BenchmarkState* state;
+    size_t left;
+    value operator*() const { return value(); }
+    iterator& operator++() { --left; return *this; }
+    bool operator!=(const iterator&) {
+      if (left)
+        return true;
+      state->stop_ = std::chrono::steady_clock::now();
+      if (state->counters_)
+        state->StopCounters();
+      return false;
+    }
+  };
+  iterator begin() {
+    if (counters_)
+      StartCounters();
+    start_ = std::chrono::steady_clock::now();
+    return iterator{this, iterations_};
+  }
+  iterator end() { return iterator{this, 0}; }
+  size_t iterations() const { return iterations_; }
+  // Bytes each iteration processes, to report bytes per second.
+  void SetBytesPerOp(size_t bytes) { bytes_per_op_ = bytes; }
+
+  size_t iterations_ = 0;
+  size_t bytes_per_op_ = 0;
+  std::chrono::steady_clock::time_point start_, stop_;
+  // Hardware counters the runner reads around the timed loop, if it has any.
+  PerfCounters* counters_ = nullptr;
+  void StartCounters();
+  void StopCounters();
+};
+
+//
+// A benchmark is a test which Run is called repeatedly, SetUp and TearDown are called once.
+// Fixtures derive from Benchmark and build their corpora in SetUp.
+//
+class Benchmark : public Test {
+ public:
+  BenchmarkState state;
+};
+
+//
+// Keeps the compiler from optimizing away a computation the benchmark doesn't use.
+//
+template<typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static const void* volatile sink;
+  sink = &value;
+#endif
+}
+
 }
 
-int RUN_ALL_TESTS();
+//
+// Runs tests which names contain filter (all if NULL) on `jobs` threads (<= 0 - one per CPU).
+// With shard_count > 1 runs only every shard_count-th of them starting from the shard-th,
+// so CI machines can split the suite. A failed assertion fails only its test, the rest go on.
+// Prints each test as it completes and a summary with durations. Returns the number of failed tests.
+//
+int RUN_ALL_TESTS(const char* filter = nullptr, int shard = 0, int shard_count = 1, int jobs = 0);
+
+//
+// Runs benchmarks which names ("Case.Name") contain filter (all if NULL).
+// Each one is first run in growing batches until a batch takes a millisecond, which also warms it up,
+// then up to `repetitions` batches are timed. Prints min, median and 99th percentile of ns per iteration
+// over the batches and bytes per second at the median, and writes them as JSON to json_file if not NULL.
+// If baseline_file is not NULL, compares the batches with the ones saved there to json_file by an earlier run.
+// A benchmark regresses if its median is more than threshold percent slower and a one-sided Mann-Whitney test
+// says the slowdown is not noise (p < 0.01).
+// On Linux, where perf_event_open is permitted, also prints instructions per cycle and instructions,
+// branch misses, L1 data and last level cache misses per iteration, else notes they are unavailable.
+// Returns the number of benchmarks that failed an assertion or regressed.
+//
+int RUN_ALL_BENCHMARKS(const char* filter, int repetitions, const char* json_file,
+    const char* baseline_file = nullptr, double threshold = 5);
 
 #define TEST_STR_(S) #S
 #define TEST_STR(S) TEST_STR_(S)
@@ -42,13 +143,29 @@ int RUN_ALL_TESTS();
 #define TEST(CASE, TST) TEST_(CASE, TST, ::testing::Test)
 #define TEST_F(CASE, TST) TEST_(CASE, TST, CASE)
 
+#define BENCHMARK_CLASS_NAME(CASE, NAME) CASE##_##NAME##_Benchmark
+
+#define BENCHMARK_(CASE, NAME, BASE)                                             \
+  class BENCHMARK_CLASS_NAME(CASE, NAME) : public BASE {                         \
+   public:                                                                       \
+    static Test* Create_() { return new BENCHMARK_CLASS_NAME(CASE, NAME); }      \
+    void Run() override;                                                         \
+  };                                                                             \
+  ::testing::TestRegRecord CASE##_##NAME##bench_reg(                             \
+      #CASE "." #NAME, BENCHMARK_CLASS_NAME(CASE, NAME)::Create_,                \
+      &::testing::benchmarks);                                                   \
+  void BENCHMARK_CLASS_NAME(CASE, NAME)::Run()
+
+#define BENCHMARK(CASE, NAME) BENCHMARK_(CASE, NAME, ::testing::Benchmark)
+#define BENCHMARK_F(CASE, NAME) BENCHMARK_(CASE, NAME, CASE)
+
 #define ASSERT_EQ(A, B)                                                     \
   {                                                                         \
     const auto& a_ = A;                                                     \
     const auto& b_ = B;                                                     \
     if (a_ != b_) {                                                         \
-      std::cout << "[E]" << a_ << " != " << b_ << " at " << __FILE__ << ":" \
-                << __LINE__ << std::endl;                                   \
+      ::testing::out() << "[E]" << a_ << " != " << b_ << " at "             \
+                       << __FILE__ << ":" << __LINE__ << std::endl;         \
       throw 1;                                                              \
     }                                                                       \
   }
@@ -57,8 +174,8 @@ int RUN_ALL_TESTS();
     const auto& a_ = A;                                                     \
     const auto& b_ = B;                                                     \
     if (a_ == b_) {                                                         \
-      std::cout << "[E]" << a_ << " == " << b_ << " at " << __FILE__ << ":" \
-                << __LINE__ << std::endl;                                   \
+      ::testing::out() << "[E]" << a_ << " == " << b_ << " at "             \
+                       << __FILE__ << ":" << __LINE__ << std::endl;         \
       throw 1;                                                              \
     }                                                                       \
   }
@@ -67,8 +184,8 @@ int RUN_ALL_TESTS();
     const auto& a_ = A;                                                     \
     const auto& b_ = B;                                                     \
     if (a_ >= b_) {                                                         \
-      std::cout << "[E]" << a_ << " >= " << b_ << " at " << __FILE__ << ":" \
-                << __LINE__ << std::endl;                                   \
+      ::testing::out() << "[E]" << a_ << " >= " << b_ << " at "             \
+                       << __FILE__ << ":" << __LINE__ << std::endl;         \
       throw 1;                                                              \
     }                                                                       \
   }
@@ -77,8 +194,8 @@ int RUN_ALL_TESTS();
     const auto& a_ = A;                                                     \
     const auto& b_ = B;                                                     \
     if (a_ > b_) {                                                         \
-      std::cout << "[E]" << a_ << " > " << b_ << " at " << __FILE__ << ":" \
-                << __LINE__ << std::endl;                                   \
+      ::testing::out() << "[E]" << a_ << " > " << b_ << " at "              \
+                       << __FILE__ << ":" << __LINE__ << std::endl;         \
       throw 1;                                                              \
     }                                                                       \
   }
@@ -93,7 +210,7 @@ struct dummy_stream
   ([&]() {                                                             \
     const auto& a_ = A;                                                \
     if (!a_) {                                                         \
-      std::cout << "[E]" << a_ << " false"                             \
+      ::testing::out() << "[E]" << a_ << " false"                      \
                 << " at " << __FILE__ << ":" << __LINE__ << std::endl; \
       throw 1;                                                         \
     }                                                                  \
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "instrument.h"
+
+//
+// Counters behind the INSTRUMENT_ macros, see instrument.h.
+// Each thread allocates its block on its first count and pushes it to a global list without locks.
+// Blocks are never freed, so counts of finished threads stay in the snapshots.
+//
+
+#if defined(_MSC_VER)
+#define INSTRUMENT_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define INSTRUMENT_THREAD_LOCAL __thread
+#else
+#define INSTRUMENT_THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef WIN32
+#include <windows.h>
+#define ATOMIC_CAS(p, old, value) (InterlockedCompareExchangePointer((void *volatile *) (p), (value), (old)) == (old))
+#else
+#define ATOMIC_CAS(p, old, value) __sync_bool_compare_and_swap(p, old, value)
+#endif
+
+struct instrument_block {
+	struct instrument_stats stats;
+	struct instrument_block *next;
+};
+
+static struct instrument_block *volatile instrument_blocks;
+static INSTRUMENT_THREAD_LOCAL struct instrument_block *instrument_own;
+
+static struct instrument_stats *own_stats(void) {
+	struct instrument_block *b = instrument_own;
+	if (!b) {
+		// Not counted, it is made once per thread.
+		b = (struct instrument_block *) calloc(1, sizeof(struct instrument_block));
+		if (!b)
+			return NULL;
+		do
+			b->next = instrument_blocks;
+		while (!ATOMIC_CAS(&instrument_blocks, b->next, b));
+		instrument_own = b;
+	}
+	return &b->stats;
+}
+
+void instrument_add(int counter, unsigned long long bytes, unsigned long long cycles) {
+	struct instrument_stats *s = own_stats();
+	if (s) {
+		s->of[counter].calls++;
+		s->of[counter].bytes += bytes;
+		s->of[counter].cycles += cycles;
+	}
+}
+
+void instrument_add_allocation(int counter) {
+	struct instrument_stats *s = own_stats();
+	if (s)
+		s->of[counter].allocations++;
+}
+
+void instrument_snapshot(struct instrument_stats *out) {
+	struct instrument_block *b;
+	int i;
+	memset(out, 0, sizeof(struct instrument_stats));
+	for (b = instrument_blocks; b; b = b->next) {
+		for (i = 0; i < INSTRUMENT_COUNTERS; i++) {
+			out->of[i].calls += b->stats.of[i].calls;
+			out->of[i].bytes += b->stats.of[i].bytes;
+			out->of[i].cycles += b->stats.of[i].cycles;
+			out->of[i].allocations += b->stats.of[i].allocations;
+		}
+	}
+}
+
+void instrument_thread_snapshot(struct instrument_stats *out) {
+	if (instrument_own)
+		*out = instrument_own->stats;
+	else
+		memset(out, 0, sizeof(struct instrument_stats));
+}
+
+unsigned long long instrument_thread_allocations(void) {
+	unsigned long long r = 0;
+	int i;
+	for (i = 0; instrument_own && i < INSTRUMENT_COUNTERS; i++)
+		r += instrument_own->stats.of[i].allocations;
+	return r;
+}
+
+void instrument_reset(void) {
+	struct instrument_block *b;
+	for (b = instrument_blocks; b; b = b->next)
+		memset(&b->stats, 0, sizeof(b->stats));
+}
+
+const char *instrument_counter_name(int counter) {
+	static const char *names[INSTRUMENT_COUNTERS] = {
+		"decode_base64", "encode_base64", "calc", "eq_wild", "vsscanf", "get_utf8", "put_utf8" };
+	return counter >= 0 && counter < INSTRUMENT_COUNTERS ? names[counter] : "";
+}
+
+unsigned long long instrument_ticks(void) {
+#if defined(CLOCK_MONOTONIC)
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (unsigned long long) t.tv_sec * 1000000000 + t.tv_nsec;
+#else
+	return (unsigned long long) clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+#undef ATOMIC_CAS
+#undef INSTRUMENT_THREAD_LOCAL
+
+#ifdef TESTS
+
+#include <stdio.h>
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+double calc(const char **expression, const char **out_err_msg);
+void decode_base64(const char *src, char *(*allocator)(int size, void *context), void *context);
+void parallel_for(int task_count, int thread_count, void (*task)(void *context, int i), void *context);
+
+static char *instrument_allocator(int size, void *context) {
+	return (char *) context;
+}
+
+static void calc_task(void *context, int i) {
+	const char *expr = "1+2", *err;
+	calc(&expr, &err);
+}
+
+void instrument_tests()
+{
+	struct instrument_stats before, after;
+	const char *expr = "2*(3+4)", *err;
+	char decoded[8];
+	ASSERT(strcmp(instrument_counter_name(INSTRUMENT_SSCANF), "vsscanf") == 0 && !*instrument_counter_name(-1));
+
+	instrument_thread_snapshot(&before);
+	calc(&expr, &err);
+	decode_base64("TWFu", instrument_allocator, decoded);
+	instrument_thread_snapshot(&after);
+#ifdef CONFIG_INSTRUMENT
+	ASSERT(after.of[INSTRUMENT_CALC].calls == before.of[INSTRUMENT_CALC].calls + 1);
+	ASSERT(after.of[INSTRUMENT_CALC].bytes == before.of[INSTRUMENT_CALC].bytes + 7);
+	ASSERT(after.of[INSTRUMENT_CALC].allocations == before.of[INSTRUMENT_CALC].allocations);
+	ASSERT(after.of[INSTRUMENT_DECODE_BASE64].bytes == before.of[INSTRUMENT_DECODE_BASE64].bytes + 3);
+	ASSERT(after.of[INSTRUMENT_DECODE_BASE64].allocations == before.of[INSTRUMENT_DECODE_BASE64].allocations + 1);
+#else
+	{
+		int i;
+		for (i = 0; i < INSTRUMENT_COUNTERS; i++)
+			ASSERT(after.of[i].calls == 0 && after.of[i].allocations == 0);
+	}
+#endif
+
+	// Counts of all threads are merged, also of the finished ones.
+	instrument_reset();
+	parallel_for(1000, 4, calc_task, NULL);
+	instrument_snapshot(&after);
+#ifdef CONFIG_INSTRUMENT
+	ASSERT(after.of[INSTRUMENT_CALC].calls == 1000 && after.of[INSTRUMENT_CALC].bytes == 3000);
+#else
+	ASSERT(after.of[INSTRUMENT_CALC].calls == 0);
+#endif
+}
+
+#endif //TESTS
@@ -0,0 +1,124 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+//
+// Optional counters of the hot paths: calls, bytes processed, cycles spent and allocations made
+// by decode_base64, encode_base64, calc, eq_wild, vsscanf, get_utf8 and put_utf8.
+// Built with CONFIG_INSTRUMENT defined, otherwise the INSTRUMENT_ macros compile to nothing
+// and the snapshots are all zeros.
+// Each thread counts to its own block, the snapshot sums the blocks of all threads that ever counted,
+// exact once they are joined.
+// Usage example:
+//    struct instrument_stats s;
+//    instrument_snapshot(&s);
+//    printf("%llu cycles per eq_wild\n", s.of[INSTRUMENT_EQ_WILD].cycles / s.of[INSTRUMENT_EQ_WILD].calls);
+//
+
+enum instrument_counter {
+	INSTRUMENT_DECODE_BASE64,  // bytes decoded
+	INSTRUMENT_ENCODE_BASE64,  // bytes encoded
+	INSTRUMENT_CALC,           // expression chars read
+	INSTRUMENT_EQ_WILD,        // text chars, wild_compile allocations
+	INSTRUMENT_SSCANF,         // input chars read, scanf_compile and stream allocations
+	INSTRUMENT_GET_UTF8,       // bytes read from get_fn, skipped ill-formed ones too
+	INSTRUMENT_PUT_UTF8,       // bytes of the encoded characters
+	INSTRUMENT_COUNTERS
+};
+
+struct instrument_stat {
+	unsigned long long calls, bytes, cycles;
+	unsigned long long allocations;  // allocator callbacks and malloc/realloc calls
+};
+
+struct instrument_stats {
+	struct instrument_stat of[INSTRUMENT_COUNTERS];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sums the counters of all threads.
+void instrument_snapshot(struct instrument_stats *out);
+
+// Counters of the calling thread only, not disturbed by other threads.
+void instrument_thread_snapshot(struct instrument_stats *out);
+
+// Allocations of the calling thread over all counters.
+unsigned long long instrument_thread_allocations(void);
+
+// Zeroes the counters of all threads, call it when the other threads don't count.
+void instrument_reset(void);
+
+// "decode_base64" for INSTRUMENT_DECODE_BASE64 and so on.
+const char *instrument_counter_name(int counter);
+
+// Used by the macros.
+void instrument_add(int counter, unsigned long long bytes, unsigned long long cycles);
+void instrument_add_allocation(int counter);
+unsigned long long instrument_ticks(void);  // nanoseconds where there is no cycle counter
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef CONFIG_INSTRUMENT
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define INSTRUMENT_NOW() __rdtsc()
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define INSTRUMENT_NOW() __rdtsc()
+#else
+#define INSTRUMENT_NOW() instrument_ticks()
+#endif
+
+// Declares the start time, put it after the declarations of the function.
+#define INSTRUMENT_START(start) unsigned long long start = INSTRUMENT_NOW()
+
+// Counts a call that began at start, bytes is evaluated after the time is taken.
+#define INSTRUMENT_STOP(counter, start, bytes)                                  \
+	do {                                                                        \
+		unsigned long long instrument_cycles_ = INSTRUMENT_NOW() - (start);     \
+		instrument_add(counter, (unsigned long long) (bytes), instrument_cycles_); \
+	} while (0)
+
+#define INSTRUMENT_ALLOCATION(counter) instrument_add_allocation(counter)
+
+#else
+
+#define INSTRUMENT_START(start)
+// sizeof doesn't evaluate bytes, but keeps the variables it uses from being reported unused.
+#define INSTRUMENT_STOP(counter, start, bytes) ((void) sizeof(bytes))
+#define INSTRUMENT_ALLOCATION(counter) ((void) 0)
+
+#endif
+
+#if defined(__cplusplus) && defined(GTEST_H)
+
+//
+// Fails the gunit test if the statement makes allocations on this thread
+// in the instrumented functions or through their allocator callbacks.
+// Without CONFIG_INSTRUMENT it only runs the statement. Include gunit.h first.
+//
+#ifdef CONFIG_INSTRUMENT
+#define EXPECT_NO_ALLOC(statement)                                                  \
+  {                                                                                 \
+    unsigned long long allocations_ = instrument_thread_allocations();              \
+    statement;                                                                      \
+    allocations_ = instrument_thread_allocations() - allocations_;                  \
+    if (allocations_) {                                                             \
+      ::testing::out() << "[E]" << allocations_ << " allocations in " #statement   \
+                       << " at " << __FILE__ << ":" << __LINE__ << std::endl;       \
+      throw 1;                                                                      \
+    }                                                                               \
+  }
+#else
+#define EXPECT_NO_ALLOC(statement) \
+  { statement; }
+#endif
+
+#endif
+
+#endif  // INSTRUMENT_H
@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "gunit.h"
+#include "instrument.h"
+
+// The hot paths, link the C modules built with the same CONFIG_INSTRUMENT.
+extern "C" {
+void decode_base64(const char* src, char* (*allocator)(int size, void* context), void* context);
+double calc(const char** expression, const char** out_err_msg);
+int eq_wild(const char* text, const char* wildcard);
+struct wild_pattern* wild_compile(const char* wildcard);
+int get_utf8(int (*get_fn)(void* context), void* get_fn_context);
+int put_utf8(int character, int (*put_fn)(int ch, void* context), void* put_fn_context);
+}
+
+namespace {
+
+int get_char(void* context) {
+  const char** p = static_cast<const char**>(context);
+  return **p ? static_cast<unsigned char>(*(*p)++) : -1;
+}
+
+int put_char(int v, void* context) {
+  static_cast<std::string*>(context)->push_back(static_cast<char>(v));
+  return 1;
+}
+
+}  // namespace
+
+TEST(Instrument, HotPathsDontAllocate) {
+  const char* expr = "2*(3+4)";
+  const char* err;
+  EXPECT_NO_ALLOC(calc(&expr, &err));
+  EXPECT_NO_ALLOC(ASSERT_TRUE(eq_wild("some text", "so*t*t")));
+  int i = 0;
+  char s[8];
+  EXPECT_NO_ALLOC(ASSERT_EQ(sscanf("42 word", "%d %7s", &i, s), 2));
+  const char* text = "\xd0\xaf";
+  std::string out;
+  out.reserve(8);
+  EXPECT_NO_ALLOC(ASSERT_EQ(get_utf8(get_char, &text), 0x42f));
+  EXPECT_NO_ALLOC(put_utf8(0x42f, put_char, &out));
+}
+
+#ifdef CONFIG_INSTRUMENT
+
+static char* string_allocator(int size, void* context) {
+  std::string* s = static_cast<std::string*>(context);
+  s->resize(size);
+  return &(*s)[0];
+}
+
+TEST(Instrument, CountsAllocations) {
+  std::string out;
+  bool failed = false;
+  try {
+    EXPECT_NO_ALLOC(decode_base64("TWFu", string_allocator, &out));
+  } catch (int) {
+    failed = true;
+  }
+  ASSERT_TRUE(failed && out == "Man");
+  unsigned long long before = instrument_thread_allocations();
+  free(wild_compile("a*b"));
+  ASSERT_EQ(instrument_thread_allocations(), before + 1);
+}
+
+TEST(Instrument, CountsCallsAndBytes) {
+  instrument_stats before, after;
+  instrument_thread_snapshot(&before);
+  const char* text = "\xd0\xaf";
+  std::string out;
+  ASSERT_EQ(get_utf8(get_char, &text), 0x42f);
+  put_utf8(0x1f600, put_char, &out);
+  instrument_thread_snapshot(&after);
+  ASSERT_EQ(after.of[INSTRUMENT_GET_UTF8].calls, before.of[INSTRUMENT_GET_UTF8].calls + 1);
+  ASSERT_EQ(after.of[INSTRUMENT_GET_UTF8].bytes, before.of[INSTRUMENT_GET_UTF8].bytes + 2);
+  ASSERT_EQ(after.of[INSTRUMENT_PUT_UTF8].bytes, before.of[INSTRUMENT_PUT_UTF8].bytes + 4);
+  ASSERT_LE(before.of[INSTRUMENT_PUT_UTF8].cycles, after.of[INSTRUMENT_PUT_UTF8].cycles);
+  // Other threads count to the merged snapshot only.
+  instrument_snapshot(&after);
+  ASSERT_LE(before.of[INSTRUMENT_PUT_UTF8].calls + 1, after.of[INSTRUMENT_PUT_UTF8].calls);
+  // Skipped ill-formed bytes are read too.
+  instrument_thread_snapshot(&before);
+  text = "\x80\xe2\x82x";
+  ASSERT_EQ(get_utf8(get_char, &text), 'x');
+  instrument_thread_snapshot(&after);
+  ASSERT_EQ(after.of[INSTRUMENT_GET_UTF8].bytes, before.of[INSTRUMENT_GET_UTF8].bytes + 4);
+}
+
+#endif
@@ -0,0 +1,302 @@
+#include <stddef.h>
+#include <string.h>
+
+//
+// Converts len bytes of Latin-1 (ISO 8859-1) or Windows-1252 text from src to UTF-8.
+// Windows-1252 bytes 0x81, 0x8D, 0x8F, 0x90 and 0x9D, undefined there, become U+0081... as browsers do.
+// Stores at most cap bytes to dst (may be NULL if cap is 0), never splitting a character.
+// Returns the number of bytes of the whole text, which is more than cap if dst was too small.
+// Usage example:
+//    size_t n = latin1_to_utf8_size(text, len);
+//    char *utf8 = malloc(n);
+//    latin1_to_utf8(text, len, utf8, n);
+//
+size_t latin1_to_utf8(const char *src, size_t len, char *dst, size_t cap);
+size_t cp1252_to_utf8(const char *src, size_t len, char *dst, size_t cap);
+
+//
+// Return the exact number of bytes latin1_to_utf8 and cp1252_to_utf8 produce.
+//
+size_t latin1_to_utf8_size(const char *src, size_t len);
+size_t cp1252_to_utf8_size(const char *src, size_t len);
+
+//
+// Converts len bytes of UTF-8 from src to Latin-1 or Windows-1252, one byte per character.
+// The input is decoded as get_utf8 does, so the result has as many bytes as utf8_decoded_size returns.
+// Characters not representable in the target encoding are stored as '?', and unless unmapped is NULL,
+// *unmapped receives the offset in src where decoding of the first of them started, or len if there are none.
+// Stores at most cap bytes to dst (may be NULL if cap is 0).
+// Returns the number of bytes of the whole text, which is more than cap if dst was too small.
+// Usage example:
+//    size_t bad;
+//    n = utf8_to_latin1(text, len, out, sizeof(out), &bad);
+//    if (bad != len) printf("can't convert the character at %zu\n", bad);
+//
+size_t utf8_to_latin1(const char *src, size_t len, char *dst, size_t cap, size_t *unmapped);
+size_t utf8_to_cp1252(const char *src, size_t len, char *dst, size_t cap, size_t *unmapped);
+
+int get_utf8_from(const char **src, const char *end);
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LATIN1_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+static int lowest_bit(unsigned int mask) { unsigned long r; _BitScanForward(&r, mask); return (int) r; }
+#else
+#define lowest_bit(mask) __builtin_ctz(mask)
+#endif
+#endif
+
+// Characters of Windows-1252 bytes 0x80..0x9F.
+static const unsigned short cp1252_high[32] = {
+	0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+	0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178 };
+
+//
+// Expands bytes to UTF-8, bytes 0x80..0x9F through the high table if it's not NULL.
+//
+static size_t to_utf8(const char *src, size_t len, char *dst, size_t cap, const unsigned short *high)
+{
+	const unsigned char *s = (const unsigned char *) src;
+	unsigned char *d = (unsigned char *) dst;
+	size_t i = 0, r = 0;
+	while (i < len) {
+		int c;
+#ifdef LATIN1_SSE2
+		// ASCII runs are copied 16 bytes at a time, up to the next high byte.
+		while (len - i >= 16 && (r >= cap || cap - r >= 16)) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+			int mask = _mm_movemask_epi8(v);
+			if (mask) {
+				int ascii = lowest_bit(mask);
+				if (r < cap)
+					memcpy(d + r, s + i, ascii);
+				i += ascii;
+				r += ascii;
+				break;
+			}
+			if (r < cap)
+				_mm_storeu_si128((__m128i *) (d + r), v);
+			i += 16;
+			r += 16;
+		}
+		if (i == len)
+			break;
+#endif
+		c = s[i++];
+		if (c < 0x80) {
+			if (r < cap)
+				d[r] = (unsigned char) c;
+			r++;
+			continue;
+		}
+		if (high && c < 0xa0)
+			c = high[c - 0x80];
+		if (c < 0x800) {
+			if (r + 2 > cap)
+				cap = 0;
+			else {
+				d[r] = (unsigned char) (c >> 6 | 0xc0);
+				d[r + 1] = (unsigned char) ((c & 0x3f) | 0x80);
+			}
+			r += 2;
+		} else {
+			if (r + 3 > cap)
+				cap = 0;
+			else {
+				d[r] = (unsigned char) (c >> 12 | 0xe0);
+				d[r + 1] = (unsigned char) (((c >> 6) & 0x3f) | 0x80);
+				d[r + 2] = (unsigned char) ((c & 0x3f) | 0x80);
+			}
+			r += 3;
+		}
+	}
+	return r;
+}
+
+size_t latin1_to_utf8(const char *src, size_t len, char *dst, size_t cap)
+{
+	return to_utf8(src, len, dst, cap, NULL);
+}
+
+size_t cp1252_to_utf8(const char *src, size_t len, char *dst, size_t cap)
+{
+	return to_utf8(src, len, dst, cap, cp1252_high);
+}
+
+size_t latin1_to_utf8_size(const char *src, size_t len)
+{
+	return to_utf8(src, len, NULL, 0, NULL);
+}
+
+size_t cp1252_to_utf8_size(const char *src, size_t len)
+{
+	return to_utf8(src, len, NULL, 0, cp1252_high);
+}
+
+//
+// Returns the byte of the character in Latin-1 or, if high is not NULL, in Windows-1252, or -1.
+//
+static int to_byte(int c, const unsigned short *high)
+{
+	int i;
+	if (c < 0x80 || (c >= 0xa0 && c <= 0xff))
+		return c;
+	if (!high)
+		return c <= 0xff ? c : -1;
+	for (i = 0; i < 32; i++) {
+		if (high[i] == c)
+			return 0x80 + i;
+	}
+	return -1;
+}
+
+static size_t from_utf8(const char *src, size_t len, char *dst, size_t cap, size_t *unmapped, const unsigned short *high)
+{
+	const unsigned char *p = (const unsigned char *) src;
+	const unsigned char *end = p + len;
+	unsigned char *d = (unsigned char *) dst;
+	size_t r = 0;
+	if (unmapped)
+		*unmapped = len;
+	for (;;) {
+		const unsigned char *at;
+		int c;
+#ifdef LATIN1_SSE2
+		while (end - p >= 16 && (r >= cap || cap - r >= 16)) {
+			__m128i v = _mm_loadu_si128((const __m128i *) p);
+			int mask = _mm_movemask_epi8(v);
+			if (mask) {
+				int ascii = lowest_bit(mask);
+				if (r < cap)
+					memcpy(d + r, p, ascii);
+				p += ascii;
+				r += ascii;
+				break;
+			}
+			if (r < cap)
+				_mm_storeu_si128((__m128i *) (d + r), v);
+			p += 16;
+			r += 16;
+		}
+#endif
+		at = p;
+		if (p == end)
+			break;
+		if (*p < 0x80)
+			c = *p++;
+		else if (end - p >= 2 && (p[0] & 0xfe) == 0xc2 && (p[1] & 0xc0) == 0x80) {
+			// U+0080..U+00FF
+			c = (p[0] & 0x1f) << 6 | (p[1] & 0x3f);
+			p += 2;
+		} else {
+			c = get_utf8_from((const char **) &p, (const char *) end);
+			if (c < 0)
+				break;
+		}
+		c = to_byte(c, high);
+		if (c < 0) {
+			if (unmapped && *unmapped == len)
+				*unmapped = at - (const unsigned char *) src;
+			c = '?';
+		}
+		if (r < cap)
+			d[r] = (unsigned char) c;
+		r++;
+	}
+	return r;
+}
+
+size_t utf8_to_latin1(const char *src, size_t len, char *dst, size_t cap, size_t *unmapped)
+{
+	return from_utf8(src, len, dst, cap, unmapped, NULL);
+}
+
+size_t utf8_to_cp1252(const char *src, size_t len, char *dst, size_t cap, size_t *unmapped)
+{
+	return from_utf8(src, len, dst, cap, unmapped, cp1252_high);
+}
+
+#ifdef TESTS
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+int put_utf8(int character, int (*put_fn)(int ch, void *context), void *put_fn_context);
+size_t utf8_decoded_size(const char *src, size_t len);
+
+static int put_c(int v, void *context) {
+	*(*(char **) context)++ = (char) v;
+	return 1;
+}
+
+static void test_both_ways(const char *text, size_t len, const char *utf8, int cp1252)
+{
+	char out[64], back[64];
+	size_t n = strlen(utf8), bad;
+	ASSERT((cp1252 ? cp1252_to_utf8(text, len, out, sizeof(out)) : latin1_to_utf8(text, len, out, sizeof(out))) == n);
+	ASSERT(memcmp(out, utf8, n) == 0);
+	ASSERT((cp1252 ? cp1252_to_utf8_size(text, len) : latin1_to_utf8_size(text, len)) == n);
+	ASSERT((cp1252 ? utf8_to_cp1252(utf8, n, back, sizeof(back), &bad) : utf8_to_latin1(utf8, n, back, sizeof(back), &bad)) == len);
+	ASSERT(memcmp(back, text, len) == 0 && bad == n);
+}
+
+void latin1_tests()
+{
+	char text[300], utf8[900], expected[900], back[300];
+	size_t n, bad;
+	int i, round;
+	unsigned int seed = 11;
+
+	test_both_ways("abc", 3, "abc", 0);
+	test_both_ways("caf\xe9 \xa0\xff", 7, "caf\xc3\xa9 \xc2\xa0\xc3\xbf", 0);
+	test_both_ways("\x80\x81\x99\x9f", 4, "\xe2\x82\xac\xc2\x81\xe2\x84\xa2\xc5\xb8", 1);
+	test_both_ways("\x80\x81\x99\x9f", 4, "\xc2\x80\xc2\x81\xc2\x99\xc2\x9f", 0);
+
+	// Every byte both ways, compared with put_utf8.
+	for (i = 0; i < 256; i++)
+		text[i] = (char) i;
+	for (round = 0; round < 2; round++) {
+		char *p = expected;
+		for (i = 0; i < 256; i++)
+			put_utf8(round && i >= 0x80 && i < 0xa0 ? cp1252_high[i - 0x80] : i, put_c, &p);
+		n = p - expected;
+		ASSERT((round ? cp1252_to_utf8(text, 256, utf8, sizeof(utf8)) : latin1_to_utf8(text, 256, utf8, sizeof(utf8))) == n);
+		ASSERT(memcmp(utf8, expected, n) == 0);
+		ASSERT((round ? utf8_to_cp1252(utf8, n, back, 256, &bad) : utf8_to_latin1(utf8, n, back, 256, &bad)) == 256);
+		ASSERT(memcmp(back, text, 256) == 0 && bad == n);
+	}
+
+	// Unmappable characters.
+	ASSERT(utf8_to_latin1("a\xe2\x82\xac\xc5\xb8", 6, back, 10, &bad) == 3 && bad == 1 && memcmp(back, "a??", 3) == 0);
+	ASSERT(utf8_to_cp1252("a\xe2\x82\xac\xc5\xb8", 6, back, 10, &bad) == 3 && bad == 6 && memcmp(back, "a\x80\x9f", 3) == 0);
+	ASSERT(utf8_to_cp1252("\xc2\x80\xc2\x81\xe4\xb8\xad", 7, back, 10, &bad) == 3 && bad == 0 && memcmp(back, "?\x81?", 3) == 0);
+	ASSERT(utf8_to_latin1("x\xf0\x9f\x98\x80", 5, NULL, 0, &bad) == 2 && bad == 1);
+	ASSERT(utf8_to_latin1("\xc3", 1, back, 10, NULL) == 0);
+
+	for (round = 0; round < 20000; round++) {
+		// Mostly ASCII text around the 16 byte blocks, converted whole and into short buffers.
+		size_t len = round % 300, cap, whole;
+		int cp1252 = round % 2;
+		for (i = 0; i < (int) len; i++) {
+			seed = seed * 1103515245 + 12345;
+			text[i] = (char) ((seed >> 16) % 8 ? 'a' + (seed >> 8) % 26 : (seed >> 8) % 256);
+		}
+		n = cp1252 ? cp1252_to_utf8(text, len, utf8, sizeof(utf8)) : latin1_to_utf8(text, len, utf8, sizeof(utf8));
+		ASSERT(n == (cp1252 ? cp1252_to_utf8_size(text, len) : latin1_to_utf8_size(text, len)));
+		ASSERT((cp1252 ? utf8_to_cp1252(utf8, n, back, sizeof(back), &bad) : utf8_to_latin1(utf8, n, back, sizeof(back), &bad)) == len);
+		ASSERT(memcmp(back, text, len) == 0 && bad == n);
+		ASSERT(utf8_decoded_size(utf8, n) == len);
+		cap = n / 2;
+		memset(expected, 0x55, sizeof(expected));
+		ASSERT((cp1252 ? cp1252_to_utf8(text, len, expected, cap) : latin1_to_utf8(text, len, expected, cap)) == n);
+		// Only whole characters of the beginning.
+		for (whole = cap; whole > 0 && whole < n && (utf8[whole] & 0xc0) == 0x80; whole--) {}
+		ASSERT(memcmp(expected, utf8, whole) == 0 && (whole == n || expected[whole] == 0x55));
+	}
+}
+
+#endif //TESTS
@@ -0,0 +1,244 @@
+#include <stddef.h>
+
+//
+// Returns the number of CPUs available to the process (at least 1).
+//
+int cpu_count(void);
+
+//
+// Runs task(context, i) for every i in [0, task_count) on a pool of thread_count threads.
+// thread_count <= 0 means one thread per CPU. The calling thread is one of the pool threads.
+// Tasks are handed out one by one, so tasks of uneven cost are balanced automatically.
+// Returns after all tasks are done.
+//
+void parallel_for(int task_count, int thread_count, void (*task)(void *context, int i), void *context);
+
+//
+// Maps the whole file into memory for reading.
+// Returns NULL on error. Empty files are mapped to an empty string.
+// Release the mapping with unmap_file.
+//
+const char *map_file(const char *file_name, size_t *out_size);
+
+void unmap_file(const char *data, size_t size);
+
+struct parallel_job {
+	int task_count;
+	volatile long next_task;
+	void (*task)(void *context, int i);
+	void *context;
+};
+
+#ifdef WIN32
+
+#include <windows.h>
+
+#define ATOMIC_FETCH_INC(p) (InterlockedIncrement(p) - 1)
+
+int cpu_count(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ATOMIC_FETCH_INC(p) __sync_fetch_and_add(p, 1)
+
+int cpu_count(void) {
+	long r = sysconf(_SC_NPROCESSORS_ONLN);
+	return r > 0 ? (int) r : 1;
+}
+
+#endif
+
+static void run_tasks(struct parallel_job *job) {
+	for (;;) {
+		long i = ATOMIC_FETCH_INC(&job->next_task);
+		if (i >= job->task_count)
+			return;
+		job->task(job->context, (int) i);
+	}
+}
+
+#ifdef WIN32
+
+static DWORD WINAPI thread_proc(void *job) {
+	run_tasks((struct parallel_job *) job);
+	return 0;
+}
+
+void parallel_for(int task_count, int thread_count, void (*task)(void *context, int i), void *context) {
+	struct parallel_job job;
+	HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+	int started = 0;
+	job.task_count = task_count;
+	job.next_task = 0;
+	job.task = task;
+	job.context = context;
+	if (thread_count <= 0)
+		thread_count = cpu_count();
+	if (thread_count > task_count)
+		thread_count = task_count;
+	if (thread_count > MAXIMUM_WAIT_OBJECTS)
+		thread_count = MAXIMUM_WAIT_OBJECTS;
+	for (; started < thread_count - 1; started++) {
+		threads[started] = CreateThread(NULL, 0, thread_proc, &job, 0, NULL);
+		if (!threads[started])
+			break;
+	}
+	run_tasks(&job);
+	if (started) {
+		WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+		while (started)
+			CloseHandle(threads[--started]);
+	}
+}
+
+const char *map_file(const char *file_name, size_t *out_size) {
+	const char *r = NULL;
+	LARGE_INTEGER size;
+	HANDLE mapping;
+	HANDLE file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	if (!GetFileSizeEx(file, &size) || (unsigned long long) size.QuadPart != (size_t) size.QuadPart) {
+		CloseHandle(file);
+		return NULL;
+	}
+	*out_size = (size_t) size.QuadPart;
+	if (!size.QuadPart) {
+		CloseHandle(file);
+		return "";
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping) {
+		r = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	return r;
+}
+
+void unmap_file(const char *data, size_t size) {
+	if (size)
+		UnmapViewOfFile(data);
+}
+
+#else
+
+static void *thread_proc(void *job) {
+	run_tasks((struct parallel_job *) job);
+	return NULL;
+}
+
+void parallel_for(int task_count, int thread_count, void (*task)(void *context, int i), void *context) {
+	struct parallel_job job;
+	pthread_t threads[256];
+	int started = 0;
+	job.task_count = task_count;
+	job.next_task = 0;
+	job.task = task;
+	job.context = context;
+	if (thread_count <= 0)
+		thread_count = cpu_count();
+	if (thread_count > task_count)
+		thread_count = task_count;
+	if (thread_count > 256)
+		thread_count = 256;
+	for (; started < thread_count - 1; started++) {
+		if (pthread_create(&threads[started], NULL, thread_proc, &job) != 0)
+			break;
+	}
+	run_tasks(&job);
+	while (started)
+		pthread_join(threads[--started], NULL);
+}
+
+const char *map_file(const char *file_name, size_t *out_size) {
+	struct stat st;
+	void *r;
+	int fd = open(file_name, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || (unsigned long long) st.st_size != (size_t) st.st_size) {
+		close(fd);
+		return NULL;
+	}
+	*out_size = (size_t) st.st_size;
+	if (!st.st_size) {
+		close(fd);
+		return "";
+	}
+	r = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (r == MAP_FAILED)
+		return NULL;
+#ifdef MADV_SEQUENTIAL
+	madvise(r, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+	return (const char *) r;
+}
+
+void unmap_file(const char *data, size_t size) {
+	if (size)
+		munmap((void *) data, size);
+}
+
+#endif
+
+#undef ATOMIC_FETCH_INC
+
+#ifdef TESTS
+
+#include <stdio.h>
+#include <string.h>
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+static void square_task(void *context, int i) {
+	((long long *) context)[i] = (long long) i * i;
+}
+
+void parallel_tests()
+{
+	static long long squares[1000];
+	int i;
+	parallel_for(1000, 4, square_task, squares);
+	for (i = 0; i < 1000; i++)
+		ASSERT(squares[i] == (long long) i * i);
+	parallel_for(0, 0, square_task, squares);
+	ASSERT(cpu_count() >= 1);
+
+	{
+		const char *name = "parallel_test.tmp";
+		const char *data;
+		size_t size = 1;
+		FILE *f = fopen(name, "wb");
+		fputs("mapped text", f);
+		fclose(f);
+		data = map_file(name, &size);
+		ASSERT(data && size == 11 && memcmp(data, "mapped text", 11) == 0);
+		unmap_file(data, size);
+
+		f = fopen(name, "wb");
+		fclose(f);
+		data = map_file(name, &size);
+		ASSERT(data && size == 0);
+		unmap_file(data, size);
+		remove(name);
+
+		ASSERT(!map_file(name, &size));
+	}
+}
+
+#endif //TESTS
@@ -0,0 +1,505 @@
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+//
+// Compile-time sscanf for C++20.
+// The format is parsed at compile time, arguments are checked against conversions,
+// and each format gets its own straight-line parser with no format interpretation at runtime.
+// Conversions, return values and %n follow the rules of VSSCANF in sscanf.c.
+// Slices "%.*s", "%.*[...]" and "%N.*c" store the matched chars to a std::string_view pointing into the input.
+// Sample:
+//    int a;
+//    char name[32], rest[100];
+//    if (scan<"%d %31s %[^,]">(line, &a, name, rest) == 3) ...
+//
+
+#ifdef CONFIG_LIBC_FLOATINGPOINT
+// Floats are parsed by strtod.c, link it as C.
+extern "C" double strtodn(const char* s, long max_len, char** end);
+#endif
+
+namespace scan_detail {
+
+enum op_kind { OP_STOP, OP_SPACE, OP_LITERAL, OP_PERCENT, OP_COUNT, OP_INT, OP_FLOAT, OP_CHARS, OP_STRING, OP_SET, OP_NONE };
+
+struct op {
+  op_kind kind = OP_STOP;
+  char dst_type = 'i';  // 'c' - char, 'h' - short, 'i' - int, 'l' - long, 'L' - long long
+  char c = 0;           // literal character or conversion character
+  bool skip_assign = false;
+  bool slice = false;  // %.*s, %.*[ or %.*c stored as a std::string_view
+  long width = 0;
+  unsigned int set[256 / 32] = {};
+  std::size_t next = 0;  // format position of the next directive
+
+  constexpr bool takes_arg() const { return !skip_assign && kind >= OP_COUNT && kind <= OP_SET; }
+  constexpr void set_bit(int i) { set[i >> 5] |= 1u << (i & 0x1f); }
+  constexpr bool is_set(unsigned char i) const { return set[i >> 5] & (1u << (i & 0x1f)); }
+};
+
+template <std::size_t N>
+struct format {
+  char s[N];
+  constexpr format(const char (&str)[N]) {
+    for (std::size_t i = 0; i < N; i++)
+      s[i] = str[i];
+  }
+};
+
+constexpr bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Acts as strtol(s + pos, &end, 10) of the C implementation.
+constexpr long parse_width(const char* s, std::size_t& pos) {
+  std::size_t p = pos;
+  bool negative = false;
+  unsigned long long r = 0;
+  while (is_space(s[p]))
+    p++;
+  if (s[p] == '-' || s[p] == '+')
+    negative = s[p++] == '-';
+  if (s[p] < '0' || s[p] > '9')
+    return 0;
+  for (; s[p] >= '0' && s[p] <= '9'; p++) {
+    if (r <= LONG_MAX)
+      r = r * 10 + (s[p] - '0');
+  }
+  pos = p;
+  if (r > LONG_MAX)
+    return negative ? LONG_MIN : LONG_MAX;
+  return negative ? -static_cast<long>(r) : static_cast<long>(r);
+}
+
+// Mirrors parse_op of sscanf.c.
+constexpr op parse_op(const char* fmt, std::size_t pos) {
+  op r;
+  r.c = fmt[pos];
+  if (fmt[pos] == '%') {
+    r.skip_assign = fmt[++pos] == '*';
+    if (r.skip_assign)
+      pos++;
+    r.width = parse_width(fmt, pos);
+    r.slice = fmt[pos] == '.' && fmt[pos + 1] == '*';
+    if (r.slice)
+      pos += 2;
+    if (fmt[pos] == 'L') {
+      r.dst_type = 'L';
+      pos++;
+    } else if (fmt[pos] == 'h') {
+      r.dst_type = fmt[++pos] == 'h' ? (pos++, 'c') : 'h';
+    } else if (fmt[pos] == 'l') {
+      r.dst_type = fmt[++pos] == 'l' ? (pos++, 'L') : 'l';
+    }
+    r.c = fmt[pos];
+    switch (fmt[pos]) {
+      case 0: r.kind = OP_STOP; r.next = pos; return r;
+      case '%': r.kind = OP_PERCENT; break;
+      case 'n': r.kind = OP_COUNT; break;
+      case 'i': case 'd': case 'o': case 'x': case 'X': case 'p': case 'u':
+        r.kind = OP_INT;
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        r.kind = OP_FLOAT;
+        break;
+      case 'c': r.kind = OP_CHARS; break;
+      case 's': r.kind = OP_STRING; break;
+      case '[': {
+        bool negate = fmt[++pos] == '^';
+        r.kind = OP_STOP;
+        r.next = pos;
+        if (negate) pos++;
+        if (fmt[pos] == ']') pos++, r.set_bit(']');
+        while (fmt[pos] && fmt[pos] != ']') {
+          int f = static_cast<unsigned char>(fmt[pos++]);
+          r.set_bit(f);
+          if (fmt[pos] != '-')
+            continue;
+          if (!fmt[++pos])
+            return r;
+          if (fmt[pos] == ']') {
+            r.set_bit('-');
+            break;
+          }
+          int t = static_cast<unsigned char>(fmt[pos++]);
+          if (f < 0xff) {
+            do
+              r.set_bit(++f);
+            while (f < t);
+          }
+        }
+        if (!fmt[pos])
+          return r;
+        if (negate) {
+          for (auto& m : r.set)
+            m = ~m;
+        }
+        r.kind = OP_SET;
+      } break;
+      default: r.kind = OP_NONE; break;
+    }
+    if (r.slice && r.kind != OP_CHARS && r.kind != OP_STRING && r.kind != OP_SET)
+      r.kind = OP_NONE;
+    r.next = pos + 1;
+    return r;
+  } else if (static_cast<signed char>(fmt[pos]) <= ' ') {
+    while (fmt[pos] && static_cast<signed char>(fmt[pos]) <= ' ')
+      pos++;
+    r.kind = OP_SPACE;
+    r.next = pos;
+    return r;
+  }
+  r.kind = OP_LITERAL;
+  r.next = pos + 1;
+  return r;
+}
+
+template <format F>
+constexpr std::size_t op_count() {
+  std::size_t n = 0;
+  for (std::size_t pos = 0; F.s[pos]; n++) {
+    op o = parse_op(F.s, pos);
+    if (o.kind == OP_STOP)
+      return n + 1;
+    pos = o.next;
+  }
+  return n;
+}
+
+template <format F>
+constexpr auto parse() {
+  std::array<op, op_count<F>()> r{};
+  std::size_t pos = 0;
+  for (auto& o : r) {
+    o = parse_op(F.s, pos);
+    pos = o.next;
+  }
+  return r;
+}
+
+template <format F>
+constexpr std::size_t arg_count() {
+  std::size_t n = 0;
+  for (const auto& o : parse<F>())
+    n += o.takes_arg();
+  return n;
+}
+
+// Index of the argument of the i-th op.
+template <format F>
+constexpr std::size_t arg_index(std::size_t i) {
+  std::size_t n = 0;
+  for (std::size_t j = 0; j < i; j++)
+    n += parse<F>()[j].takes_arg();
+  return n;
+}
+
+template <class T, class... U>
+constexpr bool is_one_of = (std::is_same_v<T, U> || ...);
+
+template <class T>
+constexpr bool is_integer_dst(char dst_type) {
+  switch (dst_type) {
+    case 'c': return is_one_of<T, char, signed char, unsigned char>;
+    case 'h': return is_one_of<T, short, unsigned short>;
+    case 'l': return is_one_of<T, long, unsigned long>;
+    case 'L': return is_one_of<T, long long, unsigned long long>;
+    default: return is_one_of<T, int, unsigned int>;
+  }
+}
+
+// Checks that the argument type matches the conversion.
+template <class A>
+constexpr bool arg_matches(const op& o) {
+  if constexpr (!std::is_pointer_v<A>) {
+    return false;
+  } else {
+    using T = std::remove_pointer_t<A>;
+    if (o.slice)
+      return std::is_same_v<T, std::string_view>;
+    switch (o.kind) {
+      case OP_INT:
+        if (o.c == 'p')
+          return std::is_same_v<T, void*>;
+        return is_integer_dst<T>(o.dst_type);
+      case OP_COUNT:
+        return is_integer_dst<T>(o.dst_type);
+      case OP_FLOAT:
+        return o.dst_type == 'l' ? std::is_same_v<T, double> : std::is_same_v<T, float>;
+      default:
+        return is_one_of<T, char, signed char, unsigned char>;
+    }
+  }
+}
+
+struct state {
+  const char* buf;
+  const char* buf_start;
+  int count;
+  bool first_match;
+};
+
+inline const char* skip_ws(const char* s) {
+  while (*s && *s <= ' ')
+    s++;
+  return s;
+}
+
+template <class T>
+inline void set_typed(T* dst, long long value) {
+  *dst = static_cast<T>(value);
+}
+
+inline unsigned int digit_value(char c) {
+  return c >= '0' && c <= '9' ? c - '0' :
+         c >= 'a' && c <= 'z' ? c - 'a' + 10 :
+         c >= 'A' && c <= 'Z' ? c - 'A' + 10 : 99;
+}
+
+// Converts 8 decimal digits at once (little-endian only).
+inline unsigned long long parse_8_digits(const char* s) {
+  unsigned long long v;
+  std::memcpy(&v, s, 8);
+  v -= 0x3030303030303030ULL;
+  v = v * 10 + (v >> 8);
+  return ((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)) +
+          ((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+}
+
+// Mirrors parse_int of sscanf.c: strtoll/strtoull results, at most width characters read in place.
+template <int Radix, long Width, bool Signed>
+inline const char* parse_integer(const char* s, long long& out) {
+  const char* p = s;
+  long left = Width >= 1 ? Width : 0x7fffffff;
+  int radix = Radix;
+  unsigned long long r = 0;
+  bool negative = false, overflow = false, any_digit = false;
+  if (left >= 1 && (*p == '-' || *p == '+'))
+    negative = *p++ == '-', left--;
+  if ((radix == 0 || radix == 16) && left >= 3 &&
+      *p == '0' && (p[1] == 'x' || p[1] == 'X') && digit_value(p[2]) < 16) {
+    p += 2, left -= 2;
+    radix = 16;
+  } else if (radix == 0) {
+    radix = left >= 1 && *p == '0' ? 8 : 10;
+  }
+  for (; left >= 1 && *p == '0'; p++, left--)
+    any_digit = true;
+  if (radix == 10) {
+    long n = 0, i = 0;
+    while (n < left && p[n] >= '0' && p[n] <= '9')
+      n++;
+    if (n > 20) {
+      overflow = true;
+    } else {
+      if constexpr (std::endian::native == std::endian::little) {
+        for (; n - i >= 8; i += 8)
+          r = r * 100000000 + parse_8_digits(p + i);
+      }
+      for (; i < n && i < 19; i++)
+        r = r * 10 + (p[i] - '0');
+      if (i < n) {
+        if (r > (~0ULL - (p[i] - '0')) / 10)
+          overflow = true;
+        r = r * 10 + (p[i] - '0');
+      }
+    }
+    p += n;
+    any_digit |= n != 0;
+  } else {
+    for (; left >= 1; p++, left--) {
+      unsigned int d = digit_value(*p);
+      if (d >= static_cast<unsigned int>(radix))
+        break;
+      if (r > (~0ULL - d) / radix)
+        overflow = true;
+      r = r * radix + d;
+      any_digit = true;
+    }
+  }
+  if (!any_digit)
+    return s;
+  if constexpr (Signed) {
+    if (overflow || r > (negative ? 0x8000000000000000ULL : 0x7fffffffffffffffULL))
+      out = negative ? LLONG_MIN : LLONG_MAX;
+    else
+      out = negative ? static_cast<long long>(0 - r) : static_cast<long long>(r);
+  } else {
+    out = overflow ? static_cast<long long>(~0ULL) : static_cast<long long>(negative ? 0 - r : r);
+  }
+  return p;
+}
+
+template <op O>
+inline bool parse_int(state& st, long long& v) {
+  constexpr int radix =
+      O.c == 'd' || O.c == 'u' ? 10 :
+      O.c == 'o' ? 8 :
+      O.c == 'X' || O.c == 'x' || O.c == 'p' ? 16 : 0;
+  const char* buf = skip_ws(st.buf);
+  const char* end = parse_integer<radix, O.width, O.c == 'd' || O.c == 'i'>(buf, v);
+  if (end == buf)
+    return false;
+  st.buf = end;
+  return true;
+}
+
+// Mirrors exec_op of sscanf.c for the op known at compile time.
+template <op O, class A>
+inline bool exec(state& st, A dst) {
+  const char* buf = st.buf;
+  if constexpr (O.kind == OP_STOP) {
+    return false;
+  } else if constexpr (O.kind == OP_SPACE) {
+    buf = skip_ws(buf);
+  } else if constexpr (O.kind == OP_LITERAL) {
+    if (*buf++ != O.c)
+      return false;
+  } else if constexpr (O.kind == OP_PERCENT) {
+    buf = skip_ws(buf);
+    if (*buf++ != '%')
+      return false;
+  } else if constexpr (O.kind == OP_COUNT) {
+    buf = skip_ws(buf);
+    if constexpr (!O.skip_assign)
+      set_typed(dst, buf - st.buf_start);
+  } else if constexpr (O.kind == OP_INT) {
+    long long v;
+    if (!parse_int<O>(st, v))
+      return false;
+    buf = st.buf;
+    if constexpr (!O.skip_assign) {
+      st.count++;
+      if constexpr (O.c == 'p')
+        *dst = reinterpret_cast<void*>(static_cast<std::size_t>(v));
+      else
+        set_typed(dst, v);
+    }
+  } else if constexpr (O.kind == OP_FLOAT) {
+#ifdef CONFIG_LIBC_FLOATINGPOINT
+    buf = skip_ws(buf);
+    char* end;
+    double v = strtodn(buf, O.width, &end);
+    if (end == buf)
+      return false;
+    buf = end;
+    if constexpr (!O.skip_assign) {
+      st.count++;
+      *dst = static_cast<std::remove_pointer_t<A>>(v);
+    }
+#else
+    return false;
+#endif
+  } else if constexpr (O.kind == OP_CHARS && O.slice) {
+    constexpr long width = O.width < 2 ? 1 : O.width;
+    for (long i = 0; i < width; i++) {
+      if (!buf[i])
+        return false;
+    }
+    if constexpr (!O.skip_assign) {
+      *dst = std::string_view(buf, width);
+      st.count++;
+    }
+    buf += width;
+  } else if constexpr (O.kind == OP_CHARS) {
+    if constexpr (O.width < 2) {
+      if (!*buf)
+        return false;
+      if constexpr (O.skip_assign) {
+        buf++;
+      } else {
+        *dst = *buf++;
+        st.count++;
+      }
+    } else {
+      for (long i = 0; i < O.width; i++) {
+        if (!buf[i])
+          return false;
+      }
+      if constexpr (!O.skip_assign) {
+        std::memcpy(dst, buf, O.width);
+        st.count++;
+      }
+      buf += O.width;
+    }
+  } else if constexpr (O.kind == OP_STRING || O.kind == OP_SET) {
+    long w = O.width;
+    if constexpr (O.kind == OP_STRING)
+      buf = skip_ws(buf);
+    // Without a width nothing is counted, so the stores are bounded by the input alone.
+    auto accepts = [&w](char c) {
+      bool r;
+      if constexpr (O.kind == OP_STRING)
+        r = c > ' ';
+      else
+        r = c && O.is_set(static_cast<unsigned char>(c));
+      if constexpr (O.width == 0)
+        return r;
+      else
+        return r && w-- > 0;
+    };
+    if constexpr (O.skip_assign) {
+      while (accepts(*buf))
+        buf++;
+    } else if constexpr (O.slice) {
+      const char* start = buf;
+      while (accepts(*buf))
+        buf++;
+      *dst = std::string_view(start, buf - start);
+      st.count++;
+    } else {
+      auto d = dst;
+      while (accepts(*buf))
+        *d++ = *buf++;
+      *d = 0;
+      st.count++;
+    }
+  }
+  st.buf = buf;
+  if (st.first_match)
+    st.first_match = false, ++st.count;
+  return true;
+}
+
+struct no_arg {};
+
+template <format F, std::size_t I, class Args>
+inline bool exec_at(state& st, Args& args) {
+  constexpr op o = parse<F>()[I];
+  if constexpr (o.takes_arg()) {
+    constexpr std::size_t a = arg_index<F>(I);
+    static_assert(arg_matches<std::tuple_element_t<a, Args>>(o), "scan argument type doesn't match the conversion");
+    return exec<o>(st, std::get<a>(args));
+  } else {
+    return exec<o>(st, no_arg{});
+  }
+}
+
+template <format F, class Args, std::size_t... I>
+inline int run(const char* buf, Args& args, std::index_sequence<I...>) {
+  state st{buf, buf, -1, true};
+  (void)(exec_at<F, I>(st, args) && ...);
+  return st.count;
+}
+
+}  // namespace scan_detail
+
+template <scan_detail::format F, class... A>
+inline int scan(const char* buf, A... args) {
+  static_assert(sizeof...(A) == scan_detail::arg_count<F>(), "scan argument count doesn't match the format");
+  std::tuple<A...> t(args...);
+  return scan_detail::run<F>(buf, t, std::make_index_sequence<scan_detail::op_count<F>()>());
+}
+
+#endif  // SCAN_HPP
@@ -0,0 +1,284 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __cplusplus
+
+typedef int bool;
+#define true  1
+#define false 0
+
+#endif
+
+struct scan_error {
+	size_t line;    // zero-based line number
+	size_t offset;  // offset in the line of the input where the failed directive started
+};
+
+struct scan_columns {
+	size_t line_count;
+	int column_count;          // the number of assigned conversions in the format
+	void **columns;            // columns[i][line] - value of the i-th assigned conversion, zeroed if the line failed before it
+	size_t *column_sizes;      // bytes per value, as scanf_arg_size
+	size_t error_count;
+	struct scan_error *errors; // lines not matching the whole format, in line order
+};
+
+//
+// Parses each line of data[0..size) with the format as sscanf does, in parallel on thread_count threads
+// (<= 0 - one per CPU), storing the values of each assigned conversion into its own column.
+// Lines are separated by '\n', which is not a part of the line.
+// %s and %[ must have a width, their columns hold width + 1 chars per line.
+// Slices ("%.*s", see snscanf) take two columns: int lengths and char const* pointers into data.
+// Returns NULL if out of memory or if the format has %s or %[ without a width.
+// Release the result with scan_columns_free.
+// Sample:
+//    struct scan_columns *c = scan_columns(data, size, "%d,%lf,%15s", 0);
+//    int *ids = (int *) c->columns[0];
+//    double *prices = (double *) c->columns[1];
+//    char (*names)[16] = (char (*)[16]) c->columns[2];
+//    for (i = 0; i < c->error_count; i++)
+//      printf("bad line %zu at %zu\n", c->errors[i].line + 1, c->errors[i].offset);
+//    scan_columns_free(c);
+//
+struct scan_columns *scan_columns(const char *data, size_t size, const char *format, int thread_count);
+
+void scan_columns_free(struct scan_columns *columns);
+
+struct scanf_program;
+struct scanf_program *scanf_compile(char const *fmt);
+int scanf_exec_args(struct scanf_program const *program, char const *buf, size_t buf_len, void *const *args, char const **stopped);
+int scanf_arg_count(struct scanf_program const *program);
+size_t scanf_arg_size(struct scanf_program const *program, int i);
+void parallel_for(int task_count, int thread_count, void (*task)(void *context, int i), void *context);
+int cpu_count(void);
+
+#define SCAN_COLUMNS_MIN_CHUNK (1 << 20)
+
+struct columns_chunk {
+	size_t begin, end;
+	size_t first_line, line_count;
+	struct scan_error *errors;
+	size_t error_count, error_capacity;
+	bool out_of_memory;
+};
+
+struct columns_job {
+	const char *data;
+	const struct scanf_program *program;
+	struct scan_columns *result;
+	struct columns_chunk *chunks;
+};
+
+static void count_lines(void *context, int i) {
+	struct columns_job *job = (struct columns_job *) context;
+	struct columns_chunk *c = &job->chunks[i];
+	const char *line = job->data + c->begin;
+	const char *end = job->data + c->end;
+	while (line < end) {
+		const char *eol = (const char *) memchr(line, '\n', end - line);
+		c->line_count++;
+		line = eol ? eol + 1 : end;
+	}
+}
+
+static void parse_lines(void *context, int i) {
+	struct columns_job *job = (struct columns_job *) context;
+	struct columns_chunk *c = &job->chunks[i];
+	struct scan_columns *r = job->result;
+	const char *line = job->data + c->begin;
+	const char *end = job->data + c->end;
+	size_t n = c->first_line;
+	void **args = (void **) malloc(sizeof(void *) * (r->column_count + 1));
+	if (!args) {
+		c->out_of_memory = true;
+		return;
+	}
+	for (; line < end; n++) {
+		const char *eol = (const char *) memchr(line, '\n', end - line);
+		const char *stopped;
+		size_t len = (eol ? eol : end) - line;
+		int j;
+		for (j = 0; j < r->column_count; j++)
+			args[j] = (char *) r->columns[j] + n * r->column_sizes[j];
+		scanf_exec_args(job->program, line, len, args, &stopped);
+		if (stopped) {
+			if (c->error_count == c->error_capacity) {
+				size_t capacity = c->error_capacity ? c->error_capacity * 2 : 64;
+				struct scan_error *e = (struct scan_error *) realloc(c->errors, capacity * sizeof(struct scan_error));
+				if (!e) {
+					c->out_of_memory = true;
+					break;
+				}
+				c->errors = e;
+				c->error_capacity = capacity;
+			}
+			c->errors[c->error_count].line = n;
+			c->errors[c->error_count++].offset = stopped - line;
+		}
+		line += len + 1;
+	}
+	free(args);
+}
+
+void scan_columns_free(struct scan_columns *columns) {
+	int i;
+	if (!columns)
+		return;
+	for (i = 0; i < columns->column_count && columns->columns; i++)
+		free(columns->columns[i]);
+	free(columns->columns);
+	free(columns->column_sizes);
+	free(columns->errors);
+	free(columns);
+}
+
+static struct scan_columns *parse_columns(struct columns_job *job, int chunk_count, int thread_count) {
+	struct scan_columns *r = job->result;
+	size_t lines = 0, errors = 0;
+	int i;
+	// The first pass finds where each chunk's rows start.
+	parallel_for(chunk_count, thread_count, count_lines, job);
+	for (i = 0; i < chunk_count; i++) {
+		job->chunks[i].first_line = lines;
+		lines += job->chunks[i].line_count;
+	}
+	r->line_count = lines;
+	r->column_count = scanf_arg_count(job->program);
+	r->columns = (void **) calloc(r->column_count + 1, sizeof(void *));
+	r->column_sizes = (size_t *) calloc(r->column_count + 1, sizeof(size_t));
+	if (!r->columns || !r->column_sizes)
+		return NULL;
+	for (i = 0; i < r->column_count; i++) {
+		r->column_sizes[i] = scanf_arg_size(job->program, i);
+		if (!r->column_sizes[i])
+			return NULL;
+		r->columns[i] = calloc(lines + 1, r->column_sizes[i]);
+		if (!r->columns[i])
+			return NULL;
+	}
+	parallel_for(chunk_count, thread_count, parse_lines, job);
+	for (i = 0; i < chunk_count; i++) {
+		if (job->chunks[i].out_of_memory)
+			return NULL;
+		errors += job->chunks[i].error_count;
+	}
+	r->errors = (struct scan_error *) malloc(sizeof(struct scan_error) * (errors + 1));
+	if (!r->errors)
+		return NULL;
+	for (i = 0; i < chunk_count; i++) {
+		if (job->chunks[i].error_count)
+			memcpy(r->errors + r->error_count, job->chunks[i].errors, sizeof(struct scan_error) * job->chunks[i].error_count);
+		r->error_count += job->chunks[i].error_count;
+	}
+	return r;
+}
+
+struct scan_columns *scan_columns(const char *data, size_t size, const char *format, int thread_count) {
+	struct columns_job job;
+	int chunk_count, i;
+	if (thread_count <= 0)
+		thread_count = cpu_count();
+	// A few chunks per thread to balance chunks having different line lengths.
+	chunk_count = size / SCAN_COLUMNS_MIN_CHUNK < (size_t) thread_count * 4 ?
+		(int) (size / SCAN_COLUMNS_MIN_CHUNK) + 1 :
+		thread_count * 4;
+	job.data = data;
+	job.program = scanf_compile(format);
+	job.result = (struct scan_columns *) calloc(1, sizeof(struct scan_columns));
+	job.chunks = (struct columns_chunk *) calloc(chunk_count, sizeof(struct columns_chunk));
+	if (job.program && job.result && job.chunks) {
+		for (i = 0; i < chunk_count; i++) {
+			size_t begin = i == 0 ? 0 : job.chunks[i - 1].end;
+			size_t end = i == chunk_count - 1 ? size : size / chunk_count * (i + 1);
+			if (end < begin)
+				end = begin;
+			else if (end < size && end > 0) {
+				const char *eol = (const char *) memchr(data + end - 1, '\n', size - end + 1);
+				end = eol ? eol - data + 1 : size;
+			}
+			job.chunks[i].begin = begin;
+			job.chunks[i].end = end;
+		}
+		if (!parse_columns(&job, chunk_count, thread_count)) {
+			scan_columns_free(job.result);
+			job.result = NULL;
+		}
+	} else {
+		free(job.result);
+		job.result = NULL;
+	}
+	if (job.chunks) {
+		for (i = 0; i < chunk_count; i++)
+			free(job.chunks[i].errors);
+	}
+	free(job.chunks);
+	free((void *) job.program);
+	return job.result;
+}
+
+#ifdef TESTS
+
+#include <stdio.h>
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+void scan_columns_tests()
+{
+	const char *text = "1,25,abc\n2,x\n\n3,-1,de\n4,0,toolongname";
+	struct scan_columns *c = scan_columns(text, strlen(text), "%d,%ld,%7s", 2);
+	int *ids;
+	long *values;
+	char (*names)[8];
+	ASSERT(c && c->line_count == 5 && c->column_count == 3);
+	ids = (int *) c->columns[0];
+	values = (long *) c->columns[1];
+	names = (char (*)[8]) c->columns[2];
+	ASSERT(c->column_sizes[0] == sizeof(int) && c->column_sizes[1] == sizeof(long) && c->column_sizes[2] == 8);
+	ASSERT(ids[0] == 1 && ids[1] == 2 && ids[2] == 0 && ids[3] == 3 && ids[4] == 4);
+	ASSERT(values[0] == 25 && values[1] == 0 && values[3] == -1);
+	ASSERT(strcmp(names[0], "abc") == 0 && names[1][0] == 0 && strcmp(names[3], "de") == 0 && strcmp(names[4], "toolong") == 0);
+	ASSERT(c->error_count == 2);
+	ASSERT(c->errors[0].line == 1 && c->errors[0].offset == 2);
+	ASSERT(c->errors[1].line == 2 && c->errors[1].offset == 0);
+	scan_columns_free(c);
+
+	ASSERT(!scan_columns(text, strlen(text), "%d,%s", 2));
+
+	c = scan_columns(text, strlen(text), "%*d,%*d,%.*s", 2);
+	ASSERT(c && c->column_count == 2 && c->column_sizes[0] == sizeof(int) && c->column_sizes[1] == sizeof(char const *));
+	ASSERT(((int *) c->columns[0])[0] == 3 && ((char const **) c->columns[1])[0] == text + 5);
+	ASSERT(((int *) c->columns[0])[4] == 11 && ((char const **) c->columns[1])[4] == text + 26);
+	ASSERT(c->error_count == 2);
+	scan_columns_free(c);
+
+	c = scan_columns("", 0, "%d", 2);
+	ASSERT(c && c->line_count == 0 && c->error_count == 0);
+	scan_columns_free(c);
+
+	{
+		// Enough lines for several chunks.
+		enum { N = 300000 };
+		char *big = (char *) malloc(N * 24);
+		char *p = big;
+		size_t i;
+		short *shorts;
+		unsigned long long *hex;
+		for (i = 0; i < N; i++)
+			p += sprintf(p, i % 1000 == 7 ? "%d;%x\n" : "%d %x\n", (int) (i % 30000), (unsigned) i);
+		c = scan_columns(big, p - big, "%hd %llx", 4);
+		ASSERT(c && c->line_count == N && c->error_count == N / 1000);
+		shorts = (short *) c->columns[0];
+		hex = (unsigned long long *) c->columns[1];
+		for (i = 0; i < N; i++)
+			ASSERT(shorts[i] == (short) (i % 30000) && hex[i] == (i % 1000 == 7 ? 0 : i));
+		for (i = 0; i < c->error_count; i++)
+			ASSERT(c->errors[i].line == i * 1000 + 7);
+		scan_columns_free(c);
+		free(big);
+	}
+}
+
+#endif //TESTS
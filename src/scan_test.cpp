@@ -0,0 +1,190 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "gunit.h"
+#include "scan.hpp"
+
+TEST(Scan, Integers) {
+  int i = 0xcc;
+  unsigned n = 0xcc;
+  ASSERT_EQ(scan<"%d">("-124", &i), 1);
+  ASSERT_EQ(i, -124);
+  ASSERT_EQ(scan<"%i">("-0x1f", &i), 1);
+  ASSERT_EQ(i, -31);
+  ASSERT_EQ(scan<"%i">("010", &i), 1);
+  ASSERT_EQ(i, 8);
+  ASSERT_EQ(scan<"%4u">("12345678", &n), 1);
+  ASSERT_EQ(n, 1234u);
+  ASSERT_EQ(scan<"%o">("17777777777", &n), 1);
+  ASSERT_EQ(n, 017777777777u);
+  ASSERT_EQ(scan<"%x">("7fffffff", &n), 1);
+  ASSERT_EQ(n, 0x7fffffffu);
+  ASSERT_EQ(scan<"%%%u">("%42", &n), 1);
+  ASSERT_EQ(n, 42u);
+  ASSERT_EQ(scan<"%-3u">("12345", &n), 1);
+  ASSERT_EQ(n, 12345u);
+  int m = 0;
+  ASSERT_EQ(scan<"%3d%n">("-12345", &i, &m), 1);
+  ASSERT_TRUE(i == -12 && m == 3);
+  ASSERT_EQ(scan<"%2x%n">("0x1f", &n, &m), 1);
+  ASSERT_TRUE(n == 0 && m == 1);
+}
+
+TEST(Scan, LengthModifiers) {
+  unsigned short us = 0;
+  unsigned char uc = 0;
+  long long ll = 0;
+  unsigned long long ull = 0;
+  void* p = nullptr;
+  ASSERT_EQ(scan<"%hx">("12345678", &us), 1);
+  ASSERT_EQ(us, 0x5678);
+  ASSERT_EQ(scan<"%hhx">("12345678", &uc), 1);
+  ASSERT_EQ(uc, 0x78);
+  ASSERT_EQ(scan<"%lld">("-9223372036854775807", &ll), 1);
+  ASSERT_EQ(ll, -9223372036854775807LL);
+  ASSERT_EQ(scan<"%llu">("18446744073709551615", &ull), 1);
+  ASSERT_EQ(ull, 18446744073709551615ULL);
+  ASSERT_EQ(scan<"%lld">("9223372036854775808", &ll), 1);
+  ASSERT_EQ(ll, LLONG_MAX);
+  ASSERT_EQ(scan<"%llu">("-1", &ull), 1);
+  ASSERT_EQ(ull, 18446744073709551615ULL);
+  ASSERT_EQ(scan<"%llu">("0000000000000000000000012345678901234567", &ull), 1);
+  ASSERT_EQ(ull, 12345678901234567ULL);
+  ASSERT_EQ(scan<"%p">(" 0x12345678", &p), 1);
+  ASSERT_EQ(p, reinterpret_cast<void*>(0x12345678));
+}
+
+TEST(Scan, Strings) {
+  char s[256] = {};
+  char c = 0;
+  int i = 0, j = 0, m = 0;
+  unsigned n = 0;
+  ASSERT_EQ(scan<"%5s">(" testtest", s), 1);
+  ASSERT_EQ(std::strcmp(s, "testt"), 0);
+  ASSERT_EQ(scan<"%c">(" 1234", &c), 1);
+  ASSERT_EQ(c, ' ');
+  ASSERT_EQ(scan<" %2c">(" 1234", s), 1);
+  ASSERT_EQ(std::memcmp(s, "12", 2), 0);
+  ASSERT_EQ(scan<" %2c%c%n">(" 1234", s, &c, &m), 2);
+  ASSERT_TRUE(std::memcmp(s, "12", 2) == 0 && c == '3' && m == 4);
+  ASSERT_EQ(scan<"%[-2-3]">("23-4", s), 1);
+  ASSERT_EQ(std::strcmp(s, "23-"), 0);
+  ASSERT_EQ(scan<"%[][]">("[]xx", s), 1);
+  ASSERT_EQ(std::strcmp(s, "[]"), 0);
+  ASSERT_EQ(scan<"%[^]]">("xyz]x", s), 1);
+  ASSERT_EQ(std::strcmp(s, "xyz"), 0);
+  ASSERT_EQ(scan<"%[^1-4]">("56781234", s), 1);
+  ASSERT_EQ(std::strcmp(s, "5678"), 0);
+  ASSERT_EQ(scan<"%i%s %u %c%d %*s%n">("12 test 45 c 67 xx", &i, s, &n, &c, &j, &m), 5);
+  ASSERT_TRUE(i == 12 && !std::strcmp(s, "test") && n == 45 && c == 'c' && j == 67 && m == 18);
+}
+
+TEST(Scan, Slices) {
+  std::string_view method, path, key, value, chars;
+  int minor = 0, m = 0;
+  const char* request = "GET /index.html HTTP/1.1";
+  ASSERT_EQ(scan<"%.*s %.*s HTTP/1.%d">(request, &method, &path, &minor), 3);
+  ASSERT_TRUE(method == "GET" && path == "/index.html" && minor == 1);
+  ASSERT_EQ(path.data(), request + 4);
+  ASSERT_EQ(scan<"%.*[^=]=%4.*[^;]%n">("key=value;", &key, &value, &m), 2);
+  ASSERT_TRUE(key == "key" && value == "valu" && m == 8);
+  ASSERT_EQ(scan<"%*.*s %3.*c">("ab cdef", &chars), 1);
+  ASSERT_TRUE(chars == "cde");
+  ASSERT_EQ(scan<"%3.*c">("ab", &chars), -1);
+}
+
+TEST(Scan, ReturnValues) {
+  unsigned m = 0xaa, n = 0xee;
+  ASSERT_EQ(scan<"%u">("", &n), -1);
+  ASSERT_EQ(scan<"%u">(" ", &n), -1);
+  ASSERT_EQ(scan<"%u%u">("12", &m, &n), 1);
+  ASSERT_EQ(scan<"ab%u">("a12", &n), 0);
+  ASSERT_EQ(scan<"%u,%n">("6543", &m, &n), 1);
+  ASSERT_EQ(n, 0xeeu);
+  ASSERT_EQ(scan<"%u %n">("12", &m, &n), 1);
+  ASSERT_EQ(n, 2u);
+  ASSERT_EQ(scan<" %*[^,], %d/%d">(" 100.2 AAA, 11/12\n", &m, &n), 2);
+  ASSERT_TRUE(m == 11 && n == 12);
+  ASSERT_EQ(scan<" %*s%*s %*d/%d">(" 100.2 XXX, 11/12\n", &m), 1);
+  ASSERT_EQ(m, 12u);
+  ASSERT_EQ(scan<"%[a">("aaa"), -1);
+}
+
+namespace {
+
+// scan.hpp parse_integer is a copy of sscanf.c parse_int, sscanf is the one of sscanf.c here.
+template <scan_detail::format F, class T>
+void same_as_sscanf(const std::string& input) {
+  T a = 0x5a, b = 0x5a;
+  int m = -1, n = -1;
+  int r1 = scan<F>(input.c_str(), &a, &m);
+  int r2 = std::sscanf(input.c_str(), F.s, &b, &n);
+  if (r1 != r2 || a != b || m != n)
+    testing::out() << "scan<\"" << F.s << "\">(\"" << input << "\")" << std::endl;
+  ASSERT_EQ(r1, r2);
+  ASSERT_EQ(a, b);
+  ASSERT_EQ(m, n);
+}
+
+}  // namespace
+
+TEST(Scan, IntegersAsSscanf) {
+  static const char* prefixes[] = {"", "", "-", "+", "0", "0x", "-0X", "00", " ", "x"};
+  unsigned seed = 1;
+  auto next = [&seed](unsigned n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+  };
+  for (int i = 0; i < 20000; i++) {
+    // Signs, prefixes, leading zeros, hex letters and runs long enough to overflow.
+    std::string input = prefixes[next(10)];
+    if (next(4) == 0) {
+      // Close to the limits of the types.
+      static const unsigned long long limits[] = {0x7f, 0xffff, 0x7fffffff, 0xffffffff, 0x7fffffffffffffff, ~0ULL};
+      char digits[32];
+      std::snprintf(digits, sizeof(digits), next(2) ? "%llu" : "%llx", limits[next(6)] + next(5) - 2);
+      input += digits;
+    }
+    for (unsigned len = next(next(4) ? 12 : 30); len; len--)
+      input.push_back("0123456789abcdefABCDEFxz-"[next(next(3) ? 10 : 25)]);
+    same_as_sscanf<"%d%n", int>(input);
+    same_as_sscanf<"%3d%n", int>(input);
+    same_as_sscanf<"%i%n", int>(input);
+    same_as_sscanf<"%4i%n", int>(input);
+    same_as_sscanf<"%u%n", unsigned>(input);
+    same_as_sscanf<"%x%n", unsigned>(input);
+    same_as_sscanf<"%2x%n", unsigned>(input);
+    same_as_sscanf<"%5X%n", unsigned>(input);
+    same_as_sscanf<"%o%n", unsigned>(input);
+    same_as_sscanf<"%hhd%n", signed char>(input);
+    same_as_sscanf<"%hu%n", unsigned short>(input);
+    same_as_sscanf<"%ld%n", long>(input);
+    same_as_sscanf<"%lld%n", long long>(input);
+    same_as_sscanf<"%20lld%n", long long>(input);
+    same_as_sscanf<"%lli%n", long long>(input);
+    same_as_sscanf<"%llu%n", unsigned long long>(input);
+    same_as_sscanf<"%llx%n", unsigned long long>(input);
+  }
+}
+
+#ifdef CONFIG_LIBC_FLOATINGPOINT
+TEST(Scan, Floats) {
+  float f = 0, fl = 0;
+  double d = 0;
+  int n = 0;
+  ASSERT_EQ(scan<"%le">("0.1234", &d), 1);
+  ASSERT_LT(d - 0.1234, 0.00000001);
+  ASSERT_EQ(scan<"%6f%f%n">("123.4567.89", &f, &fl, &n), 2);
+  ASSERT_LT(f - 123.45f, 0.001f);
+  ASSERT_LT(fl - 67.89f, 0.001f);
+  ASSERT_EQ(n, 11);
+  ASSERT_EQ(scan<"%E%lA">("-1.5E2 0.25", &f, &d), 2);
+  ASSERT_TRUE(f == -150 && d == 0.25);
+  ASSERT_EQ(scan<"%3lf%n">("1.25e3", &d, &n), 1);
+  ASSERT_EQ(d, 1.2);
+  ASSERT_EQ(n, 3);
+  ASSERT_EQ(scan<"%lf">("0x1.8p1", &d), 1);
+  ASSERT_EQ(d, 3.0);
+}
+#endif
@@ -1,6 +1,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdio.h>
+
+#include "instrument.h"
 
 //
 // Small but complying to standard 'sscanf' and 'vsscanf' implementation.
@@ -8,14 +11,6 @@
 
 //#define TESTS
 
-#ifdef WIN32
-#define strtoll _strtoi64
-#define strtoull _strtoui64
-#else
-	unsigned long long strtoull(char const *nptr, char **endptr, int base);
-	long long strtoll(char const *nptr, char **endptr, int base);
-#endif
-
 #ifndef __cplusplus
 
 typedef int bool; 
@@ -46,214 +41,1250 @@ int SSCANF(char const*buf, char const *fmt, ...)
   return r;
 }
 
-static void set_typed(va_list *ap, int dst_type, long long value) {
+//
+// Act as sscanf/vsscanf on buf[0..buf_len) as if it were followed by a zero, never reading past it.
+// The input doesn't need to be zero-terminated, for example a field of a mapped file or a network packet.
+// Besides the standard conversions, "%.*s", "%.*[...]" and "%N.*c" store the matched chars as a slice
+// of the input, taking an 'int *' for its length and a 'char const **' for its start, as printf takes them.
+// The chars are not copied, and slices don't need a width or a buffer. They work in sscanf and scanf_exec as well.
+// Sample:
+//    int method_len, path_len;
+//    char const *method, *path;
+//    if (snscanf(packet, size, "%.*s %.*s HTTP/1.%*d", &method_len, &method, &path_len, &path) == 2) ...
+//
+int snscanf(char const *buf, size_t buf_len, char const *fmt, ...);
+int vsnscanf(char const *buf, size_t buf_len, char const *fmt, va_list ap);
+
+//
+// sscanf and snscanf keep the last SCANF_CACHE_SIZE formats of each thread compiled as by scanf_compile,
+// unless SCANF_NO_CACHE is defined. Formats are found by pointer and contents, so reused buffers are safe.
+// Returns the numbers of calls of the calling thread which found their format in the cache, and which didn't.
+//
+void scanf_cache_stats(unsigned long long *hits, unsigned long long *misses);
+
+//
+// A format string parsed once into a list of operations with prebuilt '%[' character sets,
+// to be applied to many input strings without parsing the format again.
+// Sample:
+//    struct scanf_program *p = scanf_compile("%d:%d %[^\n]");
+//    while (fgets(line, sizeof(line), f))
+//      if (scanf_exec(p, line, &a, &b, text) == 3) ...
+//    free(p);
+//
+struct scanf_program;
+
+//
+// Parses the format. Returns NULL if out of memory. Release the result with free().
+//
+struct scanf_program *scanf_compile(char const *fmt);
+
+//
+// Act exactly as sscanf/vsscanf and snscanf/vsnscanf with the format given to scanf_compile.
+//
+int scanf_exec(struct scanf_program const *program, char const *buf, ...);
+int vscanf_exec(struct scanf_program const *program, char const *buf, va_list ap);
+int snscanf_exec(struct scanf_program const *program, char const *buf, size_t buf_len, ...);
+int vsnscanf_exec(struct scanf_program const *program, char const *buf, size_t buf_len, va_list ap);
+
+//
+// Acts as snscanf_exec taking the arguments from args, one pointer per assigned conversion, two for slices.
+// stopped - if not NULL, receives the input position of the directive that failed, or NULL if the whole format matched.
+//
+int scanf_exec_args(struct scanf_program const *program, char const *buf, size_t buf_len, void *const *args, char const **stopped);
+
+//
+// Returns the number of arguments the program takes.
+//
+int scanf_arg_count(struct scanf_program const *program);
+
+//
+// Returns the size of the object the i-th argument points to,
+// or 0 for %s and %[ without a width, which may store any number of chars.
+// A slice takes an int and a char const* argument.
+//
+size_t scanf_arg_size(struct scanf_program const *program, int i);
+
+//
+// Scanning from a stream of any size read in blocks, for example a file descriptor, FILE* or a mapped file.
+// Conversions may span block boundaries, only the not yet scanned part of the current block is kept in memory,
+// plus the longest single conversion (for example %s), if it doesn't fit in a block.
+// Each stream_scanf call continues where the previous one stopped, and
+// acts as fscanf: white space skipped before a failed conversion is consumed.
+// A zero byte in the input stops the conversion as the end of string does in sscanf.
+// Slices are not supported, as the stream buffer moves, and stop the scanning as a failed conversion.
+// Sample:
+//    struct scanf_stream *s = scanf_open_fd(fd);
+//    while (stream_scanf(s, "%d,%d\n", &a, &b) == 2) ...
+//    scanf_close(s);
+//
+struct scanf_stream;
+
+//
+// Opens a stream reading through read(context, dst, size), which returns the number of bytes
+// placed to dst (up to size) or 0 at the end of input or on error.
+// Returns NULL if out of memory. Release with scanf_close, it doesn't close the underlying source.
+//
+struct scanf_stream *scanf_open(size_t (*read)(void *context, char *dst, size_t size), void *context);
+struct scanf_stream *scanf_open_fd(int fd);
+struct scanf_stream *scanf_open_file(FILE *file);
+struct scanf_stream *scanf_open_memory(char const *data, size_t size);
+void scanf_close(struct scanf_stream *stream);
+
+//
+// Act as sscanf/vsscanf and scanf_exec/vscanf_exec on the stream.
+// Return EOF at the end of input, %n counts chars consumed by this call.
+//
+int stream_scanf(struct scanf_stream *stream, char const *fmt, ...);
+int vstream_scanf(struct scanf_stream *stream, char const *fmt, va_list ap);
+int stream_scanf_exec(struct scanf_stream *stream, struct scanf_program const *program, ...);
+int vstream_scanf_exec(struct scanf_stream *stream, struct scanf_program const *program, va_list ap);
+
+enum scanf_op_kind {
+	OP_STOP,     // end of format
+	OP_SPACE,    // whitespace in format
+	OP_LITERAL,  // an ordinary character in format
+	OP_PERCENT,  // %%
+	OP_COUNT,    // %n
+	OP_INT,      // %d %i %o %u %x %X %p
+	OP_FLOAT,    // %f %e %g %a and their upper case
+	OP_CHARS,    // %c
+	OP_STRING,   // %s
+	OP_SET,      // %[
+	OP_NONE      // unknown conversion, ignored
+};
+
+struct scanf_op {
+	unsigned char kind;
+	char dst_type;  // 'c' - char, 'h' - short, 'i' - int, 'l' - long, 'L' - long long
+	char c;         // literal character or conversion character
+	bool skip_assign;
+	bool slice;     // %.*s, %.*[ or %.*c storing the length and the start of the matched chars
+	unsigned short set;  // index of '%[' character set
+	long width;
+};
+
+// Aligned block reads may touch bytes past the terminating zero (never past a page),
+// which AddressSanitizer reports, so sanitized builds use the scalar code.
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(__SANITIZE_ADDRESS__)
+#include <emmintrin.h>
+#define SCANF_SSE2
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <tmmintrin.h>
+#define SCANF_SIMD_SET
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+static int lowest_bit(unsigned int mask) { unsigned long r; _BitScanForward(&r, mask); return (int) r; }
+#else
+#define lowest_bit(mask) __builtin_ctz(mask)
+#endif
+#endif
+
+struct scanf_set {
+	unsigned int mask[256/32];
+#ifdef SCANF_SIMD_SET
+	// Bit j of rows[h][l] - the set has (h * 8 + j) << 4 | l, for the nibble lookup.
+	unsigned char rows[2][16];
+	bool rows_ready;  // built by scanf_compile, or on demand for long spans
+#endif
+};
+
+struct scanf_program {
+	int op_count;
+	struct scanf_set *sets;
+	struct scanf_op ops[1];
+};
+
+struct scanf_state {
+	char *buf;
+	char const *buf_start;
+	long long skipped;  // input consumed before buf_start and dropped by the stream
+	char const *end;    // the end of the input, or NULL if it ends with a zero
+	int count;
+	bool first_match;
+};
+
+static void set_typed(void *dst, int dst_type, long long value) {
 	switch (dst_type) {
-	case 'i': *va_arg(*ap, int*) = (int) value; break;
-	case 'c': *va_arg(*ap, char*) = (char) value; break;
-	case 'h': *va_arg(*ap, short int*) = (short int) value; break;
-	case 'l': *va_arg(*ap, long int*) = (long int) value; break;
-	case 'L': *va_arg(*ap, long long*) = value; break;
+	case 'i': *(int*) dst = (int) value; break;
+	case 'c': *(char*) dst = (char) value; break;
+	case 'h': *(short int*) dst = (short int) value; break;
+	case 'l': *(long int*) dst = (long int) value; break;
+	case 'L': *(long long*) dst = value; break;
+	}
+}
+
+#define SET_BIT(mask, i) mask[(i) >> 5] |= 1u << (i & 0x1f)
+#define IS_SET(mask, i) mask[(i) >> 5] & (1u << (i & 0x1f))
+
+//
+// Spans return the length of the prefix of s, up to max chars, made of chars of some class:
+// white space for skip_ws, a %s token, or a %[ set.
+// The zero terminator is never in a class. Chars are signed as the scalar loops compare them,
+// so 0x80..0xff are white space and stop %s tokens.
+// SIMD versions read aligned blocks, which never cross a page boundary past the terminator.
+// If the input is bounded, they only load blocks within the max chars and finish with the scalar loops.
+//
+static long span_ws_scalar(char const *s, long max) {
+	long n = 0;
+	while (n < max && s[n] && s[n] <= ' ')
+		n++;
+	return n;
+}
+
+static long span_token_scalar(char const *s, long max) {
+	long n = 0;
+	while (n < max && s[n] > ' ')
+		n++;
+	return n;
+}
+
+static long span_set_scalar(char const *s, long max, struct scanf_set const *set) {
+	long n = 0;
+	while (n < max && s[n] && IS_SET(set->mask, (unsigned char) s[n]))
+		n++;
+	return n;
+}
+
+#ifdef SCANF_SSE2
+
+static long span_ws(char const *s, long max, bool bounded) {
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i *block = (const __m128i *) ((size_t) s & ~(size_t) 15);
+	long n = bounded ? 0 : (long) ((char const *) block - s);
+	unsigned int skip_mask = bounded ? ~0u : ~0u << ((size_t) s & 15);
+	if (max <= 0)
+		return 0;
+	for (;; n += 16, skip_mask = ~0u) {
+		__m128i v;
+		unsigned int stops;
+		if (!bounded)
+			v = _mm_load_si128(block++);
+		else if (n + 16 <= max)
+			v = _mm_loadu_si128((const __m128i *) (s + n));
+		else
+			return n + span_ws_scalar(s + n, max - n);
+		stops = _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+			_mm_cmpgt_epi8(v, space))) & skip_mask;
+		if (stops) {
+			n += lowest_bit(stops);
+			return n < max ? n : max;
+		}
+		if (n + 16 >= max)
+			return max;
+	}
+}
+
+static long span_token(char const *s, long max, bool bounded) {
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i *block = (const __m128i *) ((size_t) s & ~(size_t) 15);
+	long n = bounded ? 0 : (long) ((char const *) block - s);
+	unsigned int skip_mask = bounded ? ~0u : ~0u << ((size_t) s & 15);
+	if (max <= 0)
+		return 0;
+	for (;; n += 16, skip_mask = ~0u) {
+		__m128i v;
+		unsigned int stops;
+		if (!bounded)
+			v = _mm_load_si128(block++);
+		else if (n + 16 <= max)
+			v = _mm_loadu_si128((const __m128i *) (s + n));
+		else
+			return n + span_token_scalar(s + n, max - n);
+		stops = ~_mm_movemask_epi8(_mm_cmpgt_epi8(v, space)) & 0xFFFF & skip_mask;
+		if (stops) {
+			n += lowest_bit(stops);
+			return n < max ? n : max;
+		}
+		if (n + 16 >= max)
+			return max;
+	}
+}
+
+#else
+
+static long span_ws(char const *s, long max, bool bounded) {
+	return span_ws_scalar(s, max);
+}
+
+static long span_token(char const *s, long max, bool bounded) {
+	return span_token_scalar(s, max);
+}
+
+#endif
+
+#if defined(SCANF_SIMD_SET) && defined(__AVX2__)
+
+//
+// Set membership by nibbles: the low nibble selects a byte of rows, which has a bit per high nibble.
+// Shuffles give 0 for indices with the top bit set, so rows[0] only answers for 0..0x7f, and rows[1] for the rest.
+//
+static long span_set_rows(char const *s, long max, struct scanf_set const *set, bool bounded) {
+	const __m256i rows_low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) set->rows[0]));
+	const __m256i rows_high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) set->rows[1]));
+	const __m256i bits = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128));
+	const __m256i top = _mm256_set1_epi8((char) 0x80);
+	const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+	const __m256i *block = (const __m256i *) ((size_t) s & ~(size_t) 31);
+	long n = bounded ? 0 : (long) ((char const *) block - s);
+	unsigned int skip_mask = bounded ? ~0u : ~0u << ((size_t) s & 31);
+	if (max <= 0)
+		return 0;
+	for (;; n += 32, skip_mask = ~0u) {
+		__m256i v, row, bit;
+		unsigned int member, zero, stops;
+		if (!bounded)
+			v = _mm256_load_si256(block++);
+		else if (n + 32 <= max)
+			v = _mm256_loadu_si256((const __m256i *) (s + n));
+		else
+			return n + span_set_scalar(s + n, max - n, set);
+		row = _mm256_or_si256(_mm256_shuffle_epi8(rows_low, v), _mm256_shuffle_epi8(rows_high, _mm256_xor_si256(v, top)));
+		bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+		member = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit));
+		zero = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+		stops = (~member | zero) & skip_mask;
+		if (stops) {
+			n += lowest_bit(stops);
+			return n < max ? n : max;
+		}
+		if (n + 32 >= max)
+			return max;
+	}
+}
+
+#elif defined(SCANF_SIMD_SET)
+
+//
+// Set membership by nibbles: the low nibble selects a byte of rows, which has a bit per high nibble.
+// Shuffles give 0 for indices with the top bit set, so rows[0] only answers for 0..0x7f, and rows[1] for the rest.
+//
+static long span_set_rows(char const *s, long max, struct scanf_set const *set, bool bounded) {
+	const __m128i rows_low = _mm_loadu_si128((const __m128i *) set->rows[0]);
+	const __m128i rows_high = _mm_loadu_si128((const __m128i *) set->rows[1]);
+	const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	const __m128i top = _mm_set1_epi8((char) 0x80);
+	const __m128i low_nibble = _mm_set1_epi8(0x0F);
+	const __m128i *block = (const __m128i *) ((size_t) s & ~(size_t) 15);
+	long n = bounded ? 0 : (long) ((char const *) block - s);
+	unsigned int skip_mask = bounded ? ~0u : ~0u << ((size_t) s & 15);
+	if (max <= 0)
+		return 0;
+	for (;; n += 16, skip_mask = ~0u) {
+		__m128i v, row, bit;
+		unsigned int member, zero, stops;
+		if (!bounded)
+			v = _mm_load_si128(block++);
+		else if (n + 16 <= max)
+			v = _mm_loadu_si128((const __m128i *) (s + n));
+		else
+			return n + span_set_scalar(s + n, max - n, set);
+		row = _mm_or_si128(_mm_shuffle_epi8(rows_low, v), _mm_shuffle_epi8(rows_high, _mm_xor_si128(v, top)));
+		bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+		member = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, bit), bit));
+		zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		stops = (~member | zero) & 0xFFFF & skip_mask;
+		if (stops) {
+			n += lowest_bit(stops);
+			return n < max ? n : max;
+		}
+		if (n + 16 >= max)
+			return max;
 	}
 }
 
-static void skip_ws(char **buf) {
+#endif
+
+#ifdef SCANF_SIMD_SET
+
+static void build_rows(struct scanf_set *set) {
+	int low, word;
+	for (low = 0; low < 16; low++) {
+		unsigned int rows = 0;
+		// A mask word has chars of two high nibbles: 2 * word and 2 * word + 1.
+		for (word = 0; word < 256/32; word++) {
+			unsigned int m = set->mask[word] >> low;
+			rows |= ((m & 1) | (m >> 16 & 1) << 1) << word * 2;
+		}
+		set->rows[0][low] = (unsigned char) rows;
+		set->rows[1][low] = (unsigned char) (rows >> 8);
+	}
+	set->rows_ready = true;
+}
+
+#endif
+
+static long span_set(char const *s, long max, struct scanf_set const *set, bool bounded) {
+#ifdef SCANF_SIMD_SET
+	struct scanf_set built;
+	long n = 0;
+	if (!set->rows_ready) {
+		// Building the lookup costs as much as checking a few dozen chars, do it for long spans only.
+		for (; n < 64; n++) {
+			if (n >= max || !s[n] || !(IS_SET(set->mask, (unsigned char) s[n])))
+				return n;
+		}
+		built = *set;
+		build_rows(&built);
+		set = &built;
+	}
+	return n + span_set_rows(s + n, max - n, set, bounded);
+#else
+	return span_set_scalar(s, max, set);
+#endif
+}
+
+// Returns the number of chars before the end of the input (NULL - no limit), up to 0x7fffffff.
+static long chars_left(char const *s, char const *end) {
+	return end && end - s < 0x7fffffff ? (long) (end - s) : 0x7fffffff;
+}
+
+static void skip_ws(char **buf, char const *end) {
 	char *s = *buf;
-	while (*s && *s <= ' ')
+	// Most runs are a single char, only longer ones are worth a vector.
+	if (s != end && s + 1 != end && *s && *s <= ' ' && s[1] && s[1] <= ' ')
+		s += 2 + span_ws(s + 2, chars_left(s + 2, end), end != NULL);
+	while (s != end && *s && *s <= ' ')
 		s++;
 	*buf = s;
 }
 
-#define SET_BIT(mask, i) mask[(i) >> 5] |= 1 << (i & 0x1f)
-#define IS_SET(mask, i) mask[(i) >> 5] & (1 << (i & 0x1f))
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM64)
+#define SCANF_SWAR
+#endif
+
+static int digit_value(char c) {
+	return
+		c >= '0' && c <= '9' ? c - '0' :
+		c >= 'a' && c <= 'z' ? c - 'a' + 10 :
+		c >= 'A' && c <= 'Z' ? c - 'A' + 10 : 99;
+}
+
+#ifdef SCANF_SWAR
+//
+// Converts 8 decimal digits at once, multiplying adjacent digits, pairs and quads in parallel.
+//
+static unsigned long long parse_8_digits(char const *s) {
+	unsigned long long v;
+	memcpy(&v, s, 8);
+	v -= 0x3030303030303030ULL;
+	v = v * 10 + (v >> 8);
+	return (
+		(v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)) +
+		((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))) >> 32;
+}
+#endif
 
-int VSSCANF(char const *buf_start, char const *fmt_, va_list ap)
-{
-	char *buf = (char *) buf_start;
-	char *fmt = (char *) fmt_; 
-	int count = -1;
-	bool first_match = true;
-	while (*fmt) {
-		if (*fmt == '%') {
-			bool skip_assign = *++fmt == '*';
-			long width;
-			char dst_type;
-			if (skip_assign)
-				fmt++;
-			width = strtol(fmt, &fmt, 10);
-			dst_type =
-				*fmt == 'L' ? ++fmt, 'L' :
-				*fmt == 'h' ?
-					(*++fmt == 'h' ? ++fmt, 'c' : 'h') : 
-				*fmt == 'l' ? 
-					(*++fmt == 'l' ? ++fmt, 'L' : 'l') :
-				'i';
-			switch (*fmt) {
-			case 0: return count;
-			case '%':
-				skip_ws(&buf);
-				if (*buf++ != '%')
-					return count;
-				break;
-			case 'n':
-				skip_ws(&buf);
-				if (!skip_assign)
-					set_typed(&ap, dst_type, buf - buf_start);
-				break;
-			case 'i':
-			case 'd':
-			case 'o':
-			case 'x':
-			case 'X':
-			case 'p':
-			case 'u':
-				skip_ws(&buf);
-				{
-					int radix =
-						*fmt == 'd' || *fmt == 'u' ? 10 :
-						*fmt == 'o' ? 8 :
-						*fmt == 'X' || *fmt == 'x' || *fmt == 'p' ? 16 : 0;
-					char* end;
-					char temp[65];
-					const char* src = width >= 1 && width <=64 ?
-						strncpy(temp, buf, width), temp[width]=0, temp :
-						buf;
-					long long v = *fmt == 'd' || *fmt == 'i' ? strtoll(src, &end, radix) : (long long)strtoull(src, &end, radix);
-					end = buf + (end - src);
-					if (end == buf)
-						return count;
-					buf = end;
-					if (!skip_assign) {
-						count++;
-						set_typed(&ap, dst_type, v);
-					}
-				}
-				break;
-			case 'f':
-			case 'e':
-			case 'g':
-			case 'G':
-			case 'a':
 #ifdef CONFIG_LIBC_FLOATINGPOINT
-				skip_ws(&buf);
-				{
-					char* end;
-					char temp[65];
-					char* src = width >= 1 && width <=64 ? strncpy(temp, buf, width), temp : buf;
-					double v = strtod(src, &end);
-					end = buf + (end - src);
-					if (end == buf)
-						return count;
-					buf = end;
-					if (!skip_assign) {
-						count++;
-						if (dst_type == 'l') *va_arg(ap, double*) = v;
-						else                 *va_arg(ap, float*) = (float) v;
-					}
-				}
-				break;
-#else
-				return count;
-#endif
-			case 'c':
-				if (width < 2) {
-					if (!*buf)
-						return count;
-					if (skip_assign)
-						buf++;
-					else {
-						*va_arg(ap, char*) = *buf++;
-						count++;
-					}						
-				} else {
-					int len = strlen(buf);
-					if (len < width)
-						return count;
-					if (!skip_assign) {
-						memcpy(va_arg(ap, char*), buf, width);
-						count++;
-					}
-					buf += len;
-				}
+double strtodn(const char *s, long max_len, char **end);
+#endif
+
+//
+// Parses an integer as strtoll (is_signed) or strtoull do in "C" locale, including overflow results,
+// but reads at most width characters directly from s (width < 1 - no limit).
+// Radix 0 detects octal and hex prefixes.
+// Returns the position after the number, or s if there is no number.
+//
+static char *parse_int(char *s, long width, int radix, bool is_signed, long long *out) {
+	char *p = s;
+	long left = width >= 1 ? width : 0x7fffffff;
+	unsigned long long r = 0;
+	bool negative = false, overflow = false, any_digit = false;
+	if (left >= 1 && (*p == '-' || *p == '+'))
+		negative = *p++ == '-', left--;
+	if ((radix == 0 || radix == 16) && left >= 3 &&
+		*p == '0' && (p[1] == 'x' || p[1] == 'X') && digit_value(p[2]) < 16)
+	{
+		p += 2, left -= 2;
+		radix = 16;
+	} else if (radix == 0)
+		radix = left >= 1 && *p == '0' ? 8 : 10;
+	for (; left >= 1 && *p == '0'; p++, left--)
+		any_digit = true;
+	if (radix == 10) {
+		long n = 0, i = 0;
+		while (n < left && p[n] >= '0' && p[n] <= '9')
+			n++;
+		if (n > 20)
+			overflow = true;
+		else {
+#ifdef SCANF_SWAR
+			for (; n - i >= 8; i += 8)
+				r = r * 100000000 + parse_8_digits(p + i);
+#endif
+			for (; i < n && i < 19; i++)
+				r = r * 10 + (p[i] - '0');
+			if (i < n) {
+				if (r > (~0ULL - (p[i] - '0')) / 10)
+					overflow = true;
+				r = r * 10 + (p[i] - '0');
+			}
+		}
+		p += n;
+		any_digit |= n != 0;
+	} else {
+		for (; left >= 1; p++, left--) {
+			unsigned int d = digit_value(*p);
+			if (d >= (unsigned int) radix)
 				break;
-			case 's':
-				skip_ws(&buf);
-				{
-					if (width == 0)
-						width = 0x7fffffff;
-					if (skip_assign) {
-						while(*buf > ' ' && width-- > 0)
-							buf++;
-					} else {
-						char *dst = va_arg(ap, char*);
-						while(*buf > ' ' && width-- > 0)
-							*dst++ = *buf++;
-						*dst = 0;
-						count++;
+			if (r > (~0ULL - d) / radix)
+				overflow = true;
+			r = r * radix + d;
+			any_digit = true;
+		}
+	}
+	if (!any_digit)
+		return s;
+	if (is_signed) {
+		if (overflow || r > (negative ? 0x8000000000000000ULL : 0x7fffffffffffffffULL))
+			*out = negative ? (long long) 0x8000000000000000ULL : 0x7fffffffffffffffLL;
+		else
+			*out = negative ? (long long) (0 - r) : (long long) r;
+	} else
+		*out = overflow ? (long long) ~0ULL : (long long) (negative ? 0 - r : r);
+	return p;
+}
+
+//
+// Parses one directive of the format into op, '%[' set goes to mask.
+// Returns the position of the next directive.
+//
+static char *parse_op(char *fmt, struct scanf_op *op, struct scanf_set *set) {
+	unsigned int *mask = set->mask;
+	op->c = *fmt;
+	op->set = 0;
+	// Literals and white space read these too, through takes_arg and stream_op.
+	op->skip_assign = false;
+	op->width = 0;
+	op->slice = false;
+	op->dst_type = 'i';
+	if (*fmt == '%') {
+		op->skip_assign = *++fmt == '*';
+		if (op->skip_assign)
+			fmt++;
+		op->width = strtol(fmt, &fmt, 10);
+		op->slice = fmt[0] == '.' && fmt[1] == '*';
+		if (op->slice)
+			fmt += 2;
+		op->dst_type =
+			*fmt == 'L' ? ++fmt, 'L' :
+			*fmt == 'h' ?
+				(*++fmt == 'h' ? ++fmt, 'c' : 'h') : 
+			*fmt == 'l' ? 
+				(*++fmt == 'l' ? ++fmt, 'L' : 'l') :
+			'i';
+		op->c = *fmt;
+		switch (*fmt) {
+		case 0: op->kind = OP_STOP; return fmt;
+		case '%': op->kind = OP_PERCENT; break;
+		case 'n': op->kind = OP_COUNT; break;
+		case 'i':
+		case 'd':
+		case 'o':
+		case 'x':
+		case 'X':
+		case 'p':
+		case 'u':
+			op->kind = OP_INT;
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			op->kind = OP_FLOAT;
+			break;
+		case 'c': op->kind = OP_CHARS; break;
+		case 's': op->kind = OP_STRING; break;
+		case '[':
+			{
+				bool negate = *++fmt == '^';
+				op->kind = OP_STOP;
+				memset(mask, 0, sizeof(unsigned int) * 256/32);
+				if (negate) fmt++;
+				if (*fmt == ']') fmt++, SET_BIT(mask, ']');
+				while (*fmt && *fmt != ']') {
+					int f = (unsigned char) *fmt++;
+					SET_BIT(mask, f);
+					if (*fmt != '-')
+						continue;
+					if (!*++fmt)
+						return fmt;
+					if (*fmt == ']') {
+						SET_BIT(mask, '-');
+						break;
 					}
-				}
-				break;
-			case '[':
-				{
-					bool negate = *++fmt == '^';
-					unsigned int mask[256/32];
-					memset(mask, 0, sizeof(mask));
-					if (negate) fmt++;
-					if (*fmt == ']') fmt++, SET_BIT(mask, ']');
-					while (*fmt && *fmt != ']') {
-						char f = *fmt++;
-						SET_BIT(mask, f);
-						if (*fmt != '-')
-							continue;
-						if (!*++fmt)
-							return count;
-						if (*fmt == ']') {
-							SET_BIT(mask, '-');
-							break;
-						}
-						{
-							char t = *fmt++;
+					{
+						int t = (unsigned char) *fmt++;
+						if (f < 0xff) {
 							do
 								++f, SET_BIT(mask, f);
 							while (f < t);
 						}
 					}
-					if (!*fmt)
-						return count;
-					if (negate) {
-						int i = 0;
-						for (; i < 256/32; i++)
-							mask[i] = ~mask[i];
-					}
-					if (width == 0)
-						width = 0x7fffffff;
-					if (skip_assign) {
-						while(*buf && IS_SET(mask, *buf) && width-- > 0)
-							buf++;
-					} else {
-						char *dst = va_arg(ap, char*);
-						while(*buf && IS_SET(mask, *buf) && width-- > 0)
-							*dst++ = *buf++;
-						*dst = 0;
-						count++;
-					}
 				}
-				break;
+				if (!*fmt)
+					return fmt;
+				if (negate) {
+					int i = 0;
+					for (; i < 256/32; i++)
+						mask[i] = ~mask[i];
+				}
+#ifdef SCANF_SIMD_SET
+				set->rows_ready = false;
+#endif
+				op->kind = OP_SET;
 			}
-			fmt++;
-		} else if (*fmt <= ' ') {
-			while (*fmt && *fmt <= ' ')
-				fmt++;
-			skip_ws(&buf);
-		} else if (*buf++ != *fmt++)
 			break;
-		if (first_match) first_match = false, ++count;
+		default: op->kind = OP_NONE; break;
+		}
+		if (op->slice && op->kind != OP_CHARS && op->kind != OP_STRING && op->kind != OP_SET)
+			op->kind = OP_NONE;
+		return fmt + 1;
+	} else if (*fmt <= ' ') {
+		while (*fmt && *fmt <= ' ')
+			fmt++;
+		op->kind = OP_SPACE;
+		return fmt;
 	}
-	return count;
-};
+	op->kind = OP_LITERAL;
+	return fmt + 1;
+}
+
+static bool takes_arg(struct scanf_op const *op) {
+	return !op->skip_assign && op->kind >= OP_COUNT && op->kind <= OP_SET;
+}
+
+static int arg_count(struct scanf_op const *op) {
+	return takes_arg(op) ? 1 + op->slice : 0;
+}
+
+// Takes arg_count(op) arguments of the op from ap to args.
+#define GET_ARGS(op, ap, args) ( \
+	(args)[0] = takes_arg(op) ? va_arg(ap, void*) : NULL, \
+	(args)[1] = takes_arg(op) && (op)->slice ? va_arg(ap, void*) : NULL)
+
+//
+// Applies one parsed directive to the input.
+// args - arg_count(op) arguments for the conversion.
+// Returns false if scanning stops.
+//
+static bool exec_op(struct scanf_op const *op, struct scanf_set const *set, struct scanf_state *st, void *const *args) {
+	char *buf = st->buf;
+	char const *end = st->end;
+	void *dst = takes_arg(op) ? args[0] : NULL;
+	long width = op->width;
+	switch (op->kind) {
+	case OP_STOP: return false;
+	case OP_SPACE:
+		skip_ws(&buf, end);
+		break;
+	case OP_LITERAL:
+		if (buf == end || *buf++ != op->c)
+			return false;
+		break;
+	case OP_PERCENT:
+		skip_ws(&buf, end);
+		if (buf == end || *buf++ != '%')
+			return false;
+		break;
+	case OP_COUNT:
+		skip_ws(&buf, end);
+		if (!op->skip_assign)
+			set_typed(dst, op->dst_type, buf - st->buf_start + st->skipped);
+		break;
+	case OP_INT:
+		skip_ws(&buf, end);
+		{
+			int radix =
+				op->c == 'd' || op->c == 'u' ? 10 :
+				op->c == 'o' ? 8 :
+				op->c == 'X' || op->c == 'x' || op->c == 'p' ? 16 : 0;
+			long left = chars_left(buf, end);
+			long long v;
+			char *stop;
+			if (!left)
+				return false;
+			stop = parse_int(buf, width >= 1 && width < left ? width : left, radix, op->c == 'd' || op->c == 'i', &v);
+			if (stop == buf)
+				return false;
+			buf = stop;
+			if (!op->skip_assign) {
+				st->count++;
+				if (op->c == 'p')
+					*(void**) dst = (void*) (size_t) v;
+				else
+					set_typed(dst, op->dst_type, v);
+			}
+		}
+		break;
+	case OP_FLOAT:
+#ifdef CONFIG_LIBC_FLOATINGPOINT
+		skip_ws(&buf, end);
+		{
+			long left = chars_left(buf, end);
+			char* stop;
+			double v;
+			if (!left)
+				return false;
+			v = strtodn(buf, width >= 1 && width < left ? width : left, &stop);
+			if (stop == buf)
+				return false;
+			buf = stop;
+			if (!op->skip_assign) {
+				st->count++;
+				if (op->dst_type == 'l') *(double*) dst = v;
+				else                     *(float*) dst = (float) v;
+			}
+		}
+		break;
+#else
+		return false;
+#endif
+	case OP_CHARS:
+	case OP_STRING:
+	case OP_SET:
+		if (op->kind == OP_STRING)
+			skip_ws(&buf, end);
+		{
+			long left = chars_left(buf, end);
+			long n;
+			if (op->kind == OP_CHARS) {
+				// A single char by default, and all width chars or nothing.
+				long count = width < 2 ? 1 : width;
+				for (n = 0; n < count && n < left && buf[n]; n++) {}
+				if (n < count)
+					return false;
+			} else {
+				long max = width == 0 || width > left ? left : width;
+				n = op->kind == OP_STRING ? span_token(buf, max, end != NULL) : span_set(buf, max, set, end != NULL);
+			}
+			if (!op->skip_assign) {
+				if (op->slice) {
+					*(int*) dst = (int) n;
+					*(char const**) args[1] = buf;
+				} else {
+					memcpy(dst, buf, n);
+					if (op->kind != OP_CHARS)
+						((char*) dst)[n] = 0;
+				}
+				st->count++;
+			}
+			buf += n;
+		}
+		break;
+	}
+	st->buf = buf;
+	if (st->first_match)
+		st->first_match = false, ++st->count;
+	return true;
+}
 
 #undef IS_SET
 #undef SET_BIT
 
+static void init_state(struct scanf_state *st, char const *buf, char const *end) {
+	st->buf = (char *) buf;
+	st->buf_start = buf;
+	st->skipped = 0;
+	st->end = end;
+	st->count = -1;
+	st->first_match = true;
+}
+
+static int scan_format(struct scanf_state *st, char const *fmt_, va_list ap) {
+	char *fmt = (char *) fmt_;
+	while (*fmt) {
+		struct scanf_op op;
+		struct scanf_set set;
+		void *args[2];
+		fmt = parse_op(fmt, &op, &set);
+		GET_ARGS(&op, ap, args);
+		if (!exec_op(&op, &set, st, args))
+			break;
+	}
+	return st->count;
+}
+
+// Counts the ops and '%[' sets of the format.
+static void measure_format(char const *fmt_, int *op_count, int *set_count) {
+	char *fmt = (char *) fmt_;
+	struct scanf_op op;
+	struct scanf_set set;
+	*op_count = *set_count = 0;
+	while (*fmt) {
+		fmt = parse_op(fmt, &op, &set);
+		++*op_count;
+		if (op.kind == OP_SET)
+			++*set_count;
+		if (op.kind == OP_STOP)
+			break;
+	}
+}
+
+// Parses the format into r having room for its op_count ops followed by its sets.
+static void compile_format(char const *fmt_, struct scanf_program *r, int op_count) {
+	char *fmt = (char *) fmt_;
+	int i, set_count = 0;
+	r->op_count = op_count;
+	r->sets = (struct scanf_set *) (r->ops + op_count);
+	for (i = 0; i < op_count; i++) {
+		fmt = parse_op(fmt, &r->ops[i], &r->sets[set_count]);
+		if (r->ops[i].kind == OP_SET) {
+#ifdef SCANF_SIMD_SET
+			build_rows(&r->sets[set_count]);
+#endif
+			r->ops[i].set = (unsigned short) set_count++;
+		}
+	}
+}
+
+struct scanf_program *scanf_compile(char const *fmt) {
+	int op_count, set_count;
+	struct scanf_program *r;
+	measure_format(fmt, &op_count, &set_count);
+	INSTRUMENT_ALLOCATION(INSTRUMENT_SSCANF);
+	r = (struct scanf_program *) malloc(
+		sizeof(struct scanf_program) + sizeof(struct scanf_op) * op_count + sizeof(struct scanf_set) * set_count);
+	if (r)
+		compile_format(fmt, r, op_count);
+	return r;
+}
+
+static int scan_program(struct scanf_state *st, struct scanf_program const *program, va_list ap) {
+	struct scanf_op const *op = program->ops;
+	struct scanf_op const *end = op + program->op_count;
+	for (; op != end; op++) {
+		void *args[2];
+		GET_ARGS(op, ap, args);
+		if (!exec_op(op, &program->sets[op->set], st, args))
+			break;
+	}
+	return st->count;
+}
+
+#ifndef SCANF_NO_CACHE
+
+#ifndef SCANF_CACHE_SIZE
+#define SCANF_CACHE_SIZE 8  // formats per thread
+#endif
+
+// Longer formats and ones with more ops or '%[' sets are parsed on each call.
+#define SCANF_CACHE_FORMAT 64
+#define SCANF_CACHE_OPS 24
+#define SCANF_CACHE_SETS 4
+
+#if defined(__cplusplus)
+#define SCANF_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define SCANF_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define SCANF_THREAD_LOCAL __thread
+#else
+#define SCANF_THREAD_LOCAL _Thread_local
+#endif
+
+struct scanf_cache_entry {
+	char const *fmt;                // NULL for an empty entry
+	char text[SCANF_CACHE_FORMAT];  // the format at the time it was compiled, as buffers get reused
+	union {
+		struct scanf_program program;
+		char room[sizeof(struct scanf_program) +
+			sizeof(struct scanf_op) * SCANF_CACHE_OPS + sizeof(struct scanf_set) * SCANF_CACHE_SETS];
+	} u;
+};
+
+static SCANF_THREAD_LOCAL struct scanf_cache_entry scanf_cache[SCANF_CACHE_SIZE];
+static SCANF_THREAD_LOCAL int scanf_cache_next;  // the entry to replace
+static SCANF_THREAD_LOCAL unsigned long long scanf_cache_hits, scanf_cache_misses;
+
+//
+// Returns the compiled format from the cache of the calling thread, compiling it there on a miss,
+// or NULL if the format is too big for the cache.
+//
+static struct scanf_program const *cached_program(char const *fmt) {
+	struct scanf_cache_entry *e = scanf_cache;
+	int len, op_count, set_count;
+	for (; e != scanf_cache + SCANF_CACHE_SIZE; e++) {
+		if (e->fmt == fmt && strcmp(e->text, fmt) == 0) {
+			scanf_cache_hits++;
+			return &e->u.program;
+		}
+	}
+	scanf_cache_misses++;
+	for (len = 0; fmt[len]; len++) {
+		if (len == SCANF_CACHE_FORMAT - 1)
+			return NULL;
+	}
+	measure_format(fmt, &op_count, &set_count);
+	if (op_count > SCANF_CACHE_OPS || set_count > SCANF_CACHE_SETS)
+		return NULL;
+	e = &scanf_cache[scanf_cache_next];
+	scanf_cache_next = (scanf_cache_next + 1) % SCANF_CACHE_SIZE;
+	e->fmt = fmt;
+	memcpy(e->text, fmt, len + 1);
+	compile_format(fmt, &e->u.program, op_count);
+	return &e->u.program;
+}
+
+void scanf_cache_stats(unsigned long long *hits, unsigned long long *misses) {
+	*hits = scanf_cache_hits;
+	*misses = scanf_cache_misses;
+}
+
+#undef SCANF_THREAD_LOCAL
+
+#else
+
+void scanf_cache_stats(unsigned long long *hits, unsigned long long *misses) {
+	*hits = *misses = 0;
+}
+
+#endif
+
+// Runs the format from the cache, or parses it on the fly.
+static int scan_cached(struct scanf_state *st, char const *fmt, va_list ap) {
+#ifndef SCANF_NO_CACHE
+	struct scanf_program const *program = cached_program(fmt);
+	if (program)
+		return scan_program(st, program, ap);
+#endif
+	return scan_format(st, fmt, ap);
+}
+
+int VSSCANF(char const *buf, char const *fmt, va_list ap)
+{
+	struct scanf_state st;
+	int r;
+	INSTRUMENT_START(start);
+	init_state(&st, buf, NULL);
+	r = scan_cached(&st, fmt, ap);
+	INSTRUMENT_STOP(INSTRUMENT_SSCANF, start, st.buf - buf);
+	return r;
+}
+
+int vsnscanf(char const *buf, size_t buf_len, char const *fmt, va_list ap) {
+	struct scanf_state st;
+	init_state(&st, buf, buf + buf_len);
+	return scan_cached(&st, fmt, ap);
+}
+
+int snscanf(char const *buf, size_t buf_len, char const *fmt, ...) {
+	va_list ap;
+	int r;
+	va_start(ap, fmt);
+	r = vsnscanf(buf, buf_len, fmt, ap);
+	va_end(ap);
+	return r;
+}
+
+int vscanf_exec(struct scanf_program const *program, char const *buf, va_list ap) {
+	struct scanf_state st;
+	init_state(&st, buf, NULL);
+	return scan_program(&st, program, ap);
+}
+
+int vsnscanf_exec(struct scanf_program const *program, char const *buf, size_t buf_len, va_list ap) {
+	struct scanf_state st;
+	init_state(&st, buf, buf + buf_len);
+	return scan_program(&st, program, ap);
+}
+
+int scanf_exec(struct scanf_program const *program, char const *buf, ...) {
+	va_list ap;
+	int r;
+	va_start(ap, buf);
+	r = vscanf_exec(program, buf, ap);
+	va_end(ap);
+	return r;
+}
+
+int snscanf_exec(struct scanf_program const *program, char const *buf, size_t buf_len, ...) {
+	va_list ap;
+	int r;
+	va_start(ap, buf_len);
+	r = vsnscanf_exec(program, buf, buf_len, ap);
+	va_end(ap);
+	return r;
+}
+
+int scanf_exec_args(struct scanf_program const *program, char const *buf, size_t buf_len, void *const *args, char const **stopped) {
+	struct scanf_op const *op = program->ops;
+	struct scanf_op const *end = op + program->op_count;
+	struct scanf_state st;
+	init_state(&st, buf, buf + buf_len);
+	for (; op != end; args += arg_count(op), op++) {
+		if (!exec_op(op, &program->sets[op->set], &st, args)) {
+			if (stopped)
+				*stopped = st.buf;
+			return st.count;
+		}
+	}
+	if (stopped)
+		*stopped = NULL;
+	return st.count;
+}
+
+int scanf_arg_count(struct scanf_program const *program) {
+	int i = 0, r = 0;
+	for (; i < program->op_count; i++)
+		r += arg_count(&program->ops[i]);
+	return r;
+}
+
+static size_t int_size(int dst_type) {
+	switch (dst_type) {
+	case 'c': return sizeof(char);
+	case 'h': return sizeof(short int);
+	case 'l': return sizeof(long int);
+	case 'L': return sizeof(long long);
+	default: return sizeof(int);
+	}
+}
+
+size_t scanf_arg_size(struct scanf_program const *program, int i) {
+	struct scanf_op const *op = program->ops;
+	struct scanf_op const *end = op + program->op_count;
+	for (; op != end; i -= arg_count(op), op++) {
+		if (i < arg_count(op)) {
+			if (op->slice)
+				return i == 0 ? sizeof(int) : sizeof(char const*);
+			switch (op->kind) {
+			case OP_INT: return op->c == 'p' ? sizeof(void*) : int_size(op->dst_type);
+			case OP_FLOAT: return op->dst_type == 'l' ? sizeof(double) : sizeof(float);
+			case OP_CHARS: return op->width < 2 ? 1 : (size_t) op->width;
+			case OP_STRING:
+			case OP_SET: return op->width > 0 ? (size_t) op->width + 1 : 0;
+			default: return int_size(op->dst_type);
+			}
+		}
+	}
+	return 0;
+}
+
+#ifdef WIN32
+#include <io.h>
+#define read_fd _read
+#else
+#include <unistd.h>
+#define read_fd read
+#endif
+
+#ifndef SCANF_STREAM_BLOCK
+#define SCANF_STREAM_BLOCK 65536
+#endif
+
+// Conversions look ahead at most this many chars past their end ("nan(...)" aside),
+// ones ending closer to the end of the block are repeated with more input.
+#define SCANF_LOOKAHEAD 256
+
+struct scanf_stream {
+	size_t (*read)(void *context, char *dst, size_t size);
+	void *context;
+	char *buf;  // capacity + 1 bytes
+	char *pos;  // not scanned input is [pos, end), followed by 0
+	char *end;
+	size_t capacity;
+	bool eof;
+	char const *data;  // for scanf_open_memory
+	size_t data_size;
+};
+
+struct scanf_stream *scanf_open(size_t (*read)(void *context, char *dst, size_t size), void *context) {
+	struct scanf_stream *s = (struct scanf_stream *) malloc(sizeof(struct scanf_stream));
+	INSTRUMENT_ALLOCATION(INSTRUMENT_SSCANF);
+	if (!s)
+		return NULL;
+	s->capacity = SCANF_STREAM_BLOCK;
+	INSTRUMENT_ALLOCATION(INSTRUMENT_SSCANF);
+	s->buf = (char *) malloc(s->capacity + 1);
+	if (!s->buf) {
+		free(s);
+		return NULL;
+	}
+	s->read = read;
+	s->context = context;
+	s->pos = s->end = s->buf;
+	*s->end = 0;
+	s->eof = false;
+	return s;
+}
+
+static size_t read_from_fd(void *context, char *dst, size_t size) {
+	long r = (long) read_fd((int) (size_t) context, dst, size > 0x40000000 ? 0x40000000 : (unsigned) size);
+	return r > 0 ? (size_t) r : 0;
+}
+
+static size_t read_from_file(void *context, char *dst, size_t size) {
+	return fread(dst, 1, size, (FILE *) context);
+}
+
+static size_t read_from_memory(void *context, char *dst, size_t size) {
+	struct scanf_stream *s = (struct scanf_stream *) context;
+	if (size > s->data_size)
+		size = s->data_size;
+	memcpy(dst, s->data, size);
+	s->data += size;
+	s->data_size -= size;
+	return size;
+}
+
+struct scanf_stream *scanf_open_fd(int fd) {
+	return scanf_open(read_from_fd, (void *) (size_t) fd);
+}
+
+struct scanf_stream *scanf_open_file(FILE *file) {
+	return scanf_open(read_from_file, file);
+}
+
+struct scanf_stream *scanf_open_memory(char const *data, size_t size) {
+	struct scanf_stream *s = scanf_open(read_from_memory, NULL);
+	if (s) {
+		s->context = s;
+		s->data = data;
+		s->data_size = size;
+	}
+	return s;
+}
+
+void scanf_close(struct scanf_stream *stream) {
+	if (stream) {
+		free(stream->buf);
+		free(stream);
+	}
+}
+
+//
+// Reads until there are at least needed chars after st->buf or the input ends.
+// Drops the input before st->buf and grows the buffer if it's full.
+// Returns false if out of memory.
+//
+static bool stream_fill(struct scanf_stream *s, struct scanf_state *st, size_t needed) {
+	while (!s->eof && (size_t) (s->end - st->buf) < needed) {
+		size_t n;
+		if (st->buf != s->buf) {
+			n = s->end - st->buf;
+			st->skipped += st->buf - st->buf_start;
+			memmove(s->buf, st->buf, n);
+			st->buf = s->buf;
+			st->buf_start = s->buf;
+			s->end = s->buf + n;
+		}
+		if (s->end == s->buf + s->capacity) {
+			char *b;
+			INSTRUMENT_ALLOCATION(INSTRUMENT_SSCANF);
+			b = (char *) realloc(s->buf, s->capacity * 2 + 1);
+			if (!b)
+				return false;
+			s->buf = b;
+			st->buf = b;
+			st->buf_start = b;
+			s->end = b + s->capacity;
+			s->capacity *= 2;
+		}
+		n = s->read(s->context, s->end, s->buf + s->capacity - s->end);
+		s->eof = n == 0;
+		s->end += n;
+		*s->end = 0;
+	}
+	return true;
+}
+
+static bool skips_ws(struct scanf_op const *op) {
+	return op->kind == OP_SPACE || op->kind == OP_PERCENT || op->kind == OP_COUNT ||
+		op->kind == OP_INT || op->kind == OP_FLOAT || op->kind == OP_STRING;
+}
+
+//
+// Applies exec_op to the stream.
+// Leading white space is skipped block by block, then the op runs with SCANF_LOOKAHEAD chars of input available,
+// which is enough to fail on the same input as sscanf does. If it succeeds too close to the end of the
+// available input, it may have stopped at the end of the block, so it's repeated with more input.
+//
+static bool stream_op(struct scanf_stream *s, struct scanf_op const *op, struct scanf_set const *set, struct scanf_state *st, void *const *args) {
+	size_t needed = SCANF_LOOKAHEAD + (op->kind == OP_CHARS && op->width > 1 ? op->width : 0);
+	if (op->slice)
+		return false;
+	for (;;) {
+		struct scanf_state saved;
+		bool r;
+		if (skips_ws(op)) {
+			for (skip_ws(&st->buf, NULL); st->buf == s->end && !s->eof; skip_ws(&st->buf, NULL)) {
+				if (!stream_fill(s, st, 1))
+					return false;
+			}
+		}
+		if (!stream_fill(s, st, needed))
+			return false;
+		saved = *st;
+		r = exec_op(op, set, st, args);
+		if (!r || s->eof || (size_t) (s->end - st->buf) >= SCANF_LOOKAHEAD)
+			return r;
+		*st = saved;
+		needed = s->end - st->buf + SCANF_LOOKAHEAD;
+	}
+}
+
+int vstream_scanf(struct scanf_stream *stream, char const *fmt_, va_list ap) {
+	char *fmt = (char *) fmt_;
+	struct scanf_state st;
+	init_state(&st, stream->pos, NULL);
+	while (*fmt) {
+		struct scanf_op op;
+		struct scanf_set set;
+		void *args[2];
+		fmt = parse_op(fmt, &op, &set);
+		GET_ARGS(&op, ap, args);
+		if (!stream_op(stream, &op, &set, &st, args))
+			break;
+	}
+	stream->pos = st.buf;
+	return st.count;
+}
+
+int stream_scanf(struct scanf_stream *stream, char const *fmt, ...) {
+	va_list ap;
+	int r;
+	va_start(ap, fmt);
+	r = vstream_scanf(stream, fmt, ap);
+	va_end(ap);
+	return r;
+}
+
+int vstream_scanf_exec(struct scanf_stream *stream, struct scanf_program const *program, va_list ap) {
+	struct scanf_op const *op = program->ops;
+	struct scanf_op const *end = op + program->op_count;
+	struct scanf_state st;
+	init_state(&st, stream->pos, NULL);
+	for (; op != end; op++) {
+		void *args[2];
+		GET_ARGS(op, ap, args);
+		if (!stream_op(stream, op, &program->sets[op->set], &st, args))
+			break;
+	}
+	stream->pos = st.buf;
+	return st.count;
+}
+
+int stream_scanf_exec(struct scanf_stream *stream, struct scanf_program const *program, ...) {
+	va_list ap;
+	int r;
+	va_start(ap, program);
+	r = vstream_scanf_exec(stream, program, ap);
+	va_end(ap);
+	return r;
+}
+
+#undef read_fd
+#undef GET_ARGS
+
 
 
 #ifdef TESTS
@@ -269,7 +1300,7 @@ void fail(const char* msg);
 #define _STRINGIFY(v) #v
 #define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
 
-void sscanf_tests()
+static void sscanf_tests_with(int (*scan)(char const *buf, char const *fmt, ...))
 {
 	int r;
 	int i, j;
@@ -297,298 +1328,685 @@ void sscanf_tests()
 #endif
 
 	i=0xcc;
-	r=SSCANF("124", "%d", &i);
+	r=scan("124", "%d", &i);
 	ASSERT(r == 1 && i == 124);
 
 	i=0xcc;
-	r=SSCANF("-124", "%d", &i);
+	r=scan("-124", "%d", &i);
 	ASSERT(r == 1 && i == -124);
 	
 	i=0xcc;
-	r=SSCANF("+124", "%d", &i);
+	r=scan("+124", "%d", &i);
 	ASSERT(r == 1 && i  == 124);
 
 	i=0xcc;
-	r=SSCANF("+124", "%d", &i);
+	r=scan("+124", "%d", &i);
 	ASSERT(r == 1 && i  == 124);
 
 	i=0xcc;
-	r=SSCANF("0", "%d", &i);
+	r=scan("0", "%d", &i);
 	ASSERT(r == 1 && i == 0);
 
 	i=0xcc;
-	r=SSCANF("-0", "%d", &i);
+	r=scan("-0", "%d", &i);
 	ASSERT(r == 1 && i == 0);
 
 	i=0xcc;
-	r=SSCANF("+0", "%d", &i);
+	r=scan("+0", "%d", &i);
 	ASSERT(r == 1 && i == 0);
 
 	i=0xcc;
-	r=SSCANF("010", "%d", &i);
+	r=scan("010", "%d", &i);
 	ASSERT(r == 1 && i == 10);
 
 	i=0xcc;
-	r=SSCANF("-010", "%d", &i);
+	r=scan("-010", "%d", &i);
 	ASSERT(r == 1 && i == -10);
 
 	i=0xcc;
-	r=SSCANF(" 1", "%d", &i);
+	r=scan(" 1", "%d", &i);
 	ASSERT(r == 1 && i == 1);
 
 	n=0xcc;
-	r=SSCANF("0", "%u", &n);
+	r=scan("0", "%u", &n);
 	ASSERT(r == 1 && n == 0);
 
 	n=0xcc;
-	r=SSCANF("010", "%u", &n);
+	r=scan("010", "%u", &n);
 	ASSERT(r == 1 && n == 10);
 
 	n=0xcc;
-	r=SSCANF("2147483640", "%u", &n);
+	r=scan("2147483640", "%u", &n);
 	ASSERT(r == 1 && n == 2147483640);
 
 	n=0xcc;
-	r=SSCANF(" 1", "%u", &n);
+	r=scan(" 1", "%u", &n);
 	ASSERT(r == 1 && n == 1);
 
 	n=0xcc;
-	r=SSCANF("12345678", "%4u", &n);
+	r=scan("12345678", "%4u", &n);
 	ASSERT(r == 1 && n == 1234);
 
 	i=0xcc;
-	r=SSCANF("42", "%i", &i);
+	r=scan("42", "%i", &i);
 	ASSERT(r == 1 && i == 42);
 
 	i=0xcc;
-	r=SSCANF("-42", "%i", &i);
+	r=scan("-42", "%i", &i);
 	ASSERT(r == 1 && i == -42);
 
 	i=0xcc;
-	r=SSCANF("+42", "%i", &i);
+	r=scan("+42", "%i", &i);
 	ASSERT(r == 1 && i == +42);
 
 	i=0xcc;
-	r=SSCANF("010", "%i", &i);
+	r=scan("010", "%i", &i);
 	ASSERT(r == 1 && i == 8);
 
 	i=0xcc;
-	r=SSCANF("+010", "%i", &i);
+	r=scan("+010", "%i", &i);
 	ASSERT(r == 1 && i == +8);
 
 	i=0xcc;
-	r=SSCANF("-010", "%i", &i);
+	r=scan("-010", "%i", &i);
 	ASSERT(r == 1 && i == -8);
 
 	i=0xcc;
-	r=SSCANF("0x1f", "%i", &i);
+	r=scan("0x1f", "%i", &i);
 	ASSERT(r == 1 && i == 31);
 
 	i=0xcc;
-	r=SSCANF("+0x1f", "%i", &i);
+	r=scan("+0x1f", "%i", &i);
 	ASSERT(r == 1 && i == +31);
 
 	i=0xcc;
-	r=SSCANF("-0x1f", "%i", &i);
+	r=scan("-0x1f", "%i", &i);
 	ASSERT(r == 1 && i == -31);
 
 	i=0xcc;
-	r=SSCANF("0", "%i", &i);
+	r=scan("0", "%i", &i);
 	ASSERT(r == 1 && i == 0);
 
 	i=0xcc;
-	r=SSCANF("+0", "%i", &i);
+	r=scan("+0", "%i", &i);
 	ASSERT(r == 1 && i == 0);
 
 	i=0xcc;
-	r=SSCANF("-0", "%i", &i);
+	r=scan("-0", "%i", &i);
 	ASSERT(r == 1 && i == 0);
 
 	i=0xcc;
-	r=SSCANF(" 0", "%i", &i);
+	r=scan(" 0", "%i", &i);
 	ASSERT(r == 1 && i == 0);
 
 	n=0xcc;
-	r=SSCANF("%42", "%%%u", &n);
+	r=scan("%42", "%%%u", &n);
 	ASSERT(r == 1 && n == 42);
 
 	n=0xcc;
-	r=SSCANF("0", "%o", &n);
+	r=scan("0", "%o", &n);
 	ASSERT(r == 1 && n == 0);
 
 	n=0xcc;
-	r=SSCANF("10", "%o", &n);
+	r=scan("10", "%o", &n);
 	ASSERT(r == 1 && n == 8);
 
 	n=0xcc;
-	r=SSCANF("17777777777", "%o", &n);
+	r=scan("17777777777", "%o", &n);
 	ASSERT(r == 1 && n == 017777777777);
 
 	n=0xcc;
-	r=SSCANF("0", "%x", &n);
+	r=scan("0", "%x", &n);
 	ASSERT(r == 1 && n == 0);
 
 	n=0xcc;
-	r=SSCANF("1", "%X", &n);
+	r=scan("1", "%X", &n);
 	ASSERT(r == 1 && n == 1);
 
 	n=0xcc;
-	r=SSCANF("1f", "%x", &n);
+	r=scan("1f", "%x", &n);
 	ASSERT(r == 1 && n == 31);
 
 	n=0xcc;
-	r=SSCANF("7fffffff", "%x", &n);
+	r=scan("7fffffff", "%x", &n);
 	ASSERT(r == 1 && n == 0x7fffffff);
 
 	memset(s, 0xcc, sizeof(s));
-	r=SSCANF(" test 42", "%s", s);
+	r=scan(" test 42", "%s", s);
 	ASSERT(r == 1 && strcmp(s, "test") == 0);
 
 	memset(s, 0xcc, sizeof(s));
-	r=SSCANF(" testtest", "%5s", s);
+	r=scan(" testtest", "%5s", s);
 	ASSERT(r == 1 && strcmp(s, "testt") == 0);
 
 	n=0xcc;
-	r=SSCANF("12 42", "%*u%u", &n);
+	r=scan("12 42", "%*u%u", &n);
 	ASSERT(r == 1 && n == 42);
 
 	m=0xcc;
 	i=0xcc;
-	r=SSCANF(" 42", "%u%n", &m, &i);
+	r=scan(" 42", "%u%n", &m, &i);
 	ASSERT(r == 1 && m == 42 && i == 3);
 
 	m=0xcc;
 	n=0x5a;
-	r=SSCANF("12", "%u %n", &m, &n);
+	r=scan("12", "%u %n", &m, &n);
 	ASSERT(r == 1 && m == 12 && n == 2);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF(" 1234", "%c", s);
+	r=scan(" 1234", "%c", s);
 	ASSERT(r == 1 && *s == ' ');
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF(" 1234", "%3c", s);
+	r=scan(" 1234", "%3c", s);
 	ASSERT(r == 1 && memcmp(s, " 12", 3) == 0);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF(" 1234", " %2c", s);
+	r=scan(" 1234", " %2c", s);
 	ASSERT(r == 1 && memcmp(s, "12", 2) == 0);
 
+	memset(s, 0, sizeof(s)), n=0;
+	r=scan(" 1234", " %2c%c%n", s, &c, &n);
+	ASSERT(r == 2 && memcmp(s, "12", 2) == 0 && c == '3' && n == 4);
+
+	r=scan("12", "%3c", s);
+	ASSERT(r == EOF);
+
 	p=(void*)0xCCCCCCCC;
-	r=SSCANF(" 0x12345678", "%p", &p);
+	r=scan(" 0x12345678", "%p", &p);
 	ASSERT(r == 1 && p == (void*)0x12345678);
 
 	memset(s, 0, sizeof(s));
 	i = n = c= j = m = 0;
-	r=SSCANF("12 test 45 c 67 xx", "%i%s %u %c%d %*s%n", &i, s, &n, &c, &j, &m);
+	r=scan("12 test 45 c 67 xx", "%i%s %u %c%d %*s%n", &i, s, &n, &c, &j, &m);
 	ASSERT(r == 5 && i == 12 && !strcmp(s, "test") && n == 45 && c == 'c' && j == 67 && m == 18);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF("12345", "%[321]", s);
+	r=scan("12345", "%[321]", s);
 	ASSERT(r == 1 && strcmp("123", s) == 0);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF("12345", "%[1-3]", s);
+	r=scan("12345", "%[1-3]", s);
 	ASSERT(r == 1 && strcmp("123", s) == 0);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF("56781234", "%[^1-4]", s);
+	r=scan("56781234", "%[^1-4]", s);
 	ASSERT(r == 1 && strcmp("5678", s) == 0);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF("23-4", "%[-2-3]", s);
+	r=scan("23-4", "%[-2-3]", s);
 	ASSERT(r == 1 && strcmp("23-", s) == 0);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF("23-4", "%[2-3-]", s);
+	r=scan("23-4", "%[2-3-]", s);
 	ASSERT(r == 1 && strcmp("23-", s) == 0);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF("[]xx", "%[][]", s);
+	r=scan("[]xx", "%[][]", s);
 	ASSERT(r == 1 && strcmp("[]", s) == 0);
 
 	memset(s, 0, sizeof(s));
-	r=SSCANF("xyz]x", "%[^]]", s);
+	r=scan("xyz]x", "%[^]]", s);
 	ASSERT(r == 1 && strcmp("xyz", s) == 0);
 
 	memset(s, 0, sizeof(s)), n=0;
-	r=SSCANF("12345", "%[1-3]4%u", s, &n);
+	r=scan("12345", "%[1-3]4%u", s, &n);
 	ASSERT(r == 2 && strcmp("123", s) == 0 && n == 5);
 
 	memset(u.b, 0xaa, sizeof(u));
-	r=SSCANF("12345678", "%lx", &u.ul);
-	ASSERT(r == 1 && u.ul == 0x12345678 && memchr(&u, 0xaa, sizeof(u)));
+	r=scan("12345678", "%lx", &u.ul);
+	ASSERT(r == 1 && u.ul == 0x12345678 && (sizeof(long) == sizeof(u) || memchr(&u, 0xaa, sizeof(u))));
 
 	memset(u.b, 0xaa, sizeof(u));
-	r=SSCANF("12345678", "%hx", &u.us);
+	r=scan("12345678", "%hx", &u.us);
 	ASSERT(r == 1 && u.us == 0x5678 && memchr(&u.l, 0xaa, sizeof(u.l)));
 
 	memset(u.b, 0xaa, sizeof(u));
-	r=SSCANF("12345678", "%hhx", &u.uc);
+	r=scan("12345678", "%hhx", &u.uc);
 	ASSERT(r == 1 && u.uc == 0x78 && memchr(&u.s, 0xaa, sizeof(u.s)));
 
 	memset(u.b, 0xaa, sizeof(u));
-	r=SSCANF("12345678", "%llx", &u.ull);
+	r=scan("12345678", "%llx", &u.ull);
 	ASSERT(r == 1 && u.ull == 0x12345678 && !memchr(&u.ll, 0xaa, sizeof(u.ll)));
 
-	r=SSCANF("9223372036854775807", "%lld", &u.ll);
+	r=scan("9223372036854775807", "%lld", &u.ll);
 	ASSERT(r == 1 && u.ll == 9223372036854775807LL);
 
-	r=SSCANF("18446744073709551615", "%llu", &u.ull);
+	r=scan("18446744073709551615", "%llu", &u.ull);
 	ASSERT(r == 1 && u.ull == 18446744073709551615ULL);
 
-	r=SSCANF("-9223372036854775807", "%lld", &u.ll);
+	r=scan("-9223372036854775807", "%lld", &u.ll);
 	ASSERT(r == 1 && u.ll == -9223372036854775807LL);
 
+	r=scan("9223372036854775808", "%lld", &u.ll);
+	ASSERT(r == 1 && u.ll == 9223372036854775807LL);
+
+	r=scan("-9223372036854775808", "%lld", &u.ll);
+	ASSERT(r == 1 && u.ll == -9223372036854775807LL - 1);
+
+	r=scan("-9223372036854775809", "%lld", &u.ll);
+	ASSERT(r == 1 && u.ll == -9223372036854775807LL - 1);
+
+	r=scan("18446744073709551616", "%llu", &u.ull);
+	ASSERT(r == 1 && u.ull == 18446744073709551615ULL);
+
+	r=scan("99999999999999999999999", "%llu", &u.ull);
+	ASSERT(r == 1 && u.ull == 18446744073709551615ULL);
+
+	r=scan("-1", "%llu", &u.ull);
+	ASSERT(r == 1 && u.ull == 18446744073709551615ULL);
+
+	r=scan("0000000000000000000000000012345678901234567", "%lld", &u.ll);
+	ASSERT(r == 1 && u.ll == 12345678901234567LL);
+
+	r=scan("1234567890123456789", "%llu", &u.ull);
+	ASSERT(r == 1 && u.ull == 1234567890123456789ULL);
+
+	r=scan("ffffffffffffffff 1ffffffffffffffff", "%llx%llx", &u.ull, &u.ll);
+	ASSERT(r == 2 && u.ll == -1);
+
+	i=0xcc, n=0xcc;
+	r=scan("-12345", "%3d%n", &i, &n);
+	ASSERT(r == 1 && i == -12 && n == 3);
+
+	i=0xcc, n=0xcc;
+	r=scan("0x1f", "%2x%n", &i, &n);
+	ASSERT(r == 1 && i == 0 && n == 1);
+
+	i=0xcc, n=0xcc;
+	r=scan("0xg", "%i%n", &i, &n);
+	ASSERT(r == 1 && i == 0 && n == 1);
+
+	i=0xcc;
+	r=scan("0X1F", "%x", &i);
+	ASSERT(r == 1 && i == 31);
+
+	i=0xcc, n=0xcc;
+	r=scan("0779", "%i%n", &i, &n);
+	ASSERT(r == 1 && i == 077 && n == 3);
+
+	i=0xcc, n=0xcc;
+	r=scan("123456789012", "%10d%n", &i, &n);
+	ASSERT(r == 1 && i == 1234567890 && n == 10);
+
+	r=scan("-", "%d", &i);
+	ASSERT(r == EOF);
+
 #ifdef CONFIG_LIBC_FLOATINGPOINT
 	memset(&f, 0xaa, sizeof(f));
-	r=SSCANF("-12.345", "%f", &f.f);
+	r=scan("-12.345", "%f", &f.f);
 	ASSERT(r == 1 && fabsf(f.f + 12.345) < 0.000001 && memchr(&f, 0xaa, sizeof(f)));
 
 	memset(&f, 0xaa, sizeof(f));
-	r=SSCANF("0.1234", "%le", &f.d);
+	r=scan("0.1234", "%le", &f.d);
 	ASSERT(r == 1 && fabs(f.d - 0.1234) < 0.00000001 && !memchr(&f, 0xaa, sizeof(f)));
 
+	r=scan("-1.5E2", "%lE", &f.d);
+	ASSERT(r == 1 && f.d == -150);
+	r=scan("2.5", "%lF", &f.d);
+	ASSERT(r == 1 && f.d == 2.5);
+	r=scan("0.25", "%lA", &f.d);
+	ASSERT(r == 1 && f.d == 0.25);
+
 	memset(&f, 0xaa, sizeof(f));
-	r=SSCANF("5.24e3", "%f", &f.f);
+	r=scan("5.24e3", "%f", &f.f);
 	ASSERT(r == 1 && fabsf(f.f - 5240) < 0.001 && memchr(&f, 0xaa, sizeof(f)));
 
 	memset(&f, 0xaa, sizeof(f)), n=0;
-	r=SSCANF("123.4567.89", "%6f%f%n", &f.f, &fl, &n);
+	r=scan("123.4567.89", "%6f%f%n", &f.f, &fl, &n);
 	ASSERT(r == 2 && fabsf(f.f - 123.45) < 0.001 && fabsf(fl - 67.89) < 0.001 && n == 11);
+
+	n=0;
+	r=scan(" 0.1000000000000000055511151231257827e1x", "%80lf%n", &f.d, &n);
+	ASSERT(r == 1 && f.d == 1.0000000000000000555 && n == 39);
+
+	n=0;
+	r=scan("0x1.8p1,1e999", "%lf,%lf%n", &f.d, &f.d, &n);
+	ASSERT(r == 2 && f.d > 1e308 && n == 13);
+
+	r=scan("1e-5", "%2lf%n", &f.d, &n);
+	ASSERT(r == 1 && f.d == 1 && n == 1);
 #endif
 
-	r=SSCANF("", "%u", &n);
+	r=scan("", "%u", &n);
 	ASSERT(r == EOF);
 
-	r=SSCANF("12", "%u%u", &m, &n);
+	r=scan("12", "%u%u", &m, &n);
 	ASSERT(r == 1);
 
-	r=SSCANF(" ", "%u", &n);
+	r=scan(" ", "%u", &n);
 	ASSERT(r == EOF);
 
-	r=SSCANF("a12", "ab%u", &n);
+	r=scan("a12", "ab%u", &n);
 	ASSERT(r == 0);
 
 	n=0;
-	r=SSCANF("12345", "%-3u", &n);
+	r=scan("12345", "%-3u", &n);
 	ASSERT(r == 1 && n == 12345);
 
 	m=0xaa;
 	n=0xee;
-	r=SSCANF("6543", "%u,%n", &m, &n);
+	r=scan("6543", "%u,%n", &m, &n);
 	ASSERT(r == 1);
 	ASSERT(n == 0xee);
 
 	m=0xaa;
 	n=0xee;
-	r=SSCANF(" 100.2 AAA, 11/12\n", " %*[^,], %d/%d", &m, &n);
+	r=scan(" 100.2 AAA, 11/12\n", " %*[^,], %d/%d", &m, &n);
 	ASSERT(r == 2 && m == 11 && n == 12);
 
 	m=0xaa;
 	n=0xee;
-	r=SSCANF(" 100.2 XXX, 11/12\n", " %*s%*s %*d/%d", &m);
+	r=scan(" 100.2 XXX, 11/12\n", " %*s%*s %*d/%d", &m);
 	ASSERT(r == 1 && m == 12);
+
+	memset(s, 0, sizeof(s));
+	r=scan("\xc3\xa9t\xc3\xa9,x", "%[^,]", s);
+	ASSERT(r == 1 && strcmp("\xc3\xa9t\xc3\xa9", s) == 0);
+
+	memset(s, 0, sizeof(s));
+	r=scan("\xc3\xa9t", "%[\x80-\xff]", s);
+	ASSERT(r == 1 && strcmp("\xc3\xa9", s) == 0);
+}
+
+static int compiled_scanf(char const *buf, char const *fmt, ...)
+{
+	va_list ap;
+	int r;
+	struct scanf_program *p = scanf_compile(fmt);
+	va_start(ap, fmt);
+	r = vscanf_exec(p, buf, ap);
+	va_end(ap);
+	free(p);
+	return r;
+}
+
+// Scans the input without the terminating zero, followed by a digit changing the results if it's read.
+static int bounded_scanf(char const *buf, char const *fmt, ...)
+{
+	va_list ap;
+	int r;
+	size_t len = strlen(buf);
+	char *copy = (char *) malloc(len + 1);
+	memcpy(copy, buf, len);
+	copy[len] = '7';
+	va_start(ap, fmt);
+	r = vsnscanf(copy, len, fmt, ap);
+	va_end(ap);
+	free(copy);
+	return r;
+}
+
+struct trickle {
+	char const *data;
+	int calls;
+};
+
+// Gives 1..3 bytes at a time to get conversions split between reads.
+static size_t read_trickle(void *context, char *dst, size_t size) {
+	struct trickle *t = (struct trickle *) context;
+	size_t n = strlen(t->data);
+	if (n > (size_t) (t->calls++ % 3 + 1))
+		n = t->calls % 3 + 1;
+	if (n > size)
+		n = size;
+	memcpy(dst, t->data, n);
+	t->data += n;
+	return n;
+}
+
+static int stream_scanf_trickle(char const *buf, char const *fmt, ...)
+{
+	va_list ap;
+	int r;
+	struct trickle t = {buf, 0};
+	struct scanf_stream *s = scanf_open(read_trickle, &t);
+	va_start(ap, fmt);
+	r = vstream_scanf(s, fmt, ap);
+	va_end(ap);
+	scanf_close(s);
+	return r;
+}
+
+static void stream_scanf_tests()
+{
+	enum { N = 100000 };
+	char *big = (char *) malloc(N * 16 + SCANF_STREAM_BLOCK * 3);
+	char *token = (char *) malloc(SCANF_STREAM_BLOCK * 3);
+	struct scanf_stream *s;
+	char *p = big;
+	int i, a, b, n;
+	long long sum = 0;
+	FILE *f;
+
+	// Many small records over block boundaries and a token longer than a block.
+	for (i = 0; i < N; i++)
+		p += sprintf(p, "%d,%d\n", i, -i * 3);
+	memset(p, 'x', SCANF_STREAM_BLOCK * 2 + 5);
+	p[SCANF_STREAM_BLOCK * 2 + 5] = 0;
+	s = scanf_open_memory(big, strlen(big));
+	for (i = 0; i < N; i++) {
+		ASSERT(stream_scanf(s, "%d,%d%n", &a, &b, &n) == 2 && a == i && b == -i * 3);
+		ASSERT(n == sprintf(token, "%d,%d\n", i, -i * 3));
+		sum += a + b;
+	}
+	ASSERT(sum == -(long long) N * (N - 1));
+	ASSERT(stream_scanf(s, "%s%n", token, &n) == 1 && strlen(token) == SCANF_STREAM_BLOCK * 2 + 5 && n == SCANF_STREAM_BLOCK * 2 + 5);
+	ASSERT(stream_scanf(s, "%d", &a) == EOF);
+	scanf_close(s);
+
+	// Whitespace longer than a block is skipped without keeping it.
+	memset(big, ' ', SCANF_STREAM_BLOCK * 3);
+	strcpy(big + SCANF_STREAM_BLOCK * 3, "42");
+	f = fopen("sscanf_test.tmp", "wb");
+	fputs(big, f);
+	fclose(f);
+	f = fopen("sscanf_test.tmp", "rb");
+	s = scanf_open_file(f);
+	ASSERT(stream_scanf(s, "%d%n", &a, &n) == 1 && a == 42 && n == SCANF_STREAM_BLOCK * 3 + 2);
+	ASSERT(stream_scanf(s, " %n", &n) == 0 && n == 0);
+	scanf_close(s);
+	fclose(f);
+	remove("sscanf_test.tmp");
+
+	// Failed conversion consumes the white space before it, as fscanf does.
+	s = scanf_open_memory("12  ab", 6);
+	ASSERT(stream_scanf(s, "%d", &a) == 1 && a == 12);
+	ASSERT(stream_scanf(s, "%d", &a) == EOF);
+	ASSERT(stream_scanf(s, "%2c", token) == 1 && memcmp(token, "ab", 2) == 0);
+	ASSERT(stream_scanf(s, "%c", token) == EOF);
+	scanf_close(s);
+
+	free(big);
+	free(token);
+}
+
+#ifndef WIN32
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Inputs that end where a page ends and the next one is not readable, no terminator after them.
+static void page_end_tests()
+{
+	long page = sysconf(_SC_PAGESIZE);
+	char *map = (char *) mmap(NULL, page * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	char *end = map + page;
+	char const *p;
+	char s[300];
+	int len, n, m;
+	ASSERT(map != MAP_FAILED && mprotect(end, page, PROT_NONE) == 0);
+	memset(map, 'x', page);
+	// White space, a token and a set run to the end, starting at every alignment.
+	for (len = 1; len < 200; len++) {
+		char *t = end - len;
+		memset(t, ' ', len);
+		ASSERT(snscanf(t, len, " %n", &m) == 0 && m == len);
+		memset(t, 'a', len);
+		ASSERT(snscanf(t, len, "%.*s%n", &n, &p, &m) == 1 && n == len && p == t && m == len);
+		ASSERT(snscanf(t, len, "%[a-c]%n", s, &m) == 1 && (int) strlen(s) == len && m == len);
+		memset(t, ' ', len / 3);
+		ASSERT(snscanf(t, len, "%s%n", s, &m) == 1 && (int) strlen(s) == len - len / 3 && m == len);
+		// Long enough for the set lookup built on demand.
+		ASSERT(snscanf(t, len, " %*[^,]%n", &m) == 0 && m == len);
+	}
+	munmap(map, page * 2);
+}
+
+#endif
+
+static void snscanf_tests()
+{
+	char const *request = "GET /index.html HTTP/1.1\r\n";
+	char const *p, *q;
+	char s[16];
+	int n, m, minor;
+	struct scanf_program *program;
+	struct scanf_stream *stream;
+
+	ASSERT(snscanf(request, strlen(request), "%.*s %.*s HTTP/1.%d", &n, &p, &m, &q, &minor) == 3);
+	ASSERT(n == 3 && p == request && m == 11 && q == request + 4 && minor == 1);
+
+	// Limits cut the conversions as the end of the string does.
+	ASSERT(snscanf("12345", 3, "%d%n", &n, &m) == 1 && n == 123 && m == 3);
+	ASSERT(snscanf("12345", 0, "%d", &n) == EOF);
+	ASSERT(snscanf("  12", 2, "%d", &n) == EOF);
+	ASSERT(snscanf("  12", 2, "%s", s) == 1 && s[0] == 0);
+	ASSERT(snscanf("ab", 1, "ab") == 0);
+	ASSERT(snscanf("ab", 1, "%%") == EOF);
+	ASSERT(snscanf("abc", 2, "%3c", s) == EOF);
+	ASSERT(snscanf("abcdef", 4, "%s%n", s, &n) == 1 && strcmp(s, "abcd") == 0 && n == 4);
+	ASSERT(snscanf("abcdef", 4, "%[a-z]", s) == 1 && strcmp(s, "abcd") == 0);
+	ASSERT(snscanf("ab\0cd", 5, "%s%n", s, &n) == 1 && strcmp(s, "ab") == 0 && n == 2);
+#ifndef WIN32
+	page_end_tests();
+#endif
+#ifdef CONFIG_LIBC_FLOATINGPOINT
+	{
+		double d;
+		ASSERT(snscanf("1.5e3", 3, "%lf%n", &d, &n) == 1 && d == 1.5 && n == 3);
+	}
+#endif
+
+	// Slices of %c, %s and %[, which may be empty.
+	p = q = NULL;
+	ASSERT(snscanf("abcdefg", 7, "%3.*c%.*c", &n, &p, &m, &q) == 2 && n == 3 && m == 1 && q == p + 3);
+	ASSERT(snscanf("abcdefg", 7, "%8.*c", &n, &p) == EOF);
+	ASSERT(snscanf("ab cd", 5, "%*.*s %.*s", &n, &p) == 1 && n == 2 && memcmp(p, "cd", 2) == 0);
+	ASSERT(snscanf("abcdef", 6, "%2.*s%n", &n, &p, &m) == 1 && n == 2 && m == 2);
+	ASSERT(test_scanf("key=value;", "%.*[^=]=%.*[^;]", &n, &p, &m, &q) == 2);
+	ASSERT(n == 3 && memcmp(p, "key", 3) == 0 && m == 5 && memcmp(q, "value", 5) == 0);
+	ASSERT(test_scanf("=x", "%.*[^=]=%.*s", &n, &p, &m, &q) == 2 && n == 0 && m == 1);
+
+	program = scanf_compile("%d %.*s %*.*s%n");
+	ASSERT(scanf_arg_count(program) == 4);
+	ASSERT(scanf_arg_size(program, 1) == sizeof(int) && scanf_arg_size(program, 2) == sizeof(char const*));
+	ASSERT(scanf_arg_size(program, 3) == sizeof(int));
+	ASSERT(snscanf_exec(program, "12 ab cd", 8, &minor, &n, &p, &m) == 2 && minor == 12 && n == 2 && m == 8);
+	free(program);
+
+	stream = scanf_open_memory("abc", 3);
+	ASSERT(stream_scanf(stream, "%.*s", &n, &p) == EOF);
+	ASSERT(stream_scanf(stream, "%s", s) == 1 && strcmp(s, "abc") == 0);
+	scanf_close(stream);
+}
+
+static void cache_tests()
+{
+	unsigned long long hits, misses, hits0, misses0;
+	char fmt[128];
+	int i, a, b;
+	scanf_cache_stats(&hits0, &misses0);
+	for (i = 0; i < 10; i++)
+		ASSERT(test_scanf("12,34", "%d,%d", &a, &b) == 2 && a == 12 && b == 34);
+	scanf_cache_stats(&hits, &misses);
+#ifdef SCANF_NO_CACHE
+	ASSERT(hits == 0 && misses == 0);
+#else
+	ASSERT(hits - hits0 >= 9 && misses - misses0 <= 1);
+
+	// The same buffer with another format misses.
+	strcpy(fmt, "%d-%d");
+	ASSERT(test_scanf("5-6", fmt, &a, &b) == 2 && a == 5 && b == 6);
+	strcpy(fmt, "%d+%d");
+	ASSERT(test_scanf("7+8", fmt, &a, &b) == 2 && a == 7 && b == 8);
+	ASSERT(test_scanf("7-8", fmt, &a, &b) == 1 && a == 7);
+	scanf_cache_stats(&hits0, &misses0);
+	ASSERT(hits0 - hits == 1 && misses0 - misses == 2);
+
+	// More formats than entries, and ones too big to cache, still work.
+	for (i = 0; i < SCANF_CACHE_SIZE * 3; i++) {
+		sprintf(fmt + i % 4 * 32, "%%d%*s%%n", i, "");
+		ASSERT(test_scanf("1", fmt + i % 4 * 32, &a, &b) == 1 && a == 1 && b == 1);
+	}
+	memset(fmt, ' ', sizeof(fmt));
+	strcpy(fmt + sizeof(fmt) - 4, "%d");
+	ASSERT(test_scanf("9", fmt, &a) == 1 && a == 9);
+	ASSERT(test_scanf("1 2 3 4 5", "%*[0-9] %*[0-9] %*[0-9] %*[0-9] %[0-9]", fmt) == 1 && strcmp(fmt, "5") == 0);
+#endif
+}
+
+static bool in_test_set(int c, int set) {
+	return
+		set == 0 ? c >= 'a' && c <= 'z' :
+		set == 1 ? c != ',' && c != 0 :
+		(unsigned char) c >= 0x80;
+}
+
+// Long runs of every class at every alignment and width, as vectorized spans see them.
+static void span_tests()
+{
+	static const char alphabet[] = "az,A \t\x80\xff";
+	static const char *sets[] = {"a-z]", "^,]", "\x80-\xff]"};
+	char buf[128], s[128], fmt[32];
+	int round, offset, width, set, n, expected;
+	for (round = 0; round < 200; round++) {
+		int len = round % 100;
+		for (n = 0; n < len; n++)
+			buf[n] = alphabet[(round * 7 + n * (round % 5 == 0 ? 0 : n % 3 + 1)) % (sizeof(alphabet) - 1)];
+		buf[len] = 0;
+		for (offset = 0; offset < 32 && offset <= len; offset++) {
+			const char *t = buf + offset;
+			for (width = 0; width < 70; width += width < 3 ? 1 : 17) {
+				int limit = width ? width : 1000;
+				for (set = 0; set < 3; set++) {
+					sprintf(fmt, "%%%d[%s", width, sets[set]);
+					for (expected = 0; expected < limit && in_test_set(t[expected], set); expected++) {}
+					n = -1;
+					if (test_scanf(t, fmt, s) == 1)
+						n = (int) strlen(s);
+					ASSERT(n == expected);
+					sprintf(fmt, "%%*[%s%%n", sets[set]);
+					test_scanf(t, fmt, &n);
+					// %n skips white space first.
+					for (expected = 0; in_test_set(t[expected], set); expected++) {}
+					for (; t[expected] && t[expected] <= ' '; expected++) {}
+					ASSERT(n == expected);
+				}
+				sprintf(fmt, "%%%ds", width);
+				for (n = 0; t[n] && t[n] <= ' '; n++) {}
+				for (expected = 0; expected < limit && t[n + expected] > ' '; expected++) {}
+				s[0] = 1;
+				test_scanf(t, fmt, s);
+				ASSERT((int) strlen(s) == expected || (!t[n] && s[0] == 1));
+				test_scanf(t, " %n", &n);
+				for (expected = 0; t[expected] && t[expected] <= ' '; expected++) {}
+				ASSERT(n == expected);
+			}
+		}
+	}
+}
+
+void sscanf_tests()
+{
+	span_tests();
+	sscanf_tests_with(SSCANF);
+	sscanf_tests_with(compiled_scanf);
+	sscanf_tests_with(stream_scanf_trickle);
+	sscanf_tests_with(bounded_scanf);
+	stream_scanf_tests();
+	snscanf_tests();
+	cache_tests();
 }
 
 #endif //TEST
@@ -1,22 +1,48 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 void calc_tests();
 void eq_wild_tests();
 void sscanf_tests();
 void decode_base64_tests();
 void utf8_tests();
+void utf16_tests();
+void utf8_parallel_tests();
+void utf8_index_tests();
+void latin1_tests();
+void strtod_tests();
+void parallel_tests();
+void wild_grep_tests();
+void scan_columns_tests();
+void differential_tests();
+void instrument_tests();
+void differential_report(FILE *out, unsigned int seed, long rounds);
 
 void fail(const char *msg) {
 	printf("fail: %s\n", msg);
 	exit(-1);
 }
 
-int main() {
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "--differential") == 0) {
+		differential_report(stdout, 1, argc > 2 ? atol(argv[2]) : 100000);
+		return 0;
+	}
 	decode_base64_tests();
 	calc_tests();
 	eq_wild_tests();
 	sscanf_tests();
 	utf8_tests();
+	utf16_tests();
+	utf8_parallel_tests();
+	utf8_index_tests();
+	latin1_tests();
+	strtod_tests();
+	parallel_tests();
+	wild_grep_tests();
+	scan_columns_tests();
+	instrument_tests();
+	differential_tests();
 	printf("ok\n");
 }
@@ -0,0 +1,336 @@
+#include <stddef.h>
+#include <string.h>
+
+//
+// Converts len bytes of UTF-8 from src to UTF-16. The input is decoded as get_utf8 does:
+// ill-formed sequences are skipped, encoded surrogate pairs are joined and lone surrogates are dropped,
+// characters above 0x10ffff, which can't be represented in UTF-16, are skipped as well.
+// Stores at most cap units to dst (may be NULL if cap is 0), never splitting a surrogate pair.
+// Returns the number of units of the whole text, which is more than cap if dst was too small.
+// Usage example:
+//    size_t n = utf8_to_utf16_size(text, len);
+//    unsigned short *wide = malloc(n * sizeof(unsigned short));
+//    utf8_to_utf16(text, len, wide, n);
+//
+size_t utf8_to_utf16(const char *src, size_t len, unsigned short *dst, size_t cap);
+
+//
+// Converts n units of UTF-16 from src to UTF-8, joining surrogate pairs and skipping lone surrogates.
+// Stores at most cap bytes to dst (may be NULL if cap is 0), never splitting a character.
+// Returns the number of bytes of the whole text, which is more than cap if dst was too small.
+//
+size_t utf16_to_utf8(const unsigned short *src, size_t n, char *dst, size_t cap);
+
+//
+// Return the exact number of units utf8_to_utf16 and bytes utf16_to_utf8 produce.
+//
+size_t utf8_to_utf16_size(const char *src, size_t len);
+size_t utf16_to_utf8_size(const unsigned short *src, size_t n);
+
+int get_utf8_from(const char **src, const char *end);
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF16_SSE2
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <tmmintrin.h>
+#define UTF16_SSSE3
+#endif
+#endif
+
+size_t utf8_to_utf16(const char *src, size_t len, unsigned short *dst, size_t cap)
+{
+	const unsigned char *p = (const unsigned char *) src;
+	const unsigned char *end = p + len;
+	size_t n = 0;
+	for (;;) {
+		int r;
+#ifdef UTF16_SSE2
+		// ASCII runs are widened 16 bytes at a time.
+		while (end - p >= 16 && (n >= cap || cap - n >= 16)) {
+			__m128i v = _mm_loadu_si128((const __m128i *) p);
+			if (_mm_movemask_epi8(v))
+				break;
+			if (n < cap) {
+				_mm_storeu_si128((__m128i *) (dst + n), _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+				_mm_storeu_si128((__m128i *) (dst + n + 8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+			}
+			p += 16;
+			n += 16;
+		}
+#endif
+		if (p != end && *p < 0x80) {
+			if (n < cap)
+				dst[n] = *p;
+			n++;
+			p++;
+			continue;
+		}
+		// Well-formed 2 and 3 byte characters of the BMP, except surrogates, without the general decoder.
+		if (end - p >= 3 && (p[1] & 0xc0) == 0x80) {
+			if ((p[0] & 0xe0) == 0xc0) {
+				if (n < cap)
+					dst[n] = (unsigned short) ((p[0] & 0x1f) << 6 | (p[1] & 0x3f));
+				n++;
+				p += 2;
+				continue;
+			}
+			if ((p[0] & 0xf0) == 0xe0 && (p[2] & 0xc0) == 0x80 && p[0] != 0xed) {
+				if (n < cap)
+					dst[n] = (unsigned short) ((p[0] & 0xf) << 12 | (p[1] & 0x3f) << 6 | (p[2] & 0x3f));
+				n++;
+				p += 3;
+				continue;
+			}
+		}
+		r = get_utf8_from((const char **) &p, (const char *) end);
+		if (r < 0)
+			return n;
+		if (r <= 0xffff) {
+			if (n < cap)
+				dst[n] = (unsigned short) r;
+			n++;
+		} else if (r <= 0x10ffff) {
+			if (n + 2 > cap)
+				cap = 0;  // only whole characters of the beginning of the text
+			else {
+				r -= 0x10000;
+				dst[n] = (unsigned short) (0xD800 | r >> 10);
+				dst[n + 1] = (unsigned short) (0xDC00 | (r & 0x3ff));
+			}
+			n += 2;
+		}
+	}
+}
+
+#ifdef UTF16_SSE2
+// Returns the mask of 16 bit lanes having all of bits of mask zero.
+static int zero_lanes(__m128i v, int mask)
+{
+	return _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short) mask)), _mm_setzero_si128()));
+}
+#endif
+
+size_t utf16_to_utf8(const unsigned short *src, size_t n, char *dst, size_t cap)
+{
+	unsigned char *d = (unsigned char *) dst;
+	size_t i = 0, r = 0;
+	for (;;) {
+		int c, length;
+#ifdef UTF16_SSE2
+		// Runs of 8 units of the same length: ASCII, 2 bytes (Latin, Cyrillic, ...) or 3 bytes (CJK, ...).
+		while (n - i >= 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+			int ascii = zero_lanes(v, 0xff80);
+			int two_bytes = zero_lanes(v, 0xf800);
+			if (ascii == 0xffff) {
+				if (r < cap && cap - r < 8)
+					break;
+				if (r < cap)
+					_mm_storel_epi64((__m128i *) (d + r), _mm_packus_epi16(v, v));
+				r += 8;
+			} else if (two_bytes == 0xffff && ascii == 0) {
+				if (r < cap && cap - r < 16)
+					break;
+				if (r < cap) {
+					// The lead byte is the low byte of each lane, as the text is little endian in memory.
+					__m128i lead = _mm_or_si128(_mm_srli_epi16(v, 6), _mm_set1_epi16(0xc0));
+					__m128i tail = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0x3f)), _mm_set1_epi16(0x80));
+					_mm_storeu_si128((__m128i *) (d + r), _mm_or_si128(lead, _mm_slli_epi16(tail, 8)));
+				}
+				r += 16;
+#ifdef UTF16_SSSE3
+			} else if (two_bytes == 0 &&
+				zero_lanes(_mm_xor_si128(_mm_and_si128(v, _mm_set1_epi16((short) 0xf800)), _mm_set1_epi16((short) 0xd800)), 0xffff) == 0)
+			{
+				if (r < cap && cap - r < 24)
+					break;
+				if (r < cap) {
+					static const char first[16] = { 0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10 };
+					static const char first_tail[16] = { -1, -1, 0, -1, -1, 2, -1, -1, 4, -1, -1, 6, -1, -1, 8, -1 };
+					static const char second[16] = { 11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+					static const char second_tail[16] = { -1, 10, -1, -1, 12, -1, -1, 14, -1, -1, -1, -1, -1, -1, -1, -1 };
+					// Lanes of the first two bytes and of the last one, interleaved into 3 byte groups.
+					__m128i lead = _mm_or_si128(_mm_srli_epi16(v, 12), _mm_set1_epi16(0xe0));
+					__m128i middle = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 6), _mm_set1_epi16(0x3f)), _mm_set1_epi16(0x80));
+					__m128i heads = _mm_or_si128(lead, _mm_slli_epi16(middle, 8));
+					__m128i tails = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0x3f)), _mm_set1_epi16(0x80));
+					_mm_storeu_si128((__m128i *) (d + r), _mm_or_si128(
+						_mm_shuffle_epi8(heads, _mm_loadu_si128((const __m128i *) first)),
+						_mm_shuffle_epi8(tails, _mm_loadu_si128((const __m128i *) first_tail))));
+					_mm_storel_epi64((__m128i *) (d + r + 16), _mm_or_si128(
+						_mm_shuffle_epi8(heads, _mm_loadu_si128((const __m128i *) second)),
+						_mm_shuffle_epi8(tails, _mm_loadu_si128((const __m128i *) second_tail))));
+				}
+				r += 24;
+#endif
+			} else
+				break;
+			i += 8;
+		}
+#endif
+		if (i == n)
+			return r;
+		c = src[i++];
+		if (c >= 0xD800 && c <= 0xDFFF) {
+			if (c > 0xDBFF || i == n || src[i] < 0xDC00 || src[i] > 0xDFFF)
+				continue;  // lone surrogate
+			c = ((c & 0x3ff) << 10 | (src[i++] & 0x3ff)) + 0x10000;
+		}
+		length = c <= 0x7f ? 1 : c <= 0x7ff ? 2 : c <= 0xffff ? 3 : 4;
+		if (r + length > cap) {
+			cap = 0;  // only whole characters of the beginning of the text
+			r += length;
+			continue;
+		}
+		switch (length) {
+		case 1:
+			d[r] = (unsigned char) c;
+			break;
+		case 2:
+			d[r] = (unsigned char) (c >> 6 | 0xc0);
+			d[r + 1] = (unsigned char) ((c & 0x3f) | 0x80);
+			break;
+		case 3:
+			d[r] = (unsigned char) (c >> (6 + 6) | 0xe0);
+			d[r + 1] = (unsigned char) (((c >> 6) & 0x3f) | 0x80);
+			d[r + 2] = (unsigned char) ((c & 0x3f) | 0x80);
+			break;
+		default:
+			d[r] = (unsigned char) (c >> (6 + 6 + 6) | 0xf0);
+			d[r + 1] = (unsigned char) (((c >> (6 + 6)) & 0x3f) | 0x80);
+			d[r + 2] = (unsigned char) (((c >> 6) & 0x3f) | 0x80);
+			d[r + 3] = (unsigned char) ((c & 0x3f) | 0x80);
+			break;
+		}
+		r += length;
+	}
+}
+
+size_t utf8_to_utf16_size(const char *src, size_t len)
+{
+	return utf8_to_utf16(src, len, NULL, 0);
+}
+
+size_t utf16_to_utf8_size(const unsigned short *src, size_t n)
+{
+	return utf16_to_utf8(src, n, NULL, 0);
+}
+
+#ifdef TESTS
+
+#include <stdlib.h>
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+size_t utf8_decode_buf(const char *src, size_t len, int *dst, size_t cap);
+size_t utf8_encode_buf(const int *src, size_t n, char *dst, size_t cap);
+
+// UTF-16 of the characters, skipping the ones UTF-16 can't hold.
+static size_t to_units(const int *chars, size_t n, unsigned short *dst)
+{
+	size_t i, r = 0;
+	for (i = 0; i < n; i++) {
+		int c = chars[i];
+		if (c >= 0x10000 && c <= 0x10ffff) {
+			dst[r++] = (unsigned short) (0xD800 | (c - 0x10000) >> 10);
+			dst[r++] = (unsigned short) (0xDC00 | (c & 0x3ff));
+		} else if (c <= 0xffff)
+			dst[r++] = (unsigned short) c;
+	}
+	return r;
+}
+
+void utf16_tests()
+{
+	enum { ALL = 0x110000 - 0x800 };
+	int *chars = (int *) malloc(ALL * sizeof(int));
+	unsigned short *units = (unsigned short *) malloc(ALL * 2 * sizeof(unsigned short));
+	unsigned short *back = (unsigned short *) malloc(ALL * 2 * sizeof(unsigned short));
+	char *text = (char *) malloc(ALL * 4);
+	char *expected = (char *) malloc(ALL * 4);
+	size_t unit_count, len, i;
+	int c, n = 0, round;
+	unsigned int seed = 3;
+
+	// Every code point both ways, in runs long enough for the vector paths.
+	for (c = 0; c < 0x110000; c++) {
+		if (c < 0xD800 || c > 0xDFFF)
+			chars[n++] = c;
+	}
+	unit_count = to_units(chars, n, units);
+	len = utf8_encode_buf(chars, n, expected, ALL * 4);
+	ASSERT(utf16_to_utf8_size(units, unit_count) == len);
+	ASSERT(utf16_to_utf8(units, unit_count, text, ALL * 4) == len);
+	ASSERT(memcmp(text, expected, len) == 0);
+	ASSERT(utf8_to_utf16_size(text, len) == unit_count);
+	ASSERT(utf8_to_utf16(text, len, back, ALL * 2) == unit_count);
+	ASSERT(memcmp(back, units, unit_count * sizeof(unsigned short)) == 0);
+
+	// Random runs mixing the lengths, lone surrogates, ill-formed UTF-8 and small buffers.
+	for (round = 0; round < 20000; round++) {
+		size_t count = round % 70, cap = round % 97, r;
+		for (i = 0; i < count; i++) {
+			seed = seed * 1103515245 + 12345;
+			switch ((seed >> 8) % (round % 4 + 1)) {
+			case 0: chars[i] = 0x20 + (seed >> 16) % 0x5f; break;
+			case 1: chars[i] = round % 3 == 0 ? 0x4e00 + (seed >> 16) % 0x100 : 0x400 + (seed >> 16) % 0x100; break;
+			case 2: chars[i] = 0xD800 + (seed >> 16) % 0x800; break;
+			default: chars[i] = (seed >> 12) % 0x110000; break;
+			}
+			units[i] = (unsigned short) chars[i];
+			text[i] = (char) (seed >> 16);
+		}
+		// UTF-16 with lone surrogates: the pairs are joined, the rest dropped.
+		{
+			int decoded[70];
+			size_t k = 0;
+			for (i = 0; i < count; i++) {
+				int u = units[i];
+				if (u >= 0xD800 && u <= 0xDBFF && i + 1 < count && units[i + 1] >= 0xDC00 && units[i + 1] <= 0xDFFF)
+					decoded[k++] = ((u & 0x3ff) << 10 | (units[++i] & 0x3ff)) + 0x10000;
+				else if (u < 0xD800 || u > 0xDFFF)
+					decoded[k++] = u;
+			}
+			len = utf8_encode_buf(decoded, k, expected, ALL);
+			memset(back, 0x55, 512);
+			ASSERT(utf16_to_utf8(units, count, (char *) back, cap) == len);
+			r = 0;
+			for (i = 0; i < k && r + utf8_encode_buf(decoded + i, 1, NULL, 0) <= cap; i++)
+				r += utf8_encode_buf(decoded + i, 1, NULL, 0);
+			ASSERT(memcmp(back, expected, r) == 0 && ((unsigned char *) back)[r] == 0x55);
+		}
+		// Random bytes as UTF-8 decode as utf8_decode_buf does.
+		{
+			int decoded[70];
+			size_t k = utf8_decode_buf(text, count, decoded, 70);
+			unit_count = to_units(decoded, k, units + 100);
+			memset(back, 0x55, 512);
+			ASSERT(utf8_to_utf16(text, count, back, cap) == unit_count);
+			r = cap < unit_count ? cap : unit_count;
+			if (r > 0 && r < unit_count && units[100 + r - 1] >= 0xD800 && units[100 + r - 1] <= 0xDBFF)
+				r--;
+			ASSERT(memcmp(back, units + 100, r * sizeof(unsigned short)) == 0 && back[r] == 0x5555);
+		}
+		// UTF-8 of the characters, with surrogates in 3 bytes each, goes to the same units as get_utf8 decodes it.
+		{
+			int decoded[70];
+			size_t k;
+			len = utf8_encode_buf(chars, count, expected, ALL);
+			k = utf8_decode_buf(expected, len, decoded, 70);
+			unit_count = to_units(decoded, k, units + 100);
+			ASSERT(utf8_to_utf16(expected, len, back, ALL) == unit_count);
+			ASSERT(memcmp(back, units + 100, unit_count * sizeof(unsigned short)) == 0);
+		}
+	}
+	free(chars);
+	free(units);
+	free(back);
+	free(text);
+	free(expected);
+}
+
+#endif //TESTS
@@ -1,3 +1,5 @@
+#include <stddef.h>
+
 //
 // Decodes a single unicode symbol from the sequence of bytes containing UTF-8 character representation.
 // Also decodes utf16 surrogate pairs if they are transcoded by utf16->utf8 converter.
@@ -22,13 +24,89 @@ int get_utf8(int (*get_fn)(void *context), void *get_fn_context);
 //
 int put_utf8(int character, int (*put_fn)(int ch, void *context), void *put_fn_context);
 
+//
+// Decodes the next character of [*src, end) as get_utf8 does, advancing *src past it.
+// Returns -1 at the end of the input.
+// Usage example: for (p = text; (c = get_utf8_from(&p, text + len)) >= 0;) ...
+//
+int get_utf8_from(const char **src, const char *end);
 
+//
+// Decodes len bytes of UTF-8 from src as repeated get_utf8 calls do: ill-formed sequences are skipped,
+// encoded utf16 surrogate pairs are joined, and a sequence cut by the end of src is dropped.
+// A zero byte is decoded as character 0 instead of stopping.
+// Stores at most cap characters to dst (may be NULL if cap is 0).
+// Returns the number of characters in the whole text, which is more than cap if dst was too small.
+// Usage example:
+//    int *chars = malloc(utf8_decoded_size(text, len) * sizeof(int));
+//    size_t n = utf8_decode_buf(text, len, chars, utf8_decoded_size(text, len));
+//
+size_t utf8_decode_buf(const char *src, size_t len, int *dst, size_t cap);
+
+//
+// Encodes n characters from src to UTF-8 as repeated put_utf8 calls do, skipping characters out of 0..0x10ffff.
+// Stores at most cap bytes to dst (may be NULL if cap is 0), never splitting a character.
+// Returns the number of bytes of the whole text, which is more than cap if dst was too small.
+//
+size_t utf8_encode_buf(const int *src, size_t n, char *dst, size_t cap);
 
+//
+// Return the exact number of characters utf8_decode_buf and bytes utf8_encode_buf produce.
+//
+size_t utf8_decoded_size(const char *src, size_t len);
+size_t utf8_encoded_size(const int *src, size_t n);
 
+struct utf8_decoder {
+	int value;          // bits of the lead byte and the continuation bytes received so far
+	int pending;        // continuation bytes still expected, 0 between characters
+	int high_surrogate; // decoded high surrogate waiting for the low one, 0 if none
+};
 
+//
+// Decodes UTF-8 coming in chunks, e.g. from recv, without joining them.
+// A sequence or a surrogate pair split between chunks is kept in the decoder state.
+// Decodes the chunk [*src, end) advancing *src, stores at most cap characters to dst and returns their number.
+// If dst is full before the chunk ends, *src is left at the rest of it, call again to continue.
+// All chunks together decode exactly as utf8_decode_buf decodes their concatenation.
+// Start with a zeroed decoder, a sequence left incomplete at the end of the stream is dropped.
+// Sample:
+//    struct utf8_decoder d = {0};
+//    while ((n = recv(s, buf, sizeof(buf), 0)) > 0)
+//      for (p = buf; p != buf + n;)
+//        handle(chars, utf8_decoder_feed(&d, &p, buf + n, chars, 256));
+//
+size_t utf8_decoder_feed(struct utf8_decoder *decoder, const char **src, const char *end, int *dst, size_t cap);
 
+//
+// Checks that src[0..len) is well-formed UTF-8: no stray continuation bytes, overlong encodings,
+// characters above 0x10ffff or sequences cut short. Encoded utf16 surrogates (0xD800..0xDFFF),
+// which get_utf8 joins into pairs, are accepted only if allow_surrogates is not 0.
+// Returns len if the text is valid, or the offset of the first byte of the first ill-formed sequence.
+// Vectorized with SSSE3 or AVX2 if the compiler targets them, skipping ASCII 64 bytes at a time.
+//
+size_t utf8_validate(const char *src, size_t len, int allow_surrogates);
 
 
+
+
+
+
+
+
+#include <string.h>
+
+#include "instrument.h"
+
+static int utf8_length(int v)
+{
+	return
+		v < 0 ? 0 :
+		v <= 0x7f ? 1 :
+		v <= 0x7ff ? 2 :
+		v <= 0xffff ? 3 :
+		v <= 0x10ffff ? 4 : 0;
+}
+
 static int get_utf8_no_surrogates(int (*get_fn)(void *context), void *get_fn_context)
 {
 	int r, n;
@@ -58,7 +136,7 @@ restart:
 	return r;
 }
 
-int get_utf8(int (*get_fn)(void *context), void *get_fn_context)
+static int get_joined_utf8(int (*get_fn)(void *context), void *get_fn_context)
 {
 	int r = get_utf8_no_surrogates(get_fn, get_fn_context);
 	for (;;) {
@@ -76,7 +154,46 @@ int get_utf8(int (*get_fn)(void *context), void *get_fn_context)
 	}
 }
 
-int put_utf8(int v, int (*put_fn)(int ch, void *context), void *put_fn_context)
+#ifdef CONFIG_INSTRUMENT
+
+// Counts the bytes get_utf8 reads, the skipped ill-formed ones included.
+struct counting_source {
+	int (*get_fn)(void *context);
+	void *context;
+	unsigned long long bytes;
+};
+
+static int counting_get(void *context)
+{
+	struct counting_source *s = (struct counting_source *) context;
+	int c = s->get_fn(s->context);
+	s->bytes += c >= 0;
+	return c;
+}
+
+int get_utf8(int (*get_fn)(void *context), void *get_fn_context)
+{
+	struct counting_source s;
+	int r;
+	INSTRUMENT_START(start);
+	s.get_fn = get_fn;
+	s.context = get_fn_context;
+	s.bytes = 0;
+	r = get_joined_utf8(counting_get, &s);
+	INSTRUMENT_STOP(INSTRUMENT_GET_UTF8, start, s.bytes);
+	return r;
+}
+
+#else
+
+int get_utf8(int (*get_fn)(void *context), void *get_fn_context)
+{
+	return get_joined_utf8(get_fn, get_fn_context);
+}
+
+#endif
+
+static int put_utf8_bytes(int v, int (*put_fn)(int ch, void *context), void *put_fn_context)
 {
 	if (v <= 0x7f)
 		return put_fn(v, put_fn_context);
@@ -104,9 +221,492 @@ int put_utf8(int v, int (*put_fn)(int ch, void *context), void *put_fn_context)
 	}
 }
 
+int put_utf8(int v, int (*put_fn)(int ch, void *context), void *put_fn_context)
+{
+	int r;
+	INSTRUMENT_START(start);
+	r = put_utf8_bytes(v, put_fn, put_fn_context);
+	INSTRUMENT_STOP(INSTRUMENT_PUT_UTF8, start, utf8_length(v));
+	return r;
+}
+
+//
+// Decodes the next character of [*p, end) as get_utf8_no_surrogates does. Returns -1 at the end.
+//
+static int next_utf8(const unsigned char **p, const unsigned char *end)
+{
+	const unsigned char *s = *p;
+	int r, n;
+restart_and_reload:
+	if (s == end) {
+		*p = s;
+		return -1;
+	}
+	r = *s++;
+restart:
+	if (r < 0x80) {
+		*p = s;
+		return r;
+	}
+	if ((r & 0xe0) == 0xc0) n = 2, r &= 0x1f;
+	else if ((r & 0xf0) == 0xe0) n = 3, r &= 0xf;
+	else if ((r & 0xf8) == 0xf0) n = 4, r &= 7;
+	else
+		goto restart_and_reload;
+	while (--n) {
+		int c;
+		if (s == end) {
+			*p = s;
+			return -1;
+		}
+		c = *s++;
+		if ((c & 0xc0) != 0x80) {
+			r = c;
+			goto restart;
+		}
+		r = r << 6 | (c & 0x3f);
+	}
+	*p = s;
+	return r;
+}
+
+//
+// Decodes the next character of [*p, end) as get_utf8 does. Returns -1 at the end,
+// storing to *high a high surrogate that the end cut from its pair, or 0.
+//
+static int next_char(const unsigned char **p, const unsigned char *end, int *high)
+{
+	int r = next_utf8(p, end);
+	*high = 0;
+	for (;;) {
+		if (r < 0xD800 || r > 0xDFFF)
+			return r;
+		else if (r > 0xDBFF) // second part without first
+			r = next_utf8(p, end);
+		else {
+			int low_part = next_utf8(p, end);
+			if (low_part < 0xDC00 || low_part > 0xDFFF) {
+				if (low_part < 0)
+					*high = r;
+				r = low_part; // bad second part, restart
+			} else
+				return ((r & 0x3ff) << 10 | (low_part & 0x3ff)) + 0x10000;
+		}
+	}
+}
+
+int get_utf8_from(const char **src, const char *end)
+{
+	int high;
+	return next_char((const unsigned char **) src, (const unsigned char *) end, &high);
+}
+
+//
+// Decodes [*src, end) to dst as get_utf8_from calls do, advancing *src.
+// If count_all, counts the characters not fitting in cap, otherwise stops when dst is full.
+// Stores to *high a high surrogate left unpaired at the end, or 0.
+//
+static size_t decode_utf8(const unsigned char **src, const unsigned char *end, int *dst, size_t cap, int count_all, int *high)
+{
+	const unsigned char *p = *src;
+	size_t n = 0;
+	*high = 0;
+	for (;;) {
+		int r;
+		if (n >= cap && !count_all)
+			break;
+		// ASCII goes 8 bytes at a time.
+		while (end - p >= 8 && (n >= cap || cap - n >= 8)) {
+			unsigned long long w;
+			memcpy(&w, p, 8);
+			if (w & 0x8080808080808080ULL)
+				break;
+			if (n < cap) {
+				int i = 0;
+				for (; i < 8; i++)
+					dst[n + i] = p[i];
+			}
+			p += 8;
+			n += 8;
+		}
+		// Well-formed 2 and 3 byte characters, except surrogates, without the general decoder.
+		if (end - p >= 3 && (p[1] & 0xc0) == 0x80) {
+			if ((p[0] & 0xe0) == 0xc0) {
+				if (n < cap)
+					dst[n] = (p[0] & 0x1f) << 6 | (p[1] & 0x3f);
+				n++;
+				p += 2;
+				continue;
+			}
+			if ((p[0] & 0xf0) == 0xe0 && (p[2] & 0xc0) == 0x80 && p[0] != 0xed) {
+				if (n < cap)
+					dst[n] = (p[0] & 0xf) << 12 | (p[1] & 0x3f) << 6 | (p[2] & 0x3f);
+				n++;
+				p += 3;
+				continue;
+			}
+		}
+		r = next_char(&p, end, high);
+		if (r < 0)
+			break;
+		if (n < cap)
+			dst[n] = r;
+		n++;
+	}
+	*src = p;
+	return n;
+}
+
+size_t utf8_decode_buf(const char *src, size_t len, int *dst, size_t cap)
+{
+	const unsigned char *p = (const unsigned char *) src;
+	int high;
+	return decode_utf8(&p, p + len, dst, cap, 1, &high);
+}
+
+size_t utf8_decoded_size(const char *src, size_t len)
+{
+	return utf8_decode_buf(src, len, NULL, 0);
+}
+
+//
+// Pushes one byte through the get_utf8 state machine, returns the decoded character or -1 if there is none yet.
+//
+static int push_utf8(struct utf8_decoder *d, int b)
+{
+	int r = b;
+	if (d->pending && (b & 0xc0) == 0x80) {
+		d->value = d->value << 6 | (b & 0x3f);
+		if (--d->pending)
+			return -1;
+		r = d->value;
+	} else {
+		d->pending = 0; // not a continuation, restart from this byte
+		if (b >= 0x80) {
+			if ((b & 0xe0) == 0xc0) d->pending = 1, d->value = b & 0x1f;
+			else if ((b & 0xf0) == 0xe0) d->pending = 2, d->value = b & 0xf;
+			else if ((b & 0xf8) == 0xf0) d->pending = 3, d->value = b & 7;
+			return -1;
+		}
+	}
+	if (d->high_surrogate) {
+		int high = d->high_surrogate;
+		d->high_surrogate = 0;
+		if (r >= 0xDC00 && r <= 0xDFFF)
+			return ((high & 0x3ff) << 10 | (r & 0x3ff)) + 0x10000;
+	}
+	if (r < 0xD800 || r > 0xDFFF)
+		return r;
+	if (r <= 0xDBFF)
+		d->high_surrogate = r;
+	return -1;
+}
+
+//
+// Returns the end of [p, end) without a sequence cut by the end.
+// A lead byte always starts a new sequence, so only the last one can be incomplete.
+//
+static const unsigned char *complete_part(const unsigned char *p, const unsigned char *end)
+{
+	const unsigned char *q = end;
+	while (q != p && end - q < 4 && (q[-1] & 0xc0) == 0x80)
+		q--;
+	if (q != p && q[-1] >= 0xc0) {
+		int b = q[-1];
+		int n = (b & 0xe0) == 0xc0 ? 2 : (b & 0xf0) == 0xe0 ? 3 : (b & 0xf8) == 0xf0 ? 4 : 0;
+		if (end - (q - 1) < n)
+			return q - 1;
+	}
+	return end;
+}
+
+size_t utf8_decoder_feed(struct utf8_decoder *d, const char **src, const char *end, int *dst, size_t cap)
+{
+	const unsigned char *p = (const unsigned char *) *src;
+	const unsigned char *e = (const unsigned char *) end;
+	size_t n = 0;
+	while (n < cap && p != e) {
+		if (!d->pending && !d->high_surrogate) {
+			const unsigned char *complete = complete_part(p, e);
+			if (p != complete) {
+				n += decode_utf8(&p, complete, dst + n, cap - n, 0, &d->high_surrogate);
+				continue;
+			}
+		}
+		{
+			int r = push_utf8(d, *p++);
+			if (r >= 0)
+				dst[n++] = r;
+		}
+	}
+	*src = (const char *) p;
+	return n;
+}
+
+size_t utf8_encode_buf(const int *src, size_t n, char *dst, size_t cap)
+{
+	const int *end = src + n;
+	unsigned char *d = (unsigned char *) dst;
+	size_t r = 0;
+	for (; src != end; src++) {
+		int v = *src;
+		int length = utf8_length(v);
+		if (r + length > cap) {
+			// Only whole characters of the beginning of the text.
+			cap = 0;
+			r += length;
+			continue;
+		}
+		switch (length) {
+		case 1:
+			d[r] = (unsigned char) v;
+			break;
+		case 2:
+			d[r] = (unsigned char) (v >> 6 | 0xc0);
+			d[r + 1] = (unsigned char) ((v & 0x3f) | 0x80);
+			break;
+		case 3:
+			d[r] = (unsigned char) (v >> (6 + 6) | 0xe0);
+			d[r + 1] = (unsigned char) (((v >> 6) & 0x3f) | 0x80);
+			d[r + 2] = (unsigned char) ((v & 0x3f) | 0x80);
+			break;
+		case 4:
+			d[r] = (unsigned char) (v >> (6 + 6 + 6) | 0xf0);
+			d[r + 1] = (unsigned char) (((v >> (6 + 6)) & 0x3f) | 0x80);
+			d[r + 2] = (unsigned char) (((v >> 6) & 0x3f) | 0x80);
+			d[r + 3] = (unsigned char) ((v & 0x3f) | 0x80);
+			break;
+		}
+		r += length;
+	}
+	return r;
+}
+
+size_t utf8_encoded_size(const int *src, size_t n)
+{
+	size_t r = 0;
+	size_t i = 0;
+	for (; i < n; i++)
+		r += utf8_length(src[i]);
+	return r;
+}
+
+// Validates from i, which must be at a character boundary.
+static size_t validate_utf8_from(const unsigned char *s, size_t i, size_t len, int allow_surrogates)
+{
+	while (i < len) {
+		int c = s[i], n, k;
+		unsigned char low = 0x80, high = 0xbf;
+		if (c < 0x80) {
+			unsigned long long w;
+			if (len - i >= 8 && (memcpy(&w, s + i, 8), !(w & 0x8080808080808080ULL)))
+				i += 8;
+			else
+				i++;
+			continue;
+		}
+		n = c >= 0xc2 && c <= 0xdf ? 2 : c >= 0xe0 && c <= 0xef ? 3 : c >= 0xf0 && c <= 0xf4 ? 4 : 0;
+		if (!n || len - i < (size_t) n)
+			return i;
+		if (c == 0xe0) low = 0xa0;
+		else if (c == 0xed && !allow_surrogates) high = 0x9f;
+		else if (c == 0xf0) low = 0x90;
+		else if (c == 0xf4) high = 0x8f;
+		if (s[i + 1] < low || s[i + 1] > high)
+			return i;
+		for (k = 2; k < n; k++) {
+			if ((s[i + k] & 0xc0) != 0x80)
+				return i;
+		}
+		i += n;
+	}
+	return len;
+}
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UTF8_AVX2
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define UTF8_SSSE3
+#endif
+
+#if defined(UTF8_AVX2) || defined(UTF8_SSSE3)
+
+// Returns the first character boundary at or after i - 3, given the text before i is valid.
+static size_t boundary_before(const unsigned char *s, size_t i)
+{
+	size_t j = i < 3 ? 0 : i - 3;
+	while (j < i && (s[j] & 0xc0) == 0x80)
+		j++;
+	return j;
+}
+
+//
+// The lookup validation of Keiser and Lemire: each pair of adjacent bytes is classified by
+// three 16 entry tables indexed by the high and low nibbles of the first byte and the high nibble of the second,
+// their AND is nonzero for invalid pairs, except for continuations the 3 and 4 byte sequences require,
+// which are checked by the positions of the preceding lead bytes.
+//
+enum {
+	TOO_SHORT = 1 << 0,   // a lead byte or ASCII after a lead byte
+	TOO_LONG = 1 << 1,    // a continuation after ASCII
+	OVERLONG_3 = 1 << 2,  // e0 80..9f
+	TOO_LARGE = 1 << 3,   // f4 90..bf, f5..ff
+	SURROGATE = 1 << 4,   // ed a0..bf
+	OVERLONG_2 = 1 << 5,  // c0..c1
+	TOO_LARGE_1000 = 1 << 6,  // f5..ff 80..8f
+	OVERLONG_4 = 1 << 6,  // f0 80..8f
+	TWO_CONTS = 1 << 7,   // a continuation after a continuation, valid only inside 3 and 4 byte sequences
+	CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS
+};
+
+#define UTF8_TABLES(allow_surrogates) \
+	const char byte_1_high[16] = { \
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+		(char) TWO_CONTS, (char) TWO_CONTS, (char) TWO_CONTS, (char) TWO_CONTS, \
+		TOO_SHORT | OVERLONG_2, \
+		TOO_SHORT, \
+		(char) (TOO_SHORT | OVERLONG_3 | (allow_surrogates ? 0 : SURROGATE)), \
+		TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4 }; \
+	const char byte_1_low[16] = { \
+		(char) (CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4), \
+		(char) (CARRY | OVERLONG_2), \
+		(char) CARRY, (char) CARRY, \
+		(char) (CARRY | TOO_LARGE), \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), (char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), (char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), (char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), (char) (CARRY | TOO_LARGE | TOO_LARGE_1000), \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE), \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000), (char) (CARRY | TOO_LARGE | TOO_LARGE_1000) }; \
+	const char byte_2_high[16] = { \
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+		(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4), \
+		(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE), \
+		(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE), \
+		(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE), \
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT }; \
+	/* Lead bytes in the last 3 positions, which need the next block. */ \
+	const char incomplete[16] = { \
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char) 0xf0 - 1, (char) 0xe0 - 1, (char) 0xc0 - 1 }
+
+#endif
+
+#ifdef UTF8_AVX2
+
+// The errors of a 32 byte block, prev is the previous block.
+static __m256i check_utf8_block(__m256i input, __m256i prev, __m256i t1h, __m256i t1l, __m256i t2h)
+{
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	__m256i shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+	__m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+	__m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+	__m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+	__m256i special = _mm256_and_si256(_mm256_and_si256(
+		_mm256_shuffle_epi8(t1h, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+		_mm256_shuffle_epi8(t1l, _mm256_and_si256(prev1, nibble))),
+		_mm256_shuffle_epi8(t2h, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+	__m256i must_23 = _mm256_or_si256(
+		_mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xe0 - 0x80))),
+		_mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xf0 - 0x80))));
+	return _mm256_xor_si256(_mm256_and_si256(must_23, _mm256_set1_epi8((char) 0x80)), special);
+}
+
+size_t utf8_validate(const char *src, size_t len, int allow_surrogates)
+{
+	const unsigned char *s = (const unsigned char *) src;
+	UTF8_TABLES(allow_surrogates);
+	const __m256i t1h = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) byte_1_high));
+	const __m256i t1l = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) byte_1_low));
+	const __m256i t2h = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) byte_2_high));
+	const __m256i max = _mm256_inserti128_si256(_mm256_set1_epi8(-1), _mm_loadu_si128((const __m128i *) incomplete), 1);
+	__m256i prev = _mm256_setzero_si256();
+	__m256i prev_incomplete = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; len - i >= 64; i += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (s + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (s + i + 32));
+		__m256i error;
+		if (!_mm256_movemask_epi8(_mm256_or_si256(a, b))) {
+			if (!_mm256_testz_si256(prev_incomplete, prev_incomplete))
+				break;
+			prev = b;
+			continue;
+		}
+		error = _mm256_or_si256(check_utf8_block(a, prev, t1h, t1l, t2h), check_utf8_block(b, a, t1h, t1l, t2h));
+		if (!_mm256_testz_si256(error, error))
+			break;
+		prev = b;
+		prev_incomplete = _mm256_subs_epu8(b, max);
+	}
+	return validate_utf8_from(s, boundary_before(s, i), len, allow_surrogates);
+}
+
+#elif defined(UTF8_SSSE3)
+
+// The errors of a 16 byte block, prev is the previous block.
+static __m128i check_utf8_block(__m128i input, __m128i prev, __m128i t1h, __m128i t1l, __m128i t2h)
+{
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+	__m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+	__m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+	__m128i special = _mm_and_si128(_mm_and_si128(
+		_mm_shuffle_epi8(t1h, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+		_mm_shuffle_epi8(t1l, _mm_and_si128(prev1, nibble))),
+		_mm_shuffle_epi8(t2h, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+	__m128i must_23 = _mm_or_si128(
+		_mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xe0 - 0x80))),
+		_mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xf0 - 0x80))));
+	return _mm_xor_si128(_mm_and_si128(must_23, _mm_set1_epi8((char) 0x80)), special);
+}
+
+size_t utf8_validate(const char *src, size_t len, int allow_surrogates)
+{
+	const unsigned char *s = (const unsigned char *) src;
+	UTF8_TABLES(allow_surrogates);
+	const __m128i t1h = _mm_loadu_si128((const __m128i *) byte_1_high);
+	const __m128i t1l = _mm_loadu_si128((const __m128i *) byte_1_low);
+	const __m128i t2h = _mm_loadu_si128((const __m128i *) byte_2_high);
+	const __m128i max = _mm_loadu_si128((const __m128i *) incomplete);
+	__m128i prev = _mm_setzero_si128();
+	__m128i prev_incomplete = _mm_setzero_si128();
+	size_t i = 0;
+	for (; len - i >= 64; i += 64) {
+		__m128i b0 = _mm_loadu_si128((const __m128i *) (s + i));
+		__m128i b1 = _mm_loadu_si128((const __m128i *) (s + i + 16));
+		__m128i b2 = _mm_loadu_si128((const __m128i *) (s + i + 32));
+		__m128i b3 = _mm_loadu_si128((const __m128i *) (s + i + 48));
+		__m128i error;
+		if (!_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(b0, b1), _mm_or_si128(b2, b3)))) {
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(prev_incomplete, _mm_setzero_si128())) != 0xffff)
+				break;
+			prev = b3;
+			continue;
+		}
+		error = _mm_or_si128(
+			_mm_or_si128(check_utf8_block(b0, prev, t1h, t1l, t2h), check_utf8_block(b1, b0, t1h, t1l, t2h)),
+			_mm_or_si128(check_utf8_block(b2, b1, t1h, t1l, t2h), check_utf8_block(b3, b2, t1h, t1l, t2h)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xffff)
+			break;
+		prev = b3;
+		prev_incomplete = _mm_subs_epu8(b3, max);
+	}
+	return validate_utf8_from(s, boundary_before(s, i), len, allow_surrogates);
+}
+
+#else
+
+size_t utf8_validate(const char *src, size_t len, int allow_surrogates)
+{
+	return validate_utf8_from((const unsigned char *) src, 0, len, allow_surrogates);
+}
+
+#endif
+
 #ifdef TESTS
 
-#include <string.h>
 #include <stdlib.h>
 
 void fail(const char* msg);
@@ -142,6 +742,192 @@ static void test_surrogate(int a, int b, int r) {
 	ASSERT(get_utf8(get_c, &p) == r);
 }
 
+static int get_limited(void *context) {
+	const unsigned char **p = (const unsigned char **) context;
+	return p[0] == p[1] ? -1 : *p[0]++;
+}
+
+// Random ill-formed text, lone and paired surrogates, decoded in bulk and by get_utf8.
+static void bulk_tests()
+{
+	static const unsigned char bytes[] = {
+		'a', 0x7f, 0x80, 0xbf, 0xc0, 0xc2, 0xdf, 0xe0, 0xe2, 0xed, 0xef, 0xf0, 0xf4, 0xf7, 0xf8, 0xff };
+	static const int chars[] = { 0, 0x41, 0x7f, 0x80, 0x7ff, 0x800, 0xD800, 0xDBFF, 0xDC00, 0xDFFF, 0xfffd, 0x10000, 0x10ffff, 0x110000, -1 };
+	unsigned char text[64];
+	char encoded[512];
+	int decoded[64], expected[64], cs[64];
+	int round, i, n, len;
+	unsigned int seed = 1;
+	for (round = 0; round < 100000; round++) {
+		const unsigned char *limits[2];
+		len = round % 40;
+		for (i = 0; i < len; i++) {
+			seed = seed * 1103515245 + 12345;
+			text[i] = round % 3 == 0 ? (unsigned char) (seed >> 16) : bytes[(seed >> 16) % sizeof(bytes)];
+			if (text[i] == 0)
+				text[i] = 1;
+		}
+		limits[0] = text;
+		limits[1] = text + len;
+		for (n = 0; n < 64; n++) {
+			int c = get_utf8(get_limited, limits);
+			if (c < 0)
+				break;
+			expected[n] = c;
+		}
+		ASSERT(utf8_decoded_size((char *) text, len) == (size_t) n);
+		ASSERT(utf8_decode_buf((char *) text, len, decoded, 64) == (size_t) n);
+		ASSERT(memcmp(decoded, expected, n * sizeof(int)) == 0);
+		if (n > 0) {
+			decoded[n - 1] = -5;
+			ASSERT(utf8_decode_buf((char *) text, len, decoded, n - 1) == (size_t) n && decoded[n - 1] == -5);
+		}
+
+		for (i = 0; i < len; i++) {
+			seed = seed * 1103515245 + 12345;
+			cs[i] = round % 2 ? chars[(seed >> 16) % (sizeof(chars) / sizeof(int))] : (int) (seed >> 11) % 0x110000;
+		}
+		{
+			char *p = encoded;
+			int length;
+			for (i = 0; i < len; i++) {
+				if (cs[i] >= 0)
+					put_utf8(cs[i], put_c, &p);
+			}
+			length = (int) (p - encoded);
+			ASSERT(utf8_encoded_size(cs, len) == (size_t) length);
+			ASSERT(utf8_encode_buf(cs, len, encoded + 256, 256) == (size_t) length);
+			ASSERT(memcmp(encoded, encoded + 256, length) == 0);
+			if (length > 2) {
+				int whole = 0;
+				for (i = 0; i < len && whole + utf8_length(cs[i]) <= length - 2; i++)
+					whole += utf8_length(cs[i]);
+				memset(encoded + 256, 0x55, 256);
+				ASSERT(utf8_encode_buf(cs, len, encoded + 256, length - 2) == (size_t) length);
+				ASSERT(memcmp(encoded, encoded + 256, whole) == 0 && encoded[256 + whole] == 0x55);
+			}
+		}
+	}
+
+	{
+		// Long ASCII runs around multibyte characters and the 8 byte blocks.
+		const char *mixed = "0123456789abcdef\xc3\xa9 0123456789\xe2\x82\xac" "012345678";
+		int out[64];
+		len = (int) strlen(mixed);
+		ASSERT(utf8_decode_buf(mixed, len, out, 64) == (size_t) len - 3);
+		ASSERT(out[15] == 'f' && out[16] == 0xe9 && out[17] == ' ' && out[28] == 0x20ac && out[37] == '8');
+		ASSERT(utf8_decode_buf(mixed, len, out, 5) == (size_t) len - 3 && out[4] == '4');
+		ASSERT(utf8_decode_buf("a\0b", 3, out, 64) == 3 && out[1] == 0);
+	}
+}
+
+// Random texts fed in random chunks to random output sizes decode as one buffer.
+static void decoder_tests()
+{
+	static const unsigned char bytes[] = {
+		'a', 0, 0x80, 0x9f, 0xa0, 0xb0, 0xbf, 0xc2, 0xdf, 0xe0, 0xe2, 0xed, 0xef, 0xf0, 0xf4, 0xf7, 0xf8 };
+	unsigned char text[200];
+	int expected[200], decoded[200];
+	unsigned int seed = 3;
+	int round, i;
+	for (round = 0; round < 20000; round++) {
+		struct utf8_decoder d = {0};
+		size_t len = round % 200, expected_n, n = 0, at = 0;
+		for (i = 0; i < (int) len; i++) {
+			seed = seed * 1103515245 + 12345;
+			text[i] = bytes[(seed >> 16) % sizeof(bytes)];
+		}
+		expected_n = utf8_decode_buf((char *) text, len, expected, 200);
+		while (at < len) {
+			const char *p = (char *) text + at;
+			const char *end;
+			size_t cap;
+			seed = seed * 1103515245 + 12345;
+			end = p + (seed >> 16) % (len - at + 1);
+			cap = round % 2 ? 200 - n : (seed >> 8) % 4;
+			n += utf8_decoder_feed(&d, &p, end, decoded + n, cap);
+			ASSERT(p == end || n == 200 || cap < 4);
+			at = p - (char *) text;
+		}
+		ASSERT(n == expected_n && memcmp(decoded, expected, n * sizeof(int)) == 0);
+	}
+	{
+		// A surrogate pair byte by byte.
+		struct utf8_decoder d = {0};
+		const char *pair = "\xed\xa0\x81\xed\xb0\x80!", *p = pair;
+		int c[2];
+		for (i = 0; i < 6; i++)
+			ASSERT(utf8_decoder_feed(&d, &p, p + 1, c, 2) == (size_t) (i == 5));
+		ASSERT(c[0] == 0x10400 && d.pending == 0 && d.high_surrogate == 0);
+		ASSERT(utf8_decoder_feed(&d, &p, p + 1, c, 0) == 0 && p == pair + 6);
+	}
+}
+
+static void validate_tests()
+{
+	static const char *chars[] = {
+		"a", "\x7f", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xe2\x82\xac", "\xed\x9f\xbf", "\xed\xa0\x80", "\xed\xbf\xbf",
+		"\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf",
+		// ill-formed
+		"\x80", "\xbf", "\xc0\x80", "\xc1\xbf", "\xe0\x9f\xbf", "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80",
+		"\xf5\x80\x80\x80", "\xff", "\xc2", "\xe2\x82", "\xf0\x90\x80", "\xc2\xc2\x80", "\xe2\x82\x82\x82" };
+	char text[300];
+	unsigned int seed = 7;
+	int round;
+	ASSERT(utf8_validate("abc\xc3\xa9", 5, 0) == 5);
+	ASSERT(utf8_validate("\xc0\x80", 2, 0) == 0);
+	ASSERT(utf8_validate("\xed\xa0\x80", 3, 0) == 0);
+	ASSERT(utf8_validate("\xed\xa0\x80", 3, 1) == 3);
+	ASSERT(utf8_validate("a\xf0\x9f\x98", 4, 0) == 1);
+	ASSERT(utf8_validate("ab\x80", 3, 0) == 2);
+	ASSERT(utf8_validate("", 0, 0) == 0);
+	for (round = 0; round < 20000; round++) {
+		// Long valid runs of one script with rare errors, around the 64 byte blocks.
+		size_t len = 0, expected[2] = {(size_t) -1, (size_t) -1};
+		int script = round % 4, k;
+		while (len < sizeof(text) - 4) {
+			const char *c;
+			size_t n;
+			seed = seed * 1103515245 + 12345;
+			c = (seed >> 16) % 100 ? chars[script == 0 ? 0 : script == 1 ? 3 : script == 2 ? 5 : (seed >> 8) % 12] : chars[(seed >> 8) % 26];
+			n = strlen(c);
+			if (len + n > sizeof(text) - 4 - round % 64)
+				break;
+			memcpy(text + len, c, n);
+			len += n;
+		}
+		for (k = 0; k < 2; k++) {
+			expected[k] = validate_utf8_from((const unsigned char *) text, 0, len, k);
+			ASSERT(utf8_validate(text, len, k) == expected[k]);
+		}
+		// The validator agrees with get_utf8 on valid text.
+		if (expected[1] == len) {
+			int decoded[300];
+			size_t n = utf8_decode_buf(text, len, decoded, 300), i;
+			char encoded[1200];
+			for (i = 0; i < n; i++)
+				ASSERT(decoded[i] <= 0x10ffff);
+			ASSERT(utf8_encode_buf(decoded, n, encoded, sizeof(encoded)) <= len);
+		}
+	}
+	for (round = 0; round < 26; round++) {
+		// Every sequence at every position of an ASCII text.
+		size_t n = strlen(chars[round]), at;
+		for (at = 0; at < 140; at++) {
+			// The last one is a valid character and a stray continuation.
+			size_t expected = round < 12 ? 200 : round == 25 ? at + 3 : at;
+			memset(text, 'x', 200);
+			memcpy(text + at, chars[round], n);
+			if (round == 7 || round == 8) {
+				ASSERT(utf8_validate(text, 200, 0) == at);
+				ASSERT(utf8_validate(text, 200, 1) == 200);
+			} else
+				ASSERT(utf8_validate(text, 200, 0) == expected);
+			ASSERT(utf8_validate(text, at + n, 1) == (round < 12 ? at + n : expected));
+		}
+	}
+}
+
 void utf8_tests()
 {
 	test_both_ways(0x24, "\x24");
@@ -150,6 +936,9 @@ void utf8_tests()
 	test_both_ways(0x10348, "\xf0\x90\x8d\x88");
 	test_surrogate(0xD800, 0xDC00,  0x10000);
 	test_surrogate(0xDBFF, 0xDFFF, 0x10ffff);
+	bulk_tests();
+	decoder_tests();
+	validate_tests();
 }
 
 #endif //TESTS
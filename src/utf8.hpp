@@ -0,0 +1,139 @@
+#ifndef UTF8_HPP
+#define UTF8_HPP
+
+#include <type_traits>
+#include <utility>
+
+//
+// Inlinable C++20 versions of get_utf8 and put_utf8 from utf8.c.
+// They run the same state machine: ill-formed sequences are skipped and encoded utf16 surrogate pairs are joined.
+// The byte source and sink are template parameters, so for pointers and back-inserters nothing is called indirectly.
+//
+// get_utf8(source) decodes one character, the source is advanced past it. The source is:
+//   - a callable returning the next byte as int, 0 or negative stops decoding and is returned, as get_fn of get_utf8,
+//   - a std::pair of iterators [first, second), first is advanced, -1 is returned at the end,
+//   - an iterator or a pointer, 0 byte stops decoding and is returned.
+// put_utf8(character, sink) encodes one character in 0..0x10ffff, returns 0 for characters above. The sink is:
+//   - a callable taking a byte, if it returns int <= 0 encoding stops and put_utf8 returns it, as put_fn of put_utf8,
+//   - an output iterator or a pointer, put_utf8 returns 1.
+// Sample:
+//    std::pair<const char*, const char*> in(text.data(), text.data() + text.size());
+//    std::string out;
+//    auto o = std::back_inserter(out);
+//    for (int c; (c = get_utf8(in)) >= 0;)
+//      put_utf8(towupper(c), o);
+//
+
+namespace utf8_detail {
+
+template <class S>
+concept iterator_range = requires(S s) {
+  s.first != s.second;
+  *s.first++;
+};
+
+template <class Source>
+inline int get_byte(Source& src) {
+  if constexpr (std::is_invocable_v<Source&>) {
+    return src();
+  } else if constexpr (iterator_range<Source>) {
+    if (src.first == src.second)
+      return -1;
+    return static_cast<unsigned char>(*src.first++);
+  } else {
+    return static_cast<unsigned char>(*src++);
+  }
+}
+
+template <class Sink>
+inline int put_byte(int b, Sink& sink) {
+  if constexpr (std::is_invocable_v<Sink&, int>) {
+    if constexpr (std::is_void_v<std::invoke_result_t<Sink&, int>>) {
+      sink(b);
+      return 1;
+    } else {
+      return sink(b);
+    }
+  } else {
+    *sink = static_cast<char>(b);
+    ++sink;
+    return 1;
+  }
+}
+
+template <class Source>
+inline int get_utf8_no_surrogates(Source& src) {
+  int r, n;
+restart_and_reload:
+  r = get_byte(src);
+restart:
+  n = 2;
+  if (r <= 0)
+    return r;
+  if ((r & 0x80) == 0)
+    return r;
+  if ((r & 0xe0) == 0xc0) r &= 0x1f;
+  else if ((r & 0xf0) == 0xe0) n = 3, r &= 0xf;
+  else if ((r & 0xf8) == 0xf0) n = 4, r &= 7;
+  else
+    goto restart_and_reload;
+  while (--n) {
+    int c = get_byte(src);
+    if ((c & 0xc0) != 0x80) {
+      if (c <= 0)
+        return c;
+      r = c;
+      goto restart;
+    }
+    r = r << 6 | (c & 0x3f);
+  }
+  return r;
+}
+
+}  // namespace utf8_detail
+
+template <class Source>
+inline int get_utf8(Source& src) {
+  int r = utf8_detail::get_utf8_no_surrogates(src);
+  for (;;) {
+    if (r < 0xD800 || r > 0xDFFF)
+      return r;
+    else if (r > 0xDBFF)  // second part without first
+      r = utf8_detail::get_utf8_no_surrogates(src);
+    else {
+      int low_part = utf8_detail::get_utf8_no_surrogates(src);
+      if (low_part < 0xDC00 || low_part > 0xDFFF)
+        r = low_part;  // bad second part, restart
+      else
+        return ((r & 0x3ff) << 10 | (low_part & 0x3ff)) + 0x10000;
+    }
+  }
+}
+
+template <class Sink>
+inline int put_utf8(int v, Sink& sink) {
+  using utf8_detail::put_byte;
+  if (v <= 0x7f)
+    return put_byte(v, sink);
+  int r;
+  if (v <= 0x7ff)
+    r = put_byte(v >> 6 | 0xc0, sink);
+  else {
+    if (v <= 0xffff)
+      r = put_byte(v >> (6 + 6) | 0xe0, sink);
+    else {
+      if (v > 0x10ffff)
+        return 0;
+      r = put_byte(v >> (6 + 6 + 6) | 0xf0, sink);
+      if (r > 0)
+        r = put_byte(((v >> (6 + 6)) & 0x3f) | 0x80, sink);
+    }
+    if (r > 0)
+      r = put_byte(((v >> 6) & 0x3f) | 0x80, sink);
+  }
+  if (r > 0)
+    r = put_byte((v & 0x3f) | 0x80, sink);
+  return r;
+}
+
+#endif  // UTF8_HPP
@@ -0,0 +1,342 @@
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Side index of a UTF-8 text mapping code point numbers to byte offsets and back in O(log n)
+// and a scan of at most one block, instead of decoding the text from the start.
+// Every byte except continuation bytes (10xxxxxx) starts a code point, as in well-formed text.
+// The text is split into blocks of block_size bytes (0 - 4096), the index keeps the byte and code point counts
+// of each block in Fenwick trees taking 2 * sizeof(size_t) per block, 16 bytes per 4K on 64 bits.
+// Bigger blocks make the index smaller and lookups slower.
+// The index doesn't keep the text, each call takes its current version.
+// Returns NULL if out of memory.
+// Sample:
+//    struct utf8_index *ix = utf8_index_build(text, len, 0);
+//    size_t from = utf8_index_offset(ix, text, i), to = utf8_index_offset(ix, text, j);
+//    ...replace 3 bytes at offset 10 with 5 bytes...
+//    utf8_index_update(ix, text, 10, 3, 5);
+//    utf8_index_free(ix);
+//
+struct utf8_index *utf8_index_build(const char *text, size_t len, size_t block_size);
+
+void utf8_index_free(struct utf8_index *index);
+
+//
+// Returns the byte offset of the code point number n, or the text length if n is past the end.
+//
+size_t utf8_index_offset(const struct utf8_index *index, const char *text, size_t n);
+
+//
+// Returns the number of code points starting before the byte offset.
+//
+size_t utf8_index_char(const struct utf8_index *index, const char *text, size_t offset);
+
+//
+// Returns the number of code points in the text.
+//
+size_t utf8_index_count(const struct utf8_index *index);
+
+//
+// Updates the index after the removed bytes at the offset were replaced by the inserted bytes in the text.
+// Only the blocks of the edit are recounted. A block grown four times larger by inserts makes the index
+// rebuild itself, if that runs out of memory, the index stays correct with a longer block.
+//
+void utf8_index_update(struct utf8_index *index, const char *text, size_t offset, size_t removed, size_t inserted);
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8_INDEX_SSE2
+#endif
+
+#define UTF8_INDEX_BLOCK 4096
+
+struct utf8_index {
+	size_t block_size;
+	size_t block_count;
+	size_t *bytes; // Fenwick trees of byte and code point counts of the blocks, 1-based
+	size_t *chars;
+};
+
+//
+// Counts the bytes of s[0..len) that are not continuation bytes.
+//
+static size_t count_chars(const unsigned char *s, size_t len)
+{
+	size_t r = 0, i = 0;
+#ifdef UTF8_INDEX_SSE2
+	// Continuation bytes are counted in byte lanes, summed every 255 blocks before they overflow.
+	const __m128i limit = _mm_set1_epi8(-0x40);
+	while (len - i >= 16) {
+		__m128i sum = _mm_setzero_si128();
+		size_t end = len - i >= 255 * 16 ? i + 255 * 16 : i + (len - i) / 16 * 16;
+		for (; i < end; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+			sum = _mm_sub_epi8(sum, _mm_cmplt_epi8(v, limit));
+		}
+		sum = _mm_sad_epu8(sum, _mm_setzero_si128());
+		r -= (size_t) _mm_cvtsi128_si32(sum) + (size_t) _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+	}
+	r += i;
+#endif
+	for (; i < len; i++)
+		r += (s[i] & 0xc0) != 0x80;
+	return r;
+}
+
+//
+// Returns the offset of the start of the code point number n in s[0..len), or len.
+//
+static size_t skip_chars(const unsigned char *s, size_t len, size_t n)
+{
+	size_t i = 0;
+#ifdef UTF8_INDEX_SSE2
+	const __m128i limit = _mm_set1_epi8(-0x40);
+	while (len - i >= 16) {
+		int continuations = _mm_movemask_epi8(_mm_cmplt_epi8(_mm_loadu_si128((const __m128i *) (s + i)), limit));
+		size_t starts = 16;
+		for (; continuations; continuations &= continuations - 1)
+			starts--;
+		if (starts > n)
+			break;
+		n -= starts;
+		i += 16;
+	}
+#endif
+	for (; i < len; i++) {
+		if ((s[i] & 0xc0) != 0x80 && n-- == 0)
+			break;
+	}
+	return i;
+}
+
+static size_t prefix_sum(const size_t *tree, size_t i)
+{
+	size_t r = 0;
+	for (; i; i &= i - 1)
+		r += tree[i];
+	return r;
+}
+
+static void tree_add(size_t *tree, size_t count, size_t i, size_t delta)
+{
+	for (i++; i <= count; i += i & (0 - i))
+		tree[i] += delta;
+}
+
+//
+// Finds the last block starting at or before the position by the tree,
+// stores its start in the units of the tree and of the other tree.
+//
+static size_t find_block(const struct utf8_index *index, const size_t *tree, const size_t *other,
+	size_t position, size_t *start, size_t *other_start)
+{
+	size_t i = 0, step = 1;
+	*start = *other_start = 0;
+	while (step * 2 <= index->block_count)
+		step *= 2;
+	for (; step; step /= 2) {
+		if (i + step <= index->block_count && *start + tree[i + step] <= position) {
+			i += step;
+			*start += tree[i];
+			*other_start += other[i];
+		}
+	}
+	if (i == index->block_count) {
+		// Past the end, the last block has it.
+		i--;
+		*start = prefix_sum(tree, i);
+		*other_start = prefix_sum(other, i);
+	}
+	return i;
+}
+
+//
+// Makes the Fenwick trees of the block counts stored one per element.
+//
+static void make_trees(struct utf8_index *index)
+{
+	size_t i;
+	for (i = 1; i <= index->block_count; i++) {
+		size_t parent = i + (i & (0 - i));
+		if (parent <= index->block_count) {
+			index->bytes[parent] += index->bytes[i];
+			index->chars[parent] += index->chars[i];
+		}
+	}
+}
+
+static int index_text(struct utf8_index *index, const char *text, size_t len)
+{
+	size_t count = len / index->block_size + 1, i;
+	size_t *bytes = (size_t *) malloc((count + 1) * sizeof(size_t));
+	size_t *chars = (size_t *) malloc((count + 1) * sizeof(size_t));
+	if (!bytes || !chars) {
+		free(bytes);
+		free(chars);
+		return 0;
+	}
+	free(index->bytes);
+	free(index->chars);
+	index->bytes = bytes;
+	index->chars = chars;
+	index->block_count = count;
+	for (i = 0; i < count; i++) {
+		size_t begin = i * index->block_size;
+		size_t size = i == count - 1 ? len - begin : index->block_size;
+		bytes[i + 1] = size;
+		chars[i + 1] = count_chars((const unsigned char *) text + begin, size);
+	}
+	make_trees(index);
+	return 1;
+}
+
+struct utf8_index *utf8_index_build(const char *text, size_t len, size_t block_size)
+{
+	struct utf8_index *index = (struct utf8_index *) calloc(1, sizeof(struct utf8_index));
+	if (!index)
+		return NULL;
+	index->block_size = block_size ? block_size : UTF8_INDEX_BLOCK;
+	if (!index_text(index, text, len)) {
+		free(index);
+		return NULL;
+	}
+	return index;
+}
+
+void utf8_index_free(struct utf8_index *index)
+{
+	if (index) {
+		free(index->bytes);
+		free(index->chars);
+		free(index);
+	}
+}
+
+size_t utf8_index_count(const struct utf8_index *index)
+{
+	return prefix_sum(index->chars, index->block_count);
+}
+
+size_t utf8_index_offset(const struct utf8_index *index, const char *text, size_t n)
+{
+	size_t start, chars;
+	size_t i = find_block(index, index->chars, index->bytes, n, &chars, &start);
+	size_t size = prefix_sum(index->bytes, i + 1) - start;
+	return start + skip_chars((const unsigned char *) text + start, size, n - chars);
+}
+
+size_t utf8_index_char(const struct utf8_index *index, const char *text, size_t offset)
+{
+	size_t start, chars;
+	size_t i = find_block(index, index->bytes, index->chars, offset, &start, &chars);
+	size_t size = prefix_sum(index->bytes, i + 1) - start;
+	return chars + count_chars((const unsigned char *) text + start, offset - start < size ? offset - start : size);
+}
+
+void utf8_index_update(struct utf8_index *index, const char *text, size_t offset, size_t removed, size_t inserted)
+{
+	size_t start, chars, end, i;
+	size_t first = find_block(index, index->bytes, index->chars, offset, &start, &chars);
+	size_t last = removed ? find_block(index, index->bytes, index->chars, offset + removed - 1, &end, &chars) : first;
+	size_t new_bytes, new_chars;
+	// The edited blocks are joined into the first one, the rest of them become empty.
+	end = prefix_sum(index->bytes, last + 1) - removed + inserted;
+	new_bytes = end - start;
+	new_chars = count_chars((const unsigned char *) text + start, new_bytes);
+	for (i = first; i <= last; i++) {
+		size_t old_bytes = prefix_sum(index->bytes, i + 1) - prefix_sum(index->bytes, i);
+		size_t old_chars = prefix_sum(index->chars, i + 1) - prefix_sum(index->chars, i);
+		tree_add(index->bytes, index->block_count, i, (i == first ? new_bytes : 0) - old_bytes);
+		tree_add(index->chars, index->block_count, i, (i == first ? new_chars : 0) - old_chars);
+	}
+	if (new_bytes > index->block_size * 4)
+		index_text(index, text, prefix_sum(index->bytes, index->block_count));
+}
+
+#ifdef TESTS
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+// Checks every code point and every offset against a scan of the text.
+static void check_index(const struct utf8_index *index, const char *text, size_t len)
+{
+	size_t i, n = 0;
+	for (i = 0; i < len; i++) {
+		ASSERT(utf8_index_char(index, text, i) == n);
+		if ((text[i] & 0xc0) != 0x80) {
+			ASSERT(utf8_index_offset(index, text, n) == i);
+			n++;
+		}
+	}
+	ASSERT(utf8_index_count(index) == n);
+	ASSERT(utf8_index_char(index, text, len) == n);
+	ASSERT(utf8_index_offset(index, text, n) == len && utf8_index_offset(index, text, n + 5) == len);
+}
+
+void utf8_index_tests()
+{
+	static const char *chars[] = { "a", " ", "\xc3\xa9", "\xd0\xbf", "\xe2\x82\xac", "\xe4\xb8\xad", "\xf0\x9f\x98\x80", "\x80", "\xff" };
+	enum { N = 3000 };
+	char *text = (char *) malloc(N * 8), *edited = (char *) malloc(N * 8);
+	size_t len = 0;
+	unsigned int seed = 9;
+	int round;
+	struct utf8_index *index;
+
+	index = utf8_index_build("", 0, 0);
+	ASSERT(index && utf8_index_count(index) == 0 && utf8_index_offset(index, "", 0) == 0);
+	utf8_index_update(index, "ab\xc3\xa9", 0, 0, 4);
+	check_index(index, "ab\xc3\xa9", 4);
+	utf8_index_free(index);
+
+	while (len < N) {
+		const char *c;
+		seed = seed * 1103515245 + 12345;
+		// Runs of one script, long enough for the vectors.
+		c = chars[(seed >> 16) % 100 < 2 ? 7 + (seed >> 8) % 2 : (len / 200) % 7];
+		memcpy(text + len, c, strlen(c));
+		len += strlen(c);
+	}
+	index = utf8_index_build(text, len, 1000);
+	check_index(index, text, len);
+	utf8_index_free(index);
+
+	index = utf8_index_build(text, len, 37);
+	check_index(index, text, len);
+	for (round = 0; round < 300; round++) {
+		// Random replacements, some of them across many blocks, some growing a block past the rebuild.
+		size_t at, removed, inserted = 0, i;
+		seed = seed * 1103515245 + 12345;
+		at = (seed >> 8) % (len + 1);
+		removed = round % 5 ? (seed >> 4) % 8 : (seed >> 4) % 400;
+		if (removed > len - at)
+			removed = len - at;
+		for (i = 0; i < (size_t) (round % 3 ? 5 : 200); i++) {
+			const char *c = chars[(seed + i * 7) % 9];
+			memcpy(edited + at + inserted, c, strlen(c));
+			inserted += strlen(c);
+		}
+		memcpy(edited, text, at);
+		memcpy(edited + at + inserted, text + at + removed, len - at - removed);
+		len = len - removed + inserted;
+		memcpy(text, edited, len);
+		utf8_index_update(index, text, at, removed, inserted);
+		if (round % 10 == 0 || round > 290)
+			check_index(index, text, len);
+		ASSERT(utf8_index_count(index) == count_chars((const unsigned char *) text, len));
+		if (len > N * 4)
+			len = N * 2;
+		if (len == N * 2) {
+			utf8_index_free(index);
+			index = utf8_index_build(text, len, 37);
+		}
+	}
+	utf8_index_free(index);
+	free(text);
+	free(edited);
+}
+
+#endif //TESTS
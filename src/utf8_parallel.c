@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Parallel versions of utf8_decode_buf, utf8_to_utf16 and utf8_validate for big mapped files,
+// running on thread_count threads (<= 0 - one per CPU). Results are the same as of the single-threaded
+// functions, including the cap rules, surrogate pairs split between chunks and error offsets.
+// Texts shorter than a megabyte per thread are processed in fewer chunks.
+// Sample:
+//    const char *text = map_file("dump.txt", &len);
+//    if (utf8_validate_parallel(text, len, 0, 0) == len) {
+//      size_t n = utf8_decode_parallel(text, len, NULL, 0, 0);
+//      int *chars = malloc(n * sizeof(int));
+//      utf8_decode_parallel(text, len, chars, n, 0);
+//
+size_t utf8_decode_parallel(const char *src, size_t len, int *dst, size_t cap, int thread_count);
+size_t utf8_to_utf16_parallel(const char *src, size_t len, unsigned short *dst, size_t cap, int thread_count);
+size_t utf8_validate_parallel(const char *src, size_t len, int allow_surrogates, int thread_count);
+
+size_t utf8_decode_buf(const char *src, size_t len, int *dst, size_t cap);
+size_t utf8_to_utf16(const char *src, size_t len, unsigned short *dst, size_t cap);
+size_t utf8_validate(const char *src, size_t len, int allow_surrogates);
+void parallel_for(int task_count, int thread_count, void (*task)(void *context, int i), void *context);
+int cpu_count(void);
+
+#define UTF8_PARALLEL_MIN_CHUNK (1 << 20)
+
+struct utf8_chunk {
+	size_t begin, end;
+	size_t out_begin, out_size; // in output units, or the error offset for validation
+};
+
+struct utf8_job {
+	const char *src;
+	struct utf8_chunk *chunks;
+	size_t (*convert)(const char *src, size_t len, void *dst, size_t cap);
+	char *dst;
+	size_t cap;
+	size_t unit;           // bytes per output unit
+	int allow_surrogates;
+};
+
+static size_t decode_chunk(const char *src, size_t len, void *dst, size_t cap)
+{
+	return utf8_decode_buf(src, len, (int *) dst, cap);
+}
+
+static size_t utf16_chunk(const char *src, size_t len, void *dst, size_t cap)
+{
+	return utf8_to_utf16(src, len, (unsigned short *) dst, cap);
+}
+
+//
+// Moves a split point forward to a complete sequence that doesn't decode to a low surrogate,
+// overlong forms included, as get_utf8 decodes them too.
+// Any sequence cut by the split is dropped there anyway, and a high surrogate before it stays unpaired,
+// so the parts decode separately to the same characters as the whole text.
+//
+static size_t resync(const unsigned char *s, size_t i, size_t len)
+{
+	for (; i < len; i++) {
+		int b = s[i];
+		size_t n = b < 0x80 ? 1 : (b & 0xe0) == 0xc0 ? 2 : (b & 0xf0) == 0xe0 ? 3 : (b & 0xf8) == 0xf0 ? 4 : 0;
+		size_t k = 1;
+		int v = n == 1 ? b : b & (0x7f >> n);
+		if (n == 0 || len - i < n)
+			continue;
+		for (; k < n && (s[i + k] & 0xc0) == 0x80; k++)
+			v = v << 6 | (s[i + k] & 0x3f);
+		if (k == n && (v < 0xdc00 || v > 0xdfff))
+			return i;
+	}
+	return len;
+}
+
+static struct utf8_chunk *split_chunks(const char *src, size_t len, int thread_count, size_t min_chunk, int *chunk_count)
+{
+	struct utf8_chunk *chunks;
+	int i;
+	if (thread_count <= 0)
+		thread_count = cpu_count();
+	// A few chunks per thread to balance scripts decoding at different speeds.
+	*chunk_count = len / min_chunk < (size_t) thread_count * 4 ?
+		(int) (len / min_chunk) + 1 :
+		thread_count * 4;
+	chunks = (struct utf8_chunk *) calloc(*chunk_count, sizeof(struct utf8_chunk));
+	if (!chunks)
+		return NULL;
+	for (i = 0; i < *chunk_count; i++) {
+		size_t begin = i == 0 ? 0 : chunks[i - 1].end;
+		size_t end = i == *chunk_count - 1 ? len : len / *chunk_count * (i + 1);
+		chunks[i].begin = begin;
+		chunks[i].end = end < begin ? begin : resync((const unsigned char *) src, end, len);
+	}
+	return chunks;
+}
+
+static void measure_chunk(void *context, int i)
+{
+	struct utf8_job *job = (struct utf8_job *) context;
+	struct utf8_chunk *c = &job->chunks[i];
+	c->out_size = job->convert(job->src + c->begin, c->end - c->begin, NULL, 0);
+}
+
+static void convert_chunk(void *context, int i)
+{
+	struct utf8_job *job = (struct utf8_job *) context;
+	struct utf8_chunk *c = &job->chunks[i];
+	if (c->out_begin < job->cap) {
+		size_t cap = job->cap - c->out_begin < c->out_size ? job->cap - c->out_begin : c->out_size;
+		job->convert(job->src + c->begin, c->end - c->begin, job->dst + c->out_begin * job->unit, cap);
+	}
+}
+
+static void validate_chunk(void *context, int i)
+{
+	struct utf8_job *job = (struct utf8_job *) context;
+	struct utf8_chunk *c = &job->chunks[i];
+	c->out_size = utf8_validate(job->src + c->begin, c->end - c->begin, job->allow_surrogates);
+}
+
+static size_t convert_parallel(struct utf8_job *job, size_t len, int thread_count, size_t min_chunk)
+{
+	int chunk_count, i;
+	size_t r = 0;
+	job->chunks = split_chunks(job->src, len, thread_count, min_chunk, &chunk_count);
+	if (!job->chunks)
+		return job->convert(job->src, len, job->dst, job->cap);
+	// Chunk sizes first, their prefix sums tell where each chunk's output goes.
+	parallel_for(chunk_count, thread_count, measure_chunk, job);
+	for (i = 0; i < chunk_count; i++) {
+		job->chunks[i].out_begin = r;
+		r += job->chunks[i].out_size;
+	}
+	// A chunk that doesn't fit stores its beginning, chunks after it store nothing.
+	if (job->cap > r)
+		job->cap = r;
+	parallel_for(chunk_count, thread_count, convert_chunk, job);
+	free(job->chunks);
+	return r;
+}
+
+static size_t decode_parallel(const char *src, size_t len, int *dst, size_t cap, int thread_count, size_t min_chunk)
+{
+	struct utf8_job job;
+	job.src = src;
+	job.convert = decode_chunk;
+	job.dst = (char *) dst;
+	job.cap = cap;
+	job.unit = sizeof(int);
+	return convert_parallel(&job, len, thread_count, min_chunk);
+}
+
+static size_t to_utf16_parallel(const char *src, size_t len, unsigned short *dst, size_t cap, int thread_count, size_t min_chunk)
+{
+	struct utf8_job job;
+	job.src = src;
+	job.convert = utf16_chunk;
+	job.dst = (char *) dst;
+	job.cap = cap;
+	job.unit = sizeof(unsigned short);
+	return convert_parallel(&job, len, thread_count, min_chunk);
+}
+
+static size_t validate_parallel(const char *src, size_t len, int allow_surrogates, int thread_count, size_t min_chunk)
+{
+	struct utf8_job job;
+	int chunk_count, i;
+	size_t r = len;
+	job.src = src;
+	job.allow_surrogates = allow_surrogates;
+	job.chunks = split_chunks(src, len, thread_count, min_chunk, &chunk_count);
+	if (!job.chunks)
+		return utf8_validate(src, len, allow_surrogates);
+	parallel_for(chunk_count, thread_count, validate_chunk, &job);
+	for (i = 0; i < chunk_count; i++) {
+		struct utf8_chunk *c = &job.chunks[i];
+		if (c->out_size != c->end - c->begin) {
+			r = c->begin + c->out_size;
+			break;
+		}
+	}
+	free(job.chunks);
+	return r;
+}
+
+size_t utf8_decode_parallel(const char *src, size_t len, int *dst, size_t cap, int thread_count)
+{
+	return decode_parallel(src, len, dst, cap, thread_count, UTF8_PARALLEL_MIN_CHUNK);
+}
+
+size_t utf8_to_utf16_parallel(const char *src, size_t len, unsigned short *dst, size_t cap, int thread_count)
+{
+	return to_utf16_parallel(src, len, dst, cap, thread_count, UTF8_PARALLEL_MIN_CHUNK);
+}
+
+size_t utf8_validate_parallel(const char *src, size_t len, int allow_surrogates, int thread_count)
+{
+	return validate_parallel(src, len, allow_surrogates, thread_count, UTF8_PARALLEL_MIN_CHUNK);
+}
+
+#ifdef TESTS
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+void utf8_parallel_tests()
+{
+	// Short chunks of random ill-formed text with surrogates, so every kind of split is met.
+	static const unsigned char bytes[] = {
+		'a', 0, 0x80, 0x8d, 0x8f, 0xa0, 0xb0, 0xbf, 0xc2, 0xdf, 0xe0, 0xe2, 0xed, 0xef, 0xf0, 0xf4, 0xf8 };
+	enum { N = 4000 };
+	unsigned char *text = (unsigned char *) malloc(N);
+	int *expected = (int *) malloc(N * sizeof(int)), *decoded = (int *) malloc(N * sizeof(int));
+	unsigned short *expected16 = (unsigned short *) malloc(N * 2 * sizeof(short));
+	unsigned short *decoded16 = (unsigned short *) malloc(N * 2 * sizeof(short));
+	unsigned int seed = 5;
+	size_t n;
+	int round;
+	for (round = 0; round < 300; round++) {
+		size_t len = N - round, n16, i, cap;
+		int k;
+		for (i = 0; i < len; i++) {
+			seed = seed * 1103515245 + 12345;
+			// Mostly valid text with surrogate pairs on odd rounds.
+			text[i] = round % 2 && (seed >> 16) % 8 ? (unsigned char) "\xed\xa0\x81\xed\xb0\x80z\xc3\xa9"[(seed >> 20) % 9] : bytes[(seed >> 16) % sizeof(bytes)];
+		}
+		n = utf8_decode_buf((char *) text, len, expected, N);
+		n16 = utf8_to_utf16((char *) text, len, expected16, N * 2);
+		cap = round % 3 ? N : n / 2;
+		memset(decoded, 0x55, N * sizeof(int));
+		ASSERT(decode_parallel((char *) text, len, decoded, cap, 3, 64 + round) == n);
+		ASSERT(memcmp(decoded, expected, (cap < n ? cap : n) * sizeof(int)) == 0);
+		ASSERT(cap >= n || decoded[cap] == 0x55555555);
+		ASSERT(to_utf16_parallel((char *) text, len, decoded16, N * 2, 2, 50 + round) == n16);
+		ASSERT(memcmp(decoded16, expected16, n16 * sizeof(short)) == 0);
+		for (k = 0; k < 2; k++)
+			ASSERT(validate_parallel((char *) text, len, k, 4, 32 + round) == utf8_validate((char *) text, len, k));
+	}
+	for (round = 0; round < 100; round++) {
+		// Valid text with one error.
+		size_t len = N - round, i, at = (size_t) round * 37;
+		for (i = 0; i + 3 <= len; i += 3)
+			memcpy(text + i, "\xe2\x82\xac", 3);
+		for (; i < len; i++)
+			text[i] = 'x';
+		text[at] = 0xff;
+		ASSERT(validate_parallel((char *) text, len, 0, 4, 100) == at - at % 3);
+		ASSERT(utf8_validate((char *) text, len, 0) == at - at % 3);
+	}
+	// An overlong low surrogate at the split still pairs with the high one before it.
+	memset(text, 'a', 400);
+	memcpy(text + 77, "\xed\xa0\x80\xf0\x8d\xb0\x80", 7);
+	n = utf8_decode_buf((char *) text, 400, expected, N);
+	ASSERT(n == 394 && decode_parallel((char *) text, 400, decoded, N, 2, 100) == n);
+	ASSERT(memcmp(decoded, expected, n * sizeof(int)) == 0);
+	ASSERT(utf8_decode_parallel("", 0, NULL, 0, 0) == 0);
+	ASSERT(utf8_validate_parallel("a\xc3\xa9", 3, 0, 0) == 3);
+	free(text);
+	free(expected);
+	free(decoded);
+	free(expected16);
+	free(decoded16);
+}
+
+#endif //TESTS
@@ -0,0 +1,98 @@
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gunit.h"
+#include "utf8.hpp"
+
+// The C versions to compare with, link utf8.c as C.
+extern "C" int get_utf8(int (*get_fn)(void* context), void* get_fn_context);
+extern "C" int put_utf8(int character, int (*put_fn)(int ch, void* context), void* put_fn_context);
+
+namespace {
+
+struct limited {
+  const unsigned char* p;
+  const unsigned char* end;
+};
+
+int get_limited(void* context) {
+  limited* l = static_cast<limited*>(context);
+  return l->p == l->end ? -1 : *l->p++;
+}
+
+int put_string(int v, void* context) {
+  static_cast<std::string*>(context)->push_back(static_cast<char>(v));
+  return 1;
+}
+
+}  // namespace
+
+TEST(Utf8, EncodeDecode) {
+  std::string out;
+  auto o = std::back_inserter(out);
+  for (int c = 0; c <= 0x10ffff; c++) {
+    if (c >= 0xD800 && c <= 0xDFFF)
+      continue;
+    out.clear();
+    ASSERT_EQ(put_utf8(c, o), 1);
+    std::string expected;
+    put_utf8(c, put_string, &expected);
+    ASSERT_TRUE(out == expected);
+    std::pair<const char*, const char*> in(out.data(), out.data() + out.size());
+    ASSERT_EQ(get_utf8(in), c ? c : 0);
+    ASSERT_EQ(get_utf8(in), -1);
+  }
+  ASSERT_EQ(put_utf8(0x110000, o), 0);
+}
+
+TEST(Utf8, Sources) {
+  const char* text = "a\xd0\xbf\xed\xa0\x81\xed\xb0\x80z";
+  const char* p = text;
+  ASSERT_EQ(get_utf8(p), 'a');
+  ASSERT_EQ(get_utf8(p), 0x43f);
+  ASSERT_EQ(get_utf8(p), 0x10400);
+  ASSERT_EQ(get_utf8(p), 'z');
+  ASSERT_EQ(get_utf8(p), 0);
+  std::string s(text);
+  auto it = s.begin();
+  ASSERT_EQ(get_utf8(it), 'a');
+  ASSERT_EQ(get_utf8(it), 0x43f);
+  int calls = 0;
+  auto fn = [&calls, q = text]() mutable { return calls++ < 4 ? static_cast<unsigned char>(*q++) : -2; };
+  ASSERT_EQ(get_utf8(fn), 'a');
+  ASSERT_EQ(get_utf8(fn), 0x43f);
+  ASSERT_EQ(get_utf8(fn), -2);  // cut in the middle of the high surrogate
+  char buf[4];
+  char* d = buf;
+  ASSERT_EQ(put_utf8(0x10400, d), 1);
+  ASSERT_TRUE(d == buf + 4 && std::memcmp(buf, "\xf0\x90\x90\x80", 4) == 0);
+  int left = 2;
+  auto limited_sink = [&left](int) { return left--; };
+  ASSERT_EQ(put_utf8(0x10400, limited_sink), 0);
+  ASSERT_EQ(left, -1);
+}
+
+TEST(Utf8, SameAsC) {
+  // Random bytes biased to utf8-like and surrogate sequences must decode the same in C and C++.
+  std::srand(7);
+  std::vector<unsigned char> bytes;
+  for (int round = 0; round < 2000; round++) {
+    bytes.clear();
+    int n = std::rand() % 40;
+    for (int i = 0; i < n; i++) {
+      static const unsigned char samples[] = {'a', 0x80, 0xbf, 0xc3, 0xd0, 0xe2, 0xed, 0xa0, 0xb0, 0xf0, 0xf4, 0x90, 0xff};
+      bytes.push_back(std::rand() % 4 ? samples[std::rand() % sizeof(samples)] : std::rand() % 256);
+    }
+    limited c_src{bytes.data(), bytes.data() + bytes.size()};
+    std::pair<const unsigned char*, const unsigned char*> range(c_src.p, c_src.end);
+    int expected;
+    do {
+      expected = get_utf8(get_limited, &c_src);
+      ASSERT_EQ(get_utf8(range), expected);
+      ASSERT_TRUE(range.first == c_src.p);
+    } while (expected > 0);
+  }
+}
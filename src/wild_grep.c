@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __cplusplus
+
+typedef int bool;
+#define true  1
+#define false 0
+
+#endif
+
+//
+// Finds all lines of data[0..size) matching the wildcard (see eq_wild) using thread_count threads
+// (<= 0 - one per CPU). Lines are separated by '\n', which is not a part of the matched text.
+// The data is split into line-aligned chunks matched in parallel,
+// but on_match is called from the calling thread for each matching line in input order.
+// Returns the number of matching lines, or -1 if out of memory.
+// Sample:
+//    size_t size;
+//    const char *data = map_file("log.txt", &size);
+//    long long n = wild_grep(data, size, "*error*", 0, print_line, &data);
+//
+long long wild_grep(
+	const char *data,
+	size_t size,
+	const char *wildcard,
+	int thread_count,
+	void (*on_match)(void *context, size_t line_offset, size_t line_length),
+	void *context);
+
+//
+// Writes all lines of the file matching the wildcard to out, in input order.
+// Returns the number of matching lines, or -1 if the file can't be read or out of memory.
+//
+long long wild_grep_file(const char *file_name, const char *wildcard, int thread_count, FILE *out);
+
+struct wild_pattern;
+struct wild_pattern *wild_compile(const char *wildcard);
+bool eq_wild_compiled(const struct wild_pattern *pattern, const char *text, size_t text_len);
+void parallel_for(int task_count, int thread_count, void (*task)(void *context, int i), void *context);
+int cpu_count(void);
+const char *map_file(const char *file_name, size_t *out_size);
+void unmap_file(const char *data, size_t size);
+
+#define WILD_GREP_MIN_CHUNK (1 << 20)
+
+struct grep_match {
+	size_t offset;
+	size_t length;
+};
+
+struct grep_chunk {
+	size_t begin, end;
+	struct grep_match *matches;
+	size_t count, capacity;
+	bool out_of_memory;
+};
+
+struct grep_job {
+	const char *data;
+	const struct wild_pattern *pattern;
+	struct grep_chunk *chunks;
+};
+
+static void grep_chunk(void *context, int i) {
+	struct grep_job *job = (struct grep_job *) context;
+	struct grep_chunk *c = &job->chunks[i];
+	const char *line = job->data + c->begin;
+	const char *end = job->data + c->end;
+	while (line < end) {
+		const char *eol = (const char *) memchr(line, '\n', end - line);
+		size_t len = (eol ? eol : end) - line;
+		if (eq_wild_compiled(job->pattern, line, len)) {
+			if (c->count == c->capacity) {
+				size_t capacity = c->capacity ? c->capacity * 2 : 256;
+				struct grep_match *m = (struct grep_match *) realloc(c->matches, capacity * sizeof(struct grep_match));
+				if (!m) {
+					c->out_of_memory = true;
+					return;
+				}
+				c->matches = m;
+				c->capacity = capacity;
+			}
+			c->matches[c->count].offset = line - job->data;
+			c->matches[c->count].length = len;
+			c->count++;
+		}
+		line += len + 1;
+	}
+}
+
+long long wild_grep(
+	const char *data,
+	size_t size,
+	const char *wildcard,
+	int thread_count,
+	void (*on_match)(void *context, size_t line_offset, size_t line_length),
+	void *context)
+{
+	struct grep_job job;
+	long long r = 0;
+	int chunk_count, i;
+	if (thread_count <= 0)
+		thread_count = cpu_count();
+	// A few chunks per thread to balance chunks having different match rates.
+	chunk_count = size / WILD_GREP_MIN_CHUNK < (size_t) thread_count * 4 ?
+		(int) (size / WILD_GREP_MIN_CHUNK) + 1 :
+		thread_count * 4;
+	job.data = data;
+	job.pattern = wild_compile(wildcard);
+	job.chunks = (struct grep_chunk *) calloc(chunk_count, sizeof(struct grep_chunk));
+	if (!job.pattern || !job.chunks) {
+		free((void *) job.pattern);
+		free(job.chunks);
+		return -1;
+	}
+	for (i = 0; i < chunk_count; i++) {
+		size_t begin = i == 0 ? 0 : job.chunks[i - 1].end;
+		size_t end = i == chunk_count - 1 ? size : size / chunk_count * (i + 1);
+		if (end < begin)
+			end = begin;
+		else if (end < size && end > 0) {
+			const char *eol = (const char *) memchr(data + end - 1, '\n', size - end + 1);
+			end = eol ? eol - data + 1 : size;
+		}
+		job.chunks[i].begin = begin;
+		job.chunks[i].end = end;
+	}
+	parallel_for(chunk_count, thread_count, grep_chunk, &job);
+	for (i = 0; i < chunk_count; i++) {
+		if (job.chunks[i].out_of_memory)
+			r = -1;
+	}
+	for (i = 0; i < chunk_count; i++) {
+		struct grep_chunk *c = &job.chunks[i];
+		size_t j;
+		if (r >= 0) {
+			for (j = 0; j < c->count; j++)
+				on_match(context, c->matches[j].offset, c->matches[j].length);
+			r += c->count;
+		}
+		free(c->matches);
+	}
+	free(job.chunks);
+	free((void *) job.pattern);
+	return r;
+}
+
+struct grep_output {
+	const char *data;
+	FILE *out;
+};
+
+static void write_line(void *context, size_t offset, size_t length) {
+	struct grep_output *o = (struct grep_output *) context;
+	fwrite(o->data + offset, 1, length, o->out);
+	fputc('\n', o->out);
+}
+
+long long wild_grep_file(const char *file_name, const char *wildcard, int thread_count, FILE *out) {
+	struct grep_output o;
+	size_t size;
+	long long r;
+	o.data = map_file(file_name, &size);
+	o.out = out;
+	if (!o.data)
+		return -1;
+	r = wild_grep(o.data, size, wildcard, thread_count, write_line, &o);
+	unmap_file(o.data, size);
+	return r;
+}
+
+#ifdef WILD_GREP_MAIN
+
+//
+// Command line tool: wild_grep [-t threads] [-c] wildcard file
+// Prints lines of the file matching the wildcard, or their count with -c.
+//
+
+static void count_line(void *context, size_t offset, size_t length) {}
+
+int main(int argc, char **argv) {
+	int thread_count = 0;
+	bool count_only = false;
+	long long r;
+	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+		if (strcmp(argv[1], "-c") == 0)
+			count_only = true;
+		else if (strcmp(argv[1], "-t") == 0 && argc > 2)
+			thread_count = atoi(argv[2]), argc--, argv++;
+		else
+			break;
+	}
+	if (argc != 3) {
+		fprintf(stderr, "usage: wild_grep [-t threads] [-c] wildcard file\n");
+		return 2;
+	}
+	if (count_only) {
+		size_t size;
+		const char *data = map_file(argv[2], &size);
+		r = data ? wild_grep(data, size, argv[1], thread_count, count_line, NULL) : -1;
+		if (data)
+			unmap_file(data, size);
+		if (r >= 0)
+			printf("%lld\n", r);
+	} else
+		r = wild_grep_file(argv[2], argv[1], thread_count, stdout);
+	if (r < 0) {
+		fprintf(stderr, "wild_grep: can't read %s\n", argv[2]);
+		return 2;
+	}
+	return r ? 0 : 1;
+}
+
+#endif //WILD_GREP_MAIN
+
+#ifdef TESTS
+
+void fail(const char* msg);
+#define STRINGIFY(v) _STRINGIFY(v)
+#define _STRINGIFY(v) #v
+#define ASSERT(C) if (!(C)) fail(STRINGIFY(C));
+
+struct collected {
+	size_t offsets[16];
+	size_t lengths[16];
+	int count;
+};
+
+static void collect(void *context, size_t offset, size_t length) {
+	struct collected *c = (struct collected *) context;
+	c->offsets[c->count] = offset;
+	c->lengths[c->count++] = length;
+}
+
+static void count_matches(void *context, size_t offset, size_t length) {
+	++*(long long *) context;
+}
+
+void wild_grep_tests()
+{
+	const char *text = "asdf\nqwer\nxasdf\n\nasd";
+	struct collected c = {0};
+	ASSERT(wild_grep(text, strlen(text), "*as*", 3, collect, &c) == 3);
+	ASSERT(c.count == 3);
+	ASSERT(c.offsets[0] == 0 && c.lengths[0] == 4);
+	ASSERT(c.offsets[1] == 10 && c.lengths[1] == 5);
+	ASSERT(c.offsets[2] == 17 && c.lengths[2] == 3);
+
+	c.count = 0;
+	ASSERT(wild_grep(text, strlen(text), "", 2, collect, &c) == 1);
+	ASSERT(c.offsets[0] == 16 && c.lengths[0] == 0);
+
+	c.count = 0;
+	ASSERT(wild_grep(text, 0, "*", 2, collect, &c) == 0);
+
+	{
+		// Enough lines for several chunks, every 7th matches.
+		size_t size = WILD_GREP_MIN_CHUNK * 3 + 5;
+		char *big = (char *) malloc(size);
+		long long expected = 0, matched = 0;
+		size_t i, line = 0;
+		for (i = 0; i < size; i++) {
+			if (i % 10 == 9) {
+				big[i] = '\n';
+				line++;
+			} else
+				big[i] = line % 7 == 0 && i % 10 == 5 ? 'x' : 'a';
+		}
+		for (i = 0; i <= line; i++)
+			expected += i % 7 == 0 && (i < line || size % 10 > 5);
+		ASSERT(wild_grep(big, size, "a*x*", 4, count_matches, &matched) == expected);
+		ASSERT(matched == expected);
+		free(big);
+	}
+}
+
+#endif //TESTS